@@ -0,0 +1,205 @@
+#ifndef BENCH_HPP_INCLUDED
+#define BENCH_HPP_INCLUDED
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+/**
+ * Tiny helpers shared by the bench_*.cpp programs. A bench_timer measures
+ * wall clock time from construction (or restart()) until ns().
+ */
+class bench_timer
+{
+	typedef std::chrono::steady_clock clock;
+	clock::time_point start_;
+
+public:
+	bench_timer() : start_(clock::now()) {}
+	void restart() { start_ = clock::now(); }
+	double ns() const
+	{
+		return std::chrono::duration<double,std::nano>(
+			clock::now() - start_).count();
+	}
+};
+
+/**
+ * Energy counters of the Linux powercap interface (RAPL on x86): the
+ * package zones intel-rapl:P and their "core" subzones, summed over all
+ * packages. Package energy includes everything else the package did in
+ * the meantime (other cores, uncore, idle power), so measure on an
+ * otherwise idle machine. The counters tick about once per millisecond;
+ * runs should take tens of milliseconds at least.
+ *
+ * available() is false where there are no readable counters, e.g. in
+ * virtual machines, on other architectures or because energy_uj is only
+ * readable by root; the readings are then negative.
+ */
+class bench_energy
+{
+	static const int max_zones = 16;
+
+	struct zone
+	{
+		char path[96];
+		double range_uj;  // the counter wraps at this value
+		double start_uj;
+	};
+
+	zone pkg_[max_zones], core_[max_zones];
+	int npkg_, ncore_;
+
+	static bool read_value(char const* path, char const* file, double & v)
+	{
+		char name[128];
+		std::snprintf(name,sizeof(name),"%s/%s",path,file);
+		std::FILE* const f = std::fopen(name,"r");
+		if (!f) return false;
+		bool const ok = std::fscanf(f,"%lf",&v) == 1;
+		std::fclose(f);
+		return ok;
+	}
+
+	static bool is_core(char const* path)
+	{
+		char name[128], buf[32] = "";
+		std::snprintf(name,sizeof(name),"%s/name",path);
+		std::FILE* const f = std::fopen(name,"r");
+		if (!f) return false;
+		bool const ok = std::fscanf(f,"%31s",buf) == 1;
+		std::fclose(f);
+		return ok && std::strcmp(buf,"core") == 0;
+	}
+
+	static bool open_zone(zone & z, char const* path)
+	{
+		std::snprintf(z.path,sizeof(z.path),"%s",path);
+		double v;
+		return read_value(path,"energy_uj",v)
+			&& read_value(path,"max_energy_range_uj",z.range_uj);
+	}
+
+	static void restart_zones(zone* zs, int n)
+	{
+		for (int i=0; i<n; ++i) {
+			double & v = zs[i].start_uj;
+			if (!read_value(zs[i].path,"energy_uj",v)) v = -1;
+		}
+	}
+
+	/** nJ since restart_zones(), -1 if there are none or a read failed */
+	static double total_nj(zone const* zs, int n)
+	{
+		if (!n) return -1;
+		double sum = 0;
+		for (int i=0; i<n; ++i) {
+			double v;
+			if (zs[i].start_uj < 0) return -1;
+			if (!read_value(zs[i].path,"energy_uj",v)) return -1;
+			double d = v - zs[i].start_uj;
+			if (d < 0) d += zs[i].range_uj;
+			sum += d;
+		}
+		return 1e3 * sum;
+	}
+
+public:
+	bench_energy() : npkg_(0), ncore_(0)
+	{
+		char const* const base = "/sys/class/powercap/intel-rapl";
+		char path[96];
+		for (int p=0; p<max_zones && npkg_<max_zones; ++p) {
+			std::snprintf(path,sizeof(path),"%s:%d",base,p);
+			if (!open_zone(pkg_[npkg_],path)) continue;
+			++npkg_;
+			for (int c=0; c<max_zones && ncore_<max_zones; ++c) {
+				std::snprintf(path,sizeof(path),"%s:%d:%d",base,p,c);
+				if (is_core(path) && open_zone(core_[ncore_],path)) ++ncore_;
+			}
+		}
+		restart();
+	}
+
+	bool available() const { return npkg_ > 0; }
+
+	void restart()
+	{
+		restart_zones(pkg_,npkg_);
+		restart_zones(core_,ncore_);
+	}
+
+	/**
+	 * nJ since construction or restart(); -1 without counters or if one
+	 * could not be read, rather than counting it as 0 J
+	 */
+	double package_nj() const { return total_nj(pkg_,npkg_); }
+	double core_nj() const { return total_nj(core_,ncore_); }
+};
+
+/** time and energy of a benchmark; energies are negative if unknown */
+struct bench_result
+{
+	double ns;
+	double package_nj;
+	double core_nj;
+};
+
+/**
+ * runs f() reps times and returns the time and the energies of the
+ * fastest rep, so all figures describe the same run
+ */
+template<class F>
+bench_result bench_best(F f, int reps = 5)
+{
+	bench_energy energy;
+	bench_result best = { 0, -1, -1 };
+	for (int r=0; r<reps; ++r) {
+		energy.restart();
+		bench_timer t;
+		f();
+		bench_result const res = { t.ns(), energy.package_nj(), energy.core_nj() };
+		if (r==0 || res.ns<best.ns) best = res;
+	}
+	return best;
+}
+
+/**
+ * ends a report line with the energies of r per unit of work (per of
+ * them in the run), e.g. ", 2.5 nJ/sample package, 1.8 core"
+ */
+inline void bench_report_energy(bench_result const& r, double per, char const* unit)
+{
+	if (r.package_nj >= 0) {
+		std::cout << ", " << r.package_nj / per << " nJ/" << unit << " package";
+	} else {
+		std::cout << ", energy n/a";
+	}
+	if (r.core_nj >= 0) std::cout << ", " << r.core_nj / per << " core";
+	std::cout << '\n';
+}
+
+inline void bench_report(char const* what, bench_result const& r, double samples)
+{
+	std::cout << what << ": " << r.ns / samples << " ns/sample";
+	bench_report_energy(r,samples,"sample");
+}
+
+/** vector width the lane kernels were compiled for, for the reports */
+inline char const* bench_simd_name()
+{
+#if defined(__AVX512F__)
+	return "avx512";
+#elif defined(__AVX2__)
+	return "avx2";
+#elif defined(__AVX__)
+	return "avx";
+#elif defined(__SSE2__)
+	return "sse2";
+#else
+	return "generic";
+#endif
+}
+
+#endif // BENCH_HPP_INCLUDED
@@ -0,0 +1,88 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "bench.hpp"
+#include "shaper.hpp"
+#include "waplns_bank.hpp"
+
+// Sampled cost accounting on a bank of mixed presets: the overhead of
+// set_accounting() at several sampling rates, and the per-preset table it
+// produces. Presets differ in order; odd presets also get a parameter
+// update every block, which shows up as update cost.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_accounting.cpp
+//        waplns_bank.cpp checkpoint.cpp rt_log.cpp waplns.cpp workspace.cpp
+//        -o bench_accounting -pthread
+
+int main()
+{
+	int const streams = 4096;
+	int const presets = 8;
+	int const block = 128;
+	int const blocks = 400;
+	std::vector<float> k(presets*max_wapl_filt_order);
+	int ord[presets];
+	for (int p=0; p<presets; ++p) {
+		ord[p] = 4 * (p+1);
+		for (int i=0; i<max_wapl_filt_order; ++i) {
+			k[p*max_wapl_filt_order+i] = 0.4f * std::pow(-0.8f,i);
+		}
+	}
+	waplns_bank bank(streams);
+	std::vector<int> upd;
+	std::vector<float> lams;
+	std::vector<float const*> ks;
+	for (int s=0; s<streams; ++s) {
+		int const p = s % presets;
+		bank.add_stream(0.5f,ord[p],&k[p*max_wapl_filt_order]);
+		bank.set_param_id(s,p);
+		if (p & 1) {
+			upd.push_back(s);
+			lams.push_back(0.5f);
+			ks.push_back(&k[p*max_wapl_filt_order]);
+		}
+	}
+	bank.repack();
+	std::vector<float> in(streams*block);
+	std::vector<short> out(streams*block);
+	std::vector<float const*> ip(streams);
+	std::vector<short*> op(streams);
+	for (int s=0; s<streams; ++s) {
+		ip[s] = &in[s*block];
+		op[s] = &out[s*block];
+		for (int i=0; i<block; ++i) in[s*block+i] = 3000.0f * std::sin(0.02f*i*(1+s%7));
+	}
+	pcm16_quantizer quant;
+	auto run = [&]{
+		for (int b=0; b<blocks; ++b) {
+			bank.update_params(static_cast<int>(upd.size()),&upd[0],&lams[0],&ks[0]);
+			bank.process(quant,&ip[0],&op[0],block);
+		}
+	};
+
+	int const rates[] = { 0, 1024, 64, 1 };
+	double base = 0;
+	for (int r=0; r<4; ++r) {
+		bank.set_accounting(rates[r]);
+		bench_result const res = bench_best(run,3);
+		double const samples = double(streams)*block*blocks;
+		if (r == 0) base = res.ns;
+		std::printf("accounting 1 in %4d: %.2f ns/sample, overhead %+.2f%%",
+			rates[r],res.ns / samples,100 * (res.ns/base - 1));
+		std::fflush(stdout);
+		bench_report_energy(res,samples,"sample");
+	}
+
+	bank.set_accounting(64);
+	bank.reset_costs();
+	run();
+	waplns_bank::cost table[presets];
+	int const n = bank.get_preset_costs(table,presets);
+	std::printf("preset order streams cycles/stream-block update cycles/stream\n");
+	for (int i=0; i<n; ++i) {
+		waplns_bank::cost const& c = table[i];
+		std::printf("%6u %5d %7d %19.0f %20.0f\n",c.param_id,ord[c.param_id],
+			c.streams,c.blocks ? double(c.cycles) / c.blocks : 0.0,
+			c.updates ? double(c.update_cycles) / c.updates : 0.0);
+	}
+}
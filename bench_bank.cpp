@@ -0,0 +1,70 @@
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "bench.hpp"
+#include "shaper.hpp"
+#include "waplns_bank.hpp"
+
+// A VoIP-like bank: equal 160 sample blocks versus ragged 80/160/240
+// sample blocks (same total number of samples), compared with per-stream
+// shape_block() loops.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_bank.cpp waplns_bank.cpp
+//        checkpoint.cpp rt_log.cpp waplns.cpp workspace.cpp
+//        -o bench_bank -pthread
+
+int main()
+{
+	int const streams = 1024;
+	int const ticks = 100;
+	int const ord = 12;
+	std::vector<float> k(ord);
+	for (int i=0; i<ord; ++i) k[i] = 0.5f * std::pow(-0.7f,i);
+
+	waplns_bank bank(streams);
+	std::vector<waplns> single(streams);
+	for (int s=0; s<streams; ++s) {
+		bank.add_stream(0.6f,ord,&k[0]);
+		single[s].set_params(0.6f,ord,&k[0]);
+	}
+	bank.repack();
+
+	int const maxlen = 240;
+	std::vector<float> in(streams*maxlen);
+	std::vector<short> out(streams*maxlen);
+	std::vector<float const*> ip(streams);
+	std::vector<short*> op(streams);
+	std::vector<int> equal(streams,160), ragged(streams);
+	for (int s=0; s<streams; ++s) {
+		ip[s] = &in[s*maxlen];
+		op[s] = &out[s*maxlen];
+		ragged[s] = 80 * (1 + std::rand() % 3);
+		for (int i=0; i<maxlen; ++i) {
+			in[s*maxlen+i] = 8000.0f * std::sin(0.01f*(s+1)*i);
+		}
+	}
+	// make both cases shape the same number of samples
+	long total = 0;
+	for (int s=0; s<streams; ++s) total += ragged[s];
+	for (int s=0; s<streams; ++s) equal[s] = total / streams;
+
+	pcm16_quantizer quant;
+	bench_result const eq = bench_best([&]{
+		for (int t=0; t<ticks; ++t) bank.process(quant,&ip[0],&op[0],&equal[0]);
+	});
+	bench_result const rg = bench_best([&]{
+		for (int t=0; t<ticks; ++t) bank.process(quant,&ip[0],&op[0],&ragged[0]);
+	});
+	bench_result const sc = bench_best([&]{
+		for (int t=0; t<ticks; ++t) {
+			for (int s=0; s<streams; ++s) {
+				shape_block(single[s],quant,ip[s],op[s],ragged[s]);
+			}
+		}
+	});
+	double const samples = double(total) * ticks;
+	bench_report("bank, equal lengths",eq,samples);
+	bench_report("bank, ragged lengths (masked lanes)",rg,samples);
+	bench_report("per-stream shape_block, ragged lengths",sc,samples);
+	std::cout << "ragged efficiency vs equal: " << eq.ns / rg.ns << '\n';
+}
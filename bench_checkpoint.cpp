@@ -0,0 +1,88 @@
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+#include "bench.hpp"
+#include "checkpoint.hpp"
+#include "shaper.hpp"
+#include "waplns_bank.hpp"
+
+// Failover of a 20k stream bank: the cost of save_state() after every
+// block next to the block itself, the time a standby bank needs to adopt
+// the snapshot, and whether it then continues with the same codes.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_checkpoint.cpp
+//        waplns_bank.cpp checkpoint.cpp rt_log.cpp waplns.cpp workspace.cpp
+//        -o bench_checkpoint -pthread
+
+int main()
+{
+	int const streams = 20000;
+	int const block = 128;
+	int const presets = 16;
+	char const* const path = "/tmp/bench_checkpoint.bin";
+	std::vector<float> k(presets*max_wapl_filt_order);
+	for (int p=0; p<presets; ++p) {
+		for (int i=0; i<max_wapl_filt_order; ++i) {
+			k[p*max_wapl_filt_order+i] = 0.4f * std::pow(-0.8f,i) * (1 + 0.02f*p);
+		}
+	}
+	waplns_bank primary(streams), standby(streams);
+	for (int s=0; s<streams; ++s) {
+		int const p = s % presets;
+		int const ord = 8 + 8 * (p % 3);
+		primary.add_stream(0.5f,ord,&k[p*max_wapl_filt_order]);
+		standby.add_stream(0.5f,ord,&k[p*max_wapl_filt_order]);
+		primary.set_param_id(s,p);
+		standby.set_param_id(s,p);
+	}
+	primary.repack();
+	standby.repack();
+
+	std::vector<float> in(streams*block);
+	std::vector<short> out(streams*block), out2(streams*block);
+	std::vector<float const*> ip(streams);
+	std::vector<short*> op(streams), op2(streams);
+	for (int s=0; s<streams; ++s) {
+		ip[s] = &in[s*block];
+		op[s] = &out[s*block];
+		op2[s] = &out2[s*block];
+		for (int i=0; i<block; ++i) in[s*block+i] = 3000.0f * std::sin(0.02f*i*(1+s%7));
+	}
+	pcm16_quantizer quant;
+
+	std::remove(path);
+	bank_checkpoint cp(path,streams);
+	if (!cp.ok()) {
+		std::cerr << "cannot map " << path << '\n';
+		return 1;
+	}
+	bench_result const process = bench_best([&]{
+		primary.process(quant,&ip[0],&op[0],block);
+	});
+	bench_result const save = bench_best([&]{
+		primary.save_state(cp);
+	});
+	std::cout << "process: " << process.ns / 1e6 << " ms per block";
+	bench_report_energy(process,1,"block");
+	std::cout << "save_state: " << save.ns / 1e6 << " ms per block ("
+		<< 100 * save.ns / process.ns << "% of process)";
+	bench_report_energy(save,1,"block");
+
+	// the standby maps the same file, as another process would
+	bank_checkpoint cp2(path,streams);
+	int adopted = 0;
+	bench_result const load = bench_best([&]{
+		adopted = standby.load_state(cp2);
+	});
+	std::cout << "load_state: " << load.ns / 1e6 << " ms, " << adopted
+		<< " of " << streams << " streams adopted";
+	bench_report_energy(load,1,"load");
+	pcm16_quantizer q1, q2;
+	primary.process(q1,&ip[0],&op[0],block);
+	standby.process(q2,&ip[0],&op2[0],block);
+	int diff = 0;
+	for (int i=0; i<streams*block; ++i) diff += out[i] != out2[i];
+	std::cout << "codes differing after failover: " << diff << '\n';
+	std::remove(path);
+}
@@ -0,0 +1,70 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "bench.hpp"
+#include "shaper.hpp"
+#include "uniform_bank.hpp"
+#include "waplns_bank.hpp"
+
+// Time and energy per shaped sample for the scalar shaper, waplns_bank
+// and uniform_bank over a few orders, 16 streams. Energy comes from the
+// powercap counters where they are readable (see bench_energy); elsewhere
+// only times are reported. The vector width is the one this program was
+// compiled for, so build it once per -march (e.g. x86-64, x86-64-v3,
+// x86-64-v4) to compare widths.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_energy.cpp uniform_bank.cpp
+//        waplns_bank.cpp checkpoint.cpp rt_log.cpp waplns.cpp workspace.cpp
+//        -o bench_energy -pthread
+
+int main()
+{
+	int const streams = 16;
+	int const n = 48000*5;
+	std::vector<float> in(streams*n);
+	std::vector<short> q(streams*n);
+	std::vector<float const*> ip(streams);
+	std::vector<short*> op(streams);
+	for (int c=0; c<streams; ++c) {
+		for (int i=0; i<n; ++i) {
+			in[c*n+i] = 9000.0f * std::sin(i*(0.011f+0.001f*c)) * std::sin(i*0.0003f);
+		}
+		ip[c] = &in[c*n];
+		op[c] = &q[c*n];
+	}
+	float k[max_wapl_filt_order];
+	for (int i=0; i<max_wapl_filt_order; ++i) k[i] = 0.5f * std::pow(-0.8f,i);
+	pcm16_quantizer quant;
+	quant.dither = 1.0f;
+	quant.thresh = 2.0f;
+	std::cout << "simd " << bench_simd_name() << ", energy counters "
+		<< (bench_energy().available() ? "available" : "not available") << '\n';
+	double const samples = double(streams) * n;
+	for (int ord=4; ord<=max_wapl_filt_order; ord*=2) {
+		waplns ns;
+		ns.set_params(0.7f,ord,k);
+		bench_result const scalar = bench_best([&]{
+			for (int c=0; c<streams; ++c) {
+				ns.reset_state();
+				shape_block(ns,quant,ip[c],op[c],n);
+			}
+		},3);
+		waplns_bank bank(streams);
+		for (int c=0; c<streams; ++c) bank.add_stream(0.7f,ord,k);
+		bank.repack();
+		bench_result const banked = bench_best([&]{
+			for (int c=0; c<streams; ++c) bank.reset_state(c);
+			bank.process(quant,&ip[0],&op[0],n);
+		},3);
+		uniform_bank ub(streams);
+		ub.set_params(0.7f,ord,k);
+		bench_result const uniform = bench_best([&]{
+			ub.reset_state();
+			ub.process(quant,&ip[0],&op[0],n);
+		},3);
+		std::cout << "order " << ord << '\n';
+		bench_report("  waplns",scalar,samples);
+		bench_report("  waplns_bank",banked,samples);
+		bench_report("  uniform_bank",uniform,samples);
+	}
+}
@@ -0,0 +1,74 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "bench.hpp"
+#include "g711.hpp"
+#include "waplns_bank.hpp"
+
+// Shaped G.711 in a bank of 8 kHz telephony streams (order 4, 20 ms
+// blocks): the lane-wise quantize_lanes() of g711_quantizer versus the
+// generic lane-by-lane quantize() loop, and what that means in channels
+// per core.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_g711.cpp g711.cpp
+//        waplns_bank.cpp checkpoint.cpp rt_log.cpp waplns.cpp workspace.cpp
+//        -o bench_g711 -pthread
+
+namespace { // anonymous
+
+/** g711_quantizer without its quantize_lanes() overload */
+struct scalar_g711
+{
+	typedef unsigned char code_type;
+	g711_quantizer q;
+	explicit scalar_g711(g711_law law) : q(law) {}
+	code_type quantize(float w, float & qlin) { return q.quantize(w,qlin); }
+	float clamp_error(float x) const { return q.clamp_error(x); }
+};
+
+} // anonymous namespace
+
+int main()
+{
+	int const streams = 1024;
+	int const ticks = 50;
+	int const block = 160;
+	int const ord = 4;
+	float k[ord];
+	for (int i=0; i<ord; ++i) k[i] = 0.5f * std::pow(-0.7f,i);
+
+	waplns_bank bank(streams);
+	for (int s=0; s<streams; ++s) bank.add_stream(0.5f,ord,k);
+	bank.repack();
+
+	std::vector<float> in(streams*block);
+	std::vector<unsigned char> out(streams*block);
+	std::vector<float const*> ip(streams);
+	std::vector<unsigned char*> op(streams);
+	for (int s=0; s<streams; ++s) {
+		ip[s] = &in[s*block];
+		op[s] = &out[s*block];
+		for (int i=0; i<block; ++i) {
+			in[s*block+i] = 6000.0f * std::sin(0.01f*(s+1)*i);
+		}
+	}
+
+	double const samples = double(streams) * block * ticks;
+	char const* const names[] = { "mu-law", "A-law" };
+	g711_law const laws[] = { g711_mulaw, g711_alaw };
+	for (int i=0; i<2; ++i) {
+		g711_quantizer lanes(laws[i]);
+		scalar_g711 scalar(laws[i]);
+		bench_result const vec = bench_best([&]{
+			for (int t=0; t<ticks; ++t) bank.process(lanes,&ip[0],&op[0],block);
+		});
+		bench_result const sc = bench_best([&]{
+			for (int t=0; t<ticks; ++t) bank.process(scalar,&ip[0],&op[0],block);
+		});
+		std::cout << names[i] << '\n';
+		bench_report("  quantize_lanes()",vec,samples);
+		bench_report("  lane by lane quantize()",sc,samples);
+		std::cout << "  8 kHz channels per core: "
+			<< 1e9 / (vec.ns / samples) / 8000.0 << '\n';
+	}
+}
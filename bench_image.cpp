@@ -0,0 +1,57 @@
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "bench.hpp"
+#include "image_shaper.hpp"
+
+// One 3840x2160 10 bit 4:2:0 frame (a slow gradient plus a little noise)
+// requantized to 8 bit, scanline order versus serpentine, order 2 and 4.
+// Also reports the largest row mean error against the 10 bit source,
+// which banding would show as.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_image.cpp image_shaper.cpp
+//        waplns.cpp -o bench_image
+
+int main()
+{
+	int const w = 3840, h = 2160;
+	int const cw = w/2, ch = h/2;
+	std::vector<uint16_t> y(w*h), u(cw*ch), v(cw*ch);
+	std::vector<unsigned char> oy(w*h), ou(cw*ch), ov(cw*ch);
+	for (int r=0; r<h; ++r) {
+		for (int c=0; c<w; ++c) {
+			y[r*w+c] = static_cast<uint16_t>(64 + 0.2f*c + (std::rand() & 1));
+		}
+	}
+	for (int i=0; i<cw*ch; ++i) {
+		u[i] = static_cast<uint16_t>(512 + (i % cw) / 16);
+		v[i] = static_cast<uint16_t>(480 + (i / cw) / 8);
+	}
+	uint16_t const* in[3] = { &y[0], &u[0], &v[0] };
+	unsigned char* out[3] = { &oy[0], &ou[0], &ov[0] };
+	int const in_stride[3] = { w, cw, cw };
+	int const out_stride[3] = { w, cw, cw };
+	double const pixels = w*h + 2.0*cw*ch;
+
+	float const k2[] = { 0.7f, -0.2f };
+	float const k4[] = { 0.7f, -0.3f, 0.15f, -0.05f };
+	for (int ord=2; ord<=4; ord+=2) {
+		image_shaper sh(0.3f,ord,ord==2 ? k2 : k4);
+		for (int serp=0; serp<2; ++serp) {
+			sh.set_serpentine(serp!=0);
+			bench_result const res = bench_best([&]{
+				sh.process_yuv(in,in_stride,10,out,out_stride,w,h,1,1);
+			});
+			double worst = 0;
+			for (int c=0; c<w; ++c) {
+				double err = 0;
+				for (int r=0; r<h; ++r) err += oy[r*w+c] - y[r*w+c] * 0.25;
+				worst = std::max(worst,std::fabs(err/h));
+			}
+			std::cout << "order " << ord << (serp ? " serpentine" : " scanline")
+				<< ": " << pixels / res.ns << " Gpixel/s, worst column mean error "
+				<< worst << " LSB";
+			bench_report_energy(res,pixels,"pixel");
+		}
+	}
+}
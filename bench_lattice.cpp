@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "bench.hpp"
+#include "fft.hpp"
+#include "warped_lattice.hpp"
+#include "wlpc.hpp"
+
+// warped_lattice as plain filters on 16 channels with k from the warped
+// LPC of the signal: spectral flatness before and after analysis, the
+// round trip error of analysis followed by synthesis, and the scalar
+// filter per channel versus warped_lattice_bank, per order.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_lattice.cpp
+//        warped_lattice.cpp wlpc.cpp fft.cpp workspace.cpp -o bench_lattice
+
+namespace { // anonymous
+
+// 10 log10(geometric / arithmetic mean) of the power spectrum, <= 0
+double flatness_db(float const* x, int n)
+{
+	int const len = 1024;
+	std::vector<double> psd(len/2 + 1);
+	welch_psd(x,n,len,&psd[0]);
+	double lg = 0, ar = 0;
+	for (int b=1; b<len/2; ++b) {
+		lg += std::log(psd[b]);
+		ar += psd[b];
+	}
+	return 10 * std::log10(std::exp(lg / (len/2 - 1)) / (ar / (len/2 - 1)));
+}
+
+} // anonymous namespace
+
+int main()
+{
+	int const channels = 16;
+	int const n = 48000*2;
+	float const lam = warp_lambda_bark(48000);
+	std::vector<float> in(channels*n), res(channels*n), back(channels*n), ref(channels*n);
+	std::vector<float const*> ip(channels), rp(channels);
+	std::vector<float*> ro(channels), bo(channels);
+	unsigned s = 1;
+	for (int c=0; c<channels; ++c) {
+		for (int i=0; i<n; ++i) {
+			s = s * 1664525u + 1013904223u;
+			in[c*n+i] = 0.3f * std::sin(i*(0.011f+0.001f*c)) * std::sin(i*0.0003f)
+				+ 0.2f * std::sin(i*0.3f)
+				+ 0.01f * (static_cast<float>(s >> 8) / 16777216 - 0.5f);
+		}
+		ip[c] = &in[c*n];
+		rp[c] = &res[c*n];
+		ro[c] = &res[c*n];
+		bo[c] = &back[c*n];
+	}
+	for (int ord=4; ord<=max_wapl_filt_order; ord*=2) {
+		double r[max_wapl_filt_order+1];
+		float k[max_wapl_filt_order];
+		warped_autocorr(&in[0],n,lam,ord,r);
+		levinson(r,ord,k);
+
+		warped_lattice f;
+		f.set_params(lam,ord,k);
+		bench_result const scalar = bench_best([&]{
+			for (int c=0; c<channels; ++c) {
+				f.reset_state();
+				f.analyze(ip[c],&ref[c*n],n);
+			}
+		},3);
+		warped_lattice_bank bank(channels,ord);
+		bank.set_params(lam,ord,k);
+		bench_result const banked = bench_best([&]{
+			bank.reset_state();
+			bank.analyze(&ip[0],&ro[0],n);
+		},3);
+		bank.reset_state();
+		bank.synthesize(&rp[0],&bo[0],n);
+
+		double err = 0, diff = 0;
+		for (int c=0; c<channels; ++c) {
+			for (int i=0; i<n; ++i) {
+				err = std::max(err,static_cast<double>(std::fabs(back[c*n+i] - in[c*n+i])));
+				diff = std::max(diff,static_cast<double>(std::fabs(res[c*n+i] - ref[c*n+i])));
+			}
+		}
+		std::cout << "order " << ord << ": flatness " << flatness_db(&in[0],n)
+			<< " dB -> " << flatness_db(&res[0],n) << " dB, round trip error " << err
+			<< ", bank vs scalar " << diff << '\n';
+		bench_report("  warped_lattice",scalar,double(channels)*n);
+		bench_report("  warped_lattice_bank",banked,double(channels)*n);
+	}
+}
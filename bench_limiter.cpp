@@ -0,0 +1,54 @@
+#include <cmath>
+#include <vector>
+#include "bench.hpp"
+#include "limiter.hpp"
+
+// Separate passes (limiter into a float buffer, then shape_block) versus
+// the fused tp_limiter::process() overload on one minute of a loud signal.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_limiter.cpp limiter.cpp
+//        waplns.cpp -o bench_limiter
+
+const float k[] = {
+	0.6f, -0.35f, 0.2f, -0.1f, 0.05f, -0.02f, 0.01f, -0.005f
+};
+
+int main()
+{
+	int const n = 48000*60;
+	std::vector<float> in(n), tmp(n);
+	std::vector<short> q1(n), q2(n);
+	for (int i=0; i<n; ++i) {
+		in[i] = 40000.0f * std::sin(i*0.031f) * std::sin(i*0.0007f);
+	}
+	float const ceiling = 32767 * 0.89f; // -1 dBTP
+	tp_limiter lim(ceiling,64,0.0005f);
+	waplns ns;
+	ns.set_params(0.5f,8,k);
+	pcm16_quantizer quant;
+	quant.thresh = 2.0f;
+
+	bench_result const separate = bench_best([&]{
+		lim.reset_state();
+		ns.reset_state();
+		lim.process(&in[0],&tmp[0],n);
+		shape_block(ns,quant,&tmp[0],&q1[0],n);
+	});
+	bench_result const fused = bench_best([&]{
+		lim.reset_state();
+		ns.reset_state();
+		lim.process(ns,quant,&in[0],&q2[0],n);
+	});
+	bench_report("limiter + shaper, separate passes",separate,n);
+	bench_report("limiter + shaper, fused",fused,n);
+
+	int peak = 0;
+	bool same = true;
+	for (int i=0; i<n; ++i) {
+		peak = std::max(peak,std::abs(int(q2[i])));
+		same = same && q1[i]==q2[i];
+	}
+	std::cout << "latency = " << lim.latency() << " samples\n"
+		<< "peak = " << peak << " (ceiling " << ceiling << ")\n"
+		<< "outputs " << (same ? "identical" : "DIFFER") << '\n';
+}
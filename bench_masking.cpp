@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "bench.hpp"
+#include "masking.hpp"
+#include "shaper.hpp"
+#include "uniform_bank.hpp"
+#include "waplns_bank.hpp"
+
+// Adaptive shaping of 48 kHz stereo in blocks of 1024. Per stereo block
+// the adaptation (masking model and fit for each channel, then the batch
+// update_params() of the bank) against the shaping alone with fixed
+// parameters: the scalar shaper per channel, waplns_bank with one stream
+// per channel, and uniform_bank with one shared filter. Plus wlpc_fit()
+// against wlpc_fitter for the fit alone.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_masking.cpp masking.cpp
+//        fft.cpp wlpc.cpp uniform_bank.cpp waplns_bank.cpp checkpoint.cpp
+//        rt_log.cpp waplns.cpp workspace.cpp -o bench_masking -pthread
+
+namespace { // anonymous
+
+void report_block(char const* what, bench_result const& r, int blocks)
+{
+	std::cout << "  " << what << ": " << r.ns / blocks * 1e-3 << " us";
+	bench_report_energy(r,blocks,"block");
+}
+
+} // anonymous namespace
+
+int main()
+{
+	double const fs = 48000;
+	int const block = 1024;
+	int const blocks = 200;
+	int const n = block * blocks;
+	std::vector<float> in[2];
+	std::vector<short> q[2];
+	for (int c=0; c<2; ++c) {
+		in[c].resize(n);
+		q[c].resize(n);
+		unsigned s = 1 + c;
+		for (int i=0; i<n; ++i) {
+			s = s * 1664525u + 1013904223u;
+			float const env = 0.5f + 0.5f * std::sin(i * 2e-4f);
+			in[c][i] = env * (3000.0f * std::sin(i * (0.057f + 0.01f*c))
+				+ 600.0f * std::sin(i * 0.61f)) + (s >> 20) * 0.05f;
+		}
+	}
+	float const lam = warp_lambda_bark(fs);
+	masking_model model(fs,block,lam);
+	pcm16_quantizer quant;
+	quant.dither = 1.0f;
+	quant.thresh = 2.0f;
+	std::cout << "48 kHz stereo, blocks of " << block << ", " << model.bands()
+		<< " bands, lambda " << lam << ", times per stereo block\n";
+
+	for (int ord=8; ord<=24; ord+=8) {
+		float k[2][max_wapl_filt_order];
+		bench_result const analysis = bench_best([&]{
+			for (int b=0; b<blocks; ++b) {
+				for (int c=0; c<2; ++c) {
+					model.analyze(&in[c][b*block]);
+					model.fit(ord,k[c]);
+				}
+			}
+		});
+		waplns_bank bank(2);
+		for (int c=0; c<2; ++c) bank.add_stream(lam,ord,k[c]);
+		int const ids[2] = { 0, 1 };
+		float const lams[2] = { lam, lam };
+		float const* const ks[2] = { k[0], k[1] };
+		bench_result const update = bench_best([&]{
+			for (int b=0; b<blocks; ++b) bank.update_params(2,ids,lams,ks);
+		});
+
+		waplns ns[2];
+		for (int c=0; c<2; ++c) ns[c].set_params(lam,ord,k[c]);
+		bench_result const scalar = bench_best([&]{
+			for (int b=0; b<blocks; ++b) {
+				for (int c=0; c<2; ++c) {
+					shape_block(ns[c],quant,&in[c][b*block],&q[c][b*block],block);
+				}
+			}
+		});
+		float const* ip[2];
+		short* op[2];
+		bench_result const banked = bench_best([&]{
+			for (int b=0; b<blocks; ++b) {
+				for (int c=0; c<2; ++c) {
+					ip[c] = &in[c][b*block];
+					op[c] = &q[c][b*block];
+				}
+				bank.process(quant,ip,op,block);
+			}
+		});
+		uniform_bank shared(2);
+		shared.set_params(lam,ord,k[0]);
+		bench_result const uniform = bench_best([&]{
+			for (int b=0; b<blocks; ++b) {
+				for (int c=0; c<2; ++c) {
+					ip[c] = &in[c][b*block];
+					op[c] = &q[c][b*block];
+				}
+				shared.process(quant,ip,op,block);
+			}
+		});
+
+		bench_result const fit_plain = bench_best([&]{
+			for (int b=0; b<blocks; ++b) wlpc_fit(model.threshold(),model.bins(),lam,ord,k[0]);
+		});
+		bench_result const fit_table = bench_best([&]{
+			for (int b=0; b<blocks; ++b) model.fitter().fit(model.threshold(),ord,k[0]);
+		});
+		double const adapt = analysis.ns + update.ns;
+		std::cout << "order " << ord << '\n';
+		report_block("masking + fit",analysis,blocks);
+		report_block("update_params",update,blocks);
+		report_block("shaping, waplns",scalar,blocks);
+		report_block("shaping, waplns_bank",banked,blocks);
+		report_block("shaping, uniform_bank",uniform,blocks);
+		std::cout << "  adaptation is " << 100 * adapt / banked.ns
+			<< "% of shaping with waplns_bank, " << 100 * adapt / uniform.ns
+			<< "% with uniform_bank, " << 100 * adapt / scalar.ns << "% with waplns\n";
+		report_block("fit alone, wlpc_fit",fit_plain,blocks);
+		report_block("fit alone, wlpc_fitter",fit_table,blocks);
+	}
+}
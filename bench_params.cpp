@@ -0,0 +1,96 @@
+#include <cmath>
+#include <vector>
+#include "bench.hpp"
+#include "shaper.hpp"
+#include "waplns_bank.hpp"
+
+// Cost of parameter updates every 128 samples on many streams: full
+// set_params(), incremental set_k()/set_lambda() and the bank's batch
+// update_params(), next to the cost of shaping the 128 samples.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_params.cpp waplns_bank.cpp
+//        checkpoint.cpp rt_log.cpp waplns.cpp workspace.cpp
+//        -o bench_params -pthread
+
+int main()
+{
+	int const streams = 4096;
+	int const ord = 16;
+	int const block = 128;
+	std::vector<float> k(streams*ord), lam(streams);
+	std::vector<float const*> kp(streams);
+	std::vector<int> ids(streams);
+	for (int s=0; s<streams; ++s) {
+		for (int i=0; i<ord; ++i) k[s*ord+i] = 0.4f * std::pow(-0.8f,i) * (1 + 0.01f*(s%16));
+		lam[s] = 0.5f + 0.0001f*s;
+		kp[s] = &k[s*ord];
+		ids[s] = s;
+	}
+
+	std::vector<waplns> single(streams);
+	waplns_bank bank(streams);
+	for (int s=0; s<streams; ++s) {
+		single[s].set_params(lam[s],ord,kp[s]);
+		bank.add_stream(lam[s],ord,kp[s]);
+	}
+	bank.repack();
+
+	std::vector<float> in(streams*block);
+	std::vector<short> out(streams*block);
+	std::vector<float const*> ip(streams);
+	std::vector<short*> op(streams);
+	for (int s=0; s<streams; ++s) {
+		ip[s] = &in[s*block];
+		op[s] = &out[s*block];
+		for (int i=0; i<block; ++i) in[s*block+i] = 3000.0f * std::sin(0.02f*i*(1+s%7));
+	}
+	pcm16_quantizer quant;
+
+	bench_result const process = bench_best([&]{
+		bank.process(quant,&ip[0],&op[0],block);
+	});
+	bench_result const full = bench_best([&]{
+		for (int s=0; s<streams; ++s) single[s].set_params(lam[s],ord,kp[s]);
+	});
+	bench_result const klast = bench_best([&]{
+		for (int s=0; s<streams; ++s) {
+			k[s*ord+ord-1] = -k[s*ord+ord-1];
+			single[s].set_k(ord-2,2,kp[s]+ord-2);
+		}
+	});
+	bench_result const lamonly = bench_best([&]{
+		for (int s=0; s<streams; ++s) {
+			lam[s] = -lam[s];
+			single[s].set_lambda(lam[s]);
+		}
+	});
+	bench_result const batch = bench_best([&]{
+		bank.update_params(streams,&ids[0],&lam[0],&kp[0]);
+	});
+
+	std::cout << "per stream, order " << ord << ":\n";
+	std::cout << "  bank, shape 128 samples: " << process.ns/streams << " ns/stream";
+	bench_report_energy(process,streams,"stream");
+	std::cout << "  set_params():            " << full.ns/streams << " ns/update";
+	bench_report_energy(full,streams,"update");
+	std::cout << "  set_k() (2 values):      " << klast.ns/streams << " ns/update";
+	bench_report_energy(klast,streams,"update");
+	std::cout << "  set_lambda():            " << lamonly.ns/streams << " ns/update";
+	bench_report_energy(lamonly,streams,"update");
+	std::cout << "  bank update_params():    " << batch.ns/streams << " ns/update";
+	bench_report_energy(batch,streams,"update");
+
+	// the batch update has to agree with the scalar one
+	for (int s=0; s<streams; ++s) {
+		single[s] = bank.stream(s);
+		lam[s] = 0.3f;
+		single[s].set_params(lam[s],ord,kp[s]);
+	}
+	bank.update_params(streams,&ids[0],&lam[0],&kp[0]);
+	double maxdiff = 0;
+	for (int s=0; s<streams; ++s) {
+		waplns const b = bank.stream(s);
+		maxdiff = std::max(maxdiff,double(std::fabs(b.u() - single[s].u())));
+	}
+	std::cout << "max |u| difference batch vs scalar update: " << maxdiff << '\n';
+}
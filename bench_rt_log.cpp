@@ -0,0 +1,134 @@
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <vector>
+#include "bench.hpp"
+#include "rt_executor.hpp"
+#include "rt_log.hpp"
+#include "waplns_bank.hpp"
+
+// Cost of rt_log_ring::log() on the producer side, drop counting when the
+// drain falls behind, and the hooks: deadline misses from rt_executor
+// (with an impossible budget), NaN resets and clamp storms from
+// waplns_bank and from the scalar shaper of a shape_job.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_rt_log.cpp rt_executor.cpp
+//        rt_log.cpp waplns_bank.cpp checkpoint.cpp waplns.cpp workspace.cpp
+//        -o bench_rt_log -pthread
+
+int main()
+{
+	std::FILE* const sink = std::tmpfile();
+	int const n = 1 << 20;
+
+	// kept records: fill most of the ring, drain it untimed, repeat
+	rt_log_ring ring(12);
+	rt_log_drain drain(sink);
+	drain.add(&ring,"bench");
+	int const batch = 4000;
+	double kept = 0;
+	for (int r=0; r<n/batch; ++r) {
+		bench_timer t;
+		for (int i=0; i<batch; ++i) ring.log(rt_log_user,0,i,float(i));
+		kept += t.ns();
+		drain.poll();
+	}
+	// dropped records: the ring is full and nobody drains
+	for (int i=0; i<batch+200; ++i) ring.log(rt_log_user,0,i);
+	uint64_t const d0 = ring.dropped();
+	bench_result const dropped = bench_best([&]{
+		for (int i=0; i<n; ++i) ring.log(rt_log_user,0,i);
+	},3);
+	// a kept batch takes microseconds, far below the period of the energy
+	// counters, so only the dropped records get an energy figure
+	std::printf("log(): %.1f ns per kept record\n",kept / (n/batch*batch));
+	std::printf("log(): %.1f ns per dropped record (%llu counted)",dropped.ns / n,
+		static_cast<unsigned long long>(ring.dropped() - d0));
+	std::fflush(stdout);
+	bench_report_energy(dropped,n,"record");
+	drain.poll();
+
+	// deadline misses: every block is late with a zero budget
+	float const k[] = { 0.5f, -0.3f, 0.1f, -0.05f };
+	int const block = 256;
+	std::vector<float> in(block,1000.0f);
+	std::vector<short> out(4*block);
+	std::vector<waplns> ns4(4);
+	std::vector<shape_job> jobs(4);
+	rt_executor ex(2,4);
+	rt_log_ring wring0, wring1;
+	for (int s=0; s<4; ++s) {
+		ns4[s].set_params(0.5f,4,k);
+		shape_job j = { &ns4[s], pcm16_quantizer(), &in[0], &out[s*block], block,
+			0, 0, s, -1 };
+		jobs[s] = j;
+		ex.add_stream(shape_job::run,&jobs[s]);
+	}
+	ex.set_log(0,&wring0);
+	ex.set_log(1,&wring1);
+	rt_log_drain wdrain(sink);
+	wdrain.add(&wring0,"worker");
+	wdrain.add(&wring1,"worker");
+	ex.start();
+	wdrain.start();
+	for (int c=0; c<100; ++c) {
+		ex.begin_cycle(0);
+		ex.wait_cycle();
+	}
+	ex.stop();
+	wdrain.stop();
+	std::printf("deadline misses: %lu counted, %llu dropped\n",
+		ex.get_counters().deadline_misses,
+		static_cast<unsigned long long>(wring0.dropped() + wring1.dropped()));
+
+	// NaN resets: one stream gets a NaN sample
+	waplns_bank bank(16);
+	for (int s=0; s<16; ++s) bank.add_stream(0.5f,4,k);
+	rt_log_ring bring;
+	bank.set_log(&bring,7);
+	std::vector<float> bin(16*block,100.0f);
+	std::vector<short> bout(16*block);
+	std::vector<float const*> ip(16);
+	std::vector<short*> op(16);
+	for (int s=0; s<16; ++s) {
+		ip[s] = &bin[s*block];
+		op[s] = &bout[s*block];
+	}
+	bin[5*block+10] = std::numeric_limits<float>::quiet_NaN();
+	pcm16_quantizer quant;
+	bank.process(quant,&ip[0],&op[0],block);
+	rt_log_record rec[4];
+	int const got = bring.drain(rec,4);
+	std::printf("NaN resets: %d record(s), stream %d, stream state after reset %g\n",
+		got,got ? rec[0].stream : -1,bank.stream(5).u());
+
+	// the same through the scalar shaper
+	rt_log_ring sring;
+	waplns sns;
+	sns.set_params(0.5f,4,k);
+	shape_job sj = { &sns, pcm16_quantizer(), &bin[5*block], &bout[5*block], block,
+		&sring, 7, 5, -1 };
+	shape_job::run(&sj);
+	int const sgot = sring.drain(rec,4);
+	std::printf("scalar NaN resets: %d record(s), stream %d, state after reset %g\n",
+		sgot,sgot ? rec[0].stream : -1,sns.u());
+
+	// clamp storms: stream 3 of the bank and the scalar job overload the
+	// quantizer, the other streams clamp nothing
+	for (int i=0; i<block; ++i) {
+		bin[3*block+i] = 60000.0f * std::sin(0.3f * i);
+		bin[5*block+i] = 100.0f;
+	}
+	bank.set_log(&bring,7,0.25f);
+	bank.process(quant,&ip[0],&op[0],block);
+	int const cgot = bring.drain(rec,4);
+	std::printf("bank clamp storms: %d record(s), stream %d, %g of %g samples\n",
+		cgot,cgot ? rec[0].stream : -1,cgot ? rec[0].a : 0.0f,cgot ? rec[0].b : 0.0f);
+	sj.in = &bin[3*block];
+	sj.storm = 0.25f;
+	shape_job::run(&sj);
+	int const csgot = sring.drain(rec,4);
+	std::printf("scalar clamp storms: %d record(s), %g of %g samples\n",
+		csgot,csgot ? rec[0].a : 0.0f,csgot ? rec[0].b : 0.0f);
+	std::fclose(sink);
+}
@@ -0,0 +1,80 @@
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include "bench.hpp"
+#include "streaming.hpp"
+#include "workspace.hpp"
+
+// Output path of a large render: copying an L1 tile of codes into a big
+// output buffer with memcpy versus stream_copy(), then whole renders with
+// shape_block() versus shape_block_streaming(), each on normal and huge
+// page buffers. A scalar shaper produces 2 bytes per tens of ns, so the
+// second part mostly shows that streaming costs nothing there.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_streaming.cpp streaming.cpp
+//        waplns.cpp workspace.cpp -o bench_streaming
+
+namespace { // anonymous
+
+char const* const page_names[] = { "normal", "transparent huge", "explicit huge" };
+
+void copy_path(workspace_pages want)
+{
+	std::size_t const bytes = std::size_t(256) << 20;
+	workspace_buffer out(bytes,want);
+	unsigned char* const o = static_cast<unsigned char*>(out.data());
+	alignas(64) unsigned char tile[stream_tile*2];
+	std::memset(tile,1,sizeof(tile));
+	std::memset(o,0,bytes); // fault the pages in
+	bench_result const regular = bench_best([&]{
+		for (std::size_t p=0; p<bytes; p+=sizeof(tile)) std::memcpy(o+p,tile,sizeof(tile));
+	},3);
+	bench_result const streamed = bench_best([&]{
+		for (std::size_t p=0; p<bytes; p+=sizeof(tile)) stream_copy(o+p,tile,sizeof(tile));
+		stream_fence();
+	},3);
+	double const mib = bytes / 1048576.0;
+	std::cout << page_names[out.pages()] << " pages, tile to 256 MiB buffer:\n"
+		<< "  memcpy:      " << bytes / regular.ns << " GB/s";
+	bench_report_energy(regular,mib,"MiB");
+	std::cout << "  stream_copy: " << bytes / streamed.ns << " GB/s";
+	bench_report_energy(streamed,mib,"MiB");
+}
+
+void render_path(workspace_pages want)
+{
+	int const n = 32 << 20;
+	workspace_buffer in(n*sizeof(float),want);
+	workspace_buffer out(n*sizeof(short),want);
+	float* const s = static_cast<float*>(in.data());
+	short* const q = static_cast<short*>(out.data());
+	for (int i=0; i<n; ++i) s[i] = 0.7f * std::sin(i*0.01f);
+	std::memset(q,0,n*sizeof(short));
+	float const k[] = { 0.5f, -0.3f };
+	waplns ns;
+	ns.set_params(0.5f,2,k);
+	pcm16_quantizer quant;
+	gain_ramp const full_scale(32768.0f);
+	bench_result const regular = bench_best([&]{
+		ns.reset_state();
+		shape_block(ns,quant,full_scale,s,q,n);
+	},3);
+	bench_result const streamed = bench_best([&]{
+		ns.reset_state();
+		shape_block_streaming(ns,quant,full_scale,s,q,n);
+	},3);
+	std::cout << page_names[in.pages()] << " pages, 32 M samples:\n";
+	bench_report("  shape_block",regular,n);
+	bench_report("  shape_block_streaming",streamed,n);
+}
+
+} // anonymous namespace
+
+int main()
+{
+	copy_path(normal_pages);
+	copy_path(transparent_huge_pages);
+	copy_path(explicit_huge_pages);
+	render_path(normal_pages);
+	render_path(transparent_huge_pages);
+}
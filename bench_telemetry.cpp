@@ -0,0 +1,114 @@
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "bench.hpp"
+#include "shaper.hpp"
+#include "telemetry.hpp"
+
+// One million 64 sample vibration snippets (25.6 kHz, 12 bit codes, band
+// of interest 2-4 kHz): per-series set_params() + reset_state() +
+// shape_block() versus telemetry_shaper::shape() and shape_batch().
+// Also reports the in-band error power against plain rounding.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_telemetry.cpp telemetry.cpp
+//        wlpc.cpp waplns.cpp workspace.cpp -o bench_telemetry
+
+namespace { // anonymous
+
+const double pi = 3.14159265358979323846;
+
+// error power in [w_lo, w_hi] per bin, from 256 point DFTs of a long run
+double band_power(std::vector<float> const& s, std::vector<int> const& q,
+	float step, double w_lo, double w_hi)
+{
+	int const len = 256;
+	double sum = 0;
+	int bins = 0;
+	for (int seg=0; seg+len<=static_cast<int>(s.size()); seg+=len) {
+		for (int b=0; b<=len/2; ++b) {
+			double const w = 2*pi*b/len;
+			if (w < w_lo || w_hi < w) continue;
+			double re = 0, im = 0;
+			for (int i=0; i<len; ++i) {
+				double const e = q[seg+i] - s[seg+i] / step;
+				re += e * std::cos(w*i);
+				im += e * std::sin(w*i);
+			}
+			sum += (re*re + im*im) / len;
+			++bins;
+		}
+	}
+	return sum / bins;
+}
+
+} // anonymous namespace
+
+int main()
+{
+	int const series = 1000000;
+	int const len = 64;
+	double const fs = 25600;
+	telemetry_format fmt = { 0.01f, 0.0f, 12 };
+	telemetry_shaper ts(series);
+	int const p = ts.add_band_preset(fmt,fs,2000,4000,12);
+	waplns const& proto = ts.shaper(p);
+	float k[max_wapl_filt_order];
+	for (int i=0; i<proto.order(); ++i) k[i] = proto.k(i);
+
+	std::vector<float> in(series*len);
+	for (std::size_t i=0; i<in.size(); ++i) {
+		in[i] = 5.0f * std::sin(0.7f*i) + 0.1f * (std::rand() % 100);
+	}
+	std::vector<int> c1(in.size()), c2(in.size()), c3(in.size());
+	std::vector<float const*> ip(series);
+	std::vector<int*> op(series);
+	std::vector<int> lens(series,len), presets(series,p);
+	for (int s=0; s<series; ++s) {
+		ip[s] = &in[s*len];
+		op[s] = &c3[s*len];
+	}
+
+	bench_result const naive = bench_best([&]{
+		waplns ns;
+		telemetry_quantizer quant(fmt);
+		for (int s=0; s<series; ++s) {
+			ns.set_params(proto.lambda(),proto.order(),k);
+			ns.reset_state();
+			shape_block(ns,quant,gain_ramp(1.0f/fmt.step),&in[s*len],&c1[s*len],len);
+		}
+	},3);
+	bench_result const single = bench_best([&]{
+		for (int s=0; s<series; ++s) ts.shape(p,&in[s*len],len,&c2[s*len]);
+	},3);
+	bench_result const batch = bench_best([&]{
+		ts.shape_batch(series,&presets[0],&ip[0],&lens[0],&op[0]);
+	},3);
+	bench_report("set_params + reset_state + shape_block",naive,in.size());
+	bench_report("telemetry_shaper::shape",single,in.size());
+	bench_report("telemetry_shaper::shape_batch",batch,in.size());
+
+	long diff = 0;
+	for (std::size_t i=0; i<in.size(); ++i) diff += c2[i] != c3[i];
+	std::cout << "batch codes differing from shape(): " << diff << '\n';
+
+	std::vector<unsigned char> packed(packed_bytes(len,fmt.bits));
+	std::vector<int> back(len);
+	pack_codes(&c3[0],len,fmt.bits,&packed[0]);
+	unpack_codes(&packed[0],len,fmt.bits,&back[0]);
+	std::cout << "12 bit pack round trip "
+		<< (std::equal(back.begin(),back.end(),c3.begin()) ? "ok" : "FAILED")
+		<< ", " << packed.size() << " bytes per series\n";
+
+	// one long run for the spectrum
+	int const n = 1 << 16;
+	std::vector<float> s(in.begin(),in.begin()+n);
+	std::vector<int> shaped(n), plain(n);
+	ts.shape(p,&s[0],n,&shaped[0]);
+	float const none = 0;
+	telemetry_shaper flat(0);
+	flat.shape(flat.add_preset(fmt,0,0,&none),&s[0],n,&plain[0]);
+	double const w_lo = 2*pi*2000/fs, w_hi = 2*pi*4000/fs;
+	std::cout << "in-band error vs plain rounding: "
+		<< 10*std::log10(band_power(s,shaped,fmt.step,w_lo,w_hi)
+			/ band_power(s,plain,fmt.step,w_lo,w_hi)) << " dB\n";
+}
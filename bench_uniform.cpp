@@ -0,0 +1,56 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "bench.hpp"
+#include "shaper.hpp"
+#include "uniform_bank.hpp"
+#include "waplns_bank.hpp"
+
+// A 16 channel master with one parameter set: waplns_bank (per-lane
+// coefficients) versus uniform_bank (broadcast coefficients) per order.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_uniform.cpp
+//        uniform_bank.cpp waplns_bank.cpp checkpoint.cpp rt_log.cpp
+//        waplns.cpp workspace.cpp -o bench_uniform -pthread
+
+int main()
+{
+	int const channels = 16;
+	int const n = 48000*5;
+	std::vector<float> in(channels*n);
+	std::vector<short> q1(channels*n), q2(channels*n);
+	std::vector<float const*> ip(channels);
+	std::vector<short*> op1(channels), op2(channels);
+	for (int c=0; c<channels; ++c) {
+		for (int i=0; i<n; ++i) {
+			in[c*n+i] = 9000.0f * std::sin(i*(0.011f+0.001f*c)) * std::sin(i*0.0003f);
+		}
+		ip[c] = &in[c*n];
+		op1[c] = &q1[c*n];
+		op2[c] = &q2[c*n];
+	}
+	float k[max_wapl_filt_order];
+	for (int i=0; i<max_wapl_filt_order; ++i) k[i] = 0.5f * std::pow(-0.8f,i);
+	pcm16_quantizer quant;
+	for (int ord=4; ord<=max_wapl_filt_order; ord*=2) {
+		waplns_bank bank(channels);
+		for (int c=0; c<channels; ++c) bank.add_stream(0.6f,ord,k);
+		bank.repack();
+		uniform_bank ub(channels);
+		ub.set_params(0.6f,ord,k);
+		bench_result const per_lane = bench_best([&]{
+			for (int c=0; c<channels; ++c) bank.reset_state(c);
+			bank.process(quant,&ip[0],&op1[0],n);
+		});
+		bench_result const uniform = bench_best([&]{
+			ub.reset_state();
+			ub.process(quant,&ip[0],&op2[0],n);
+		});
+		int diff = 0;
+		for (int i=0; i<channels*n; ++i) diff += q1[i] != q2[i];
+		std::cout << "order " << ord << ", " << channels << " channels\n";
+		bench_report("  waplns_bank",per_lane,double(channels)*n);
+		bench_report("  uniform_bank",uniform,double(channels)*n);
+		std::cout << "  codes differing: " << diff << '\n';
+	}
+}
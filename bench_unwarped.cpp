@@ -0,0 +1,39 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "bench.hpp"
+#include "shaper.hpp"
+
+// shape_block() with lambda = 0 (plain delays, the unwarped x_was() path)
+// versus a lambda just off zero, which runs the general warped lattice
+// with practically the same filter, for a few telephony-sized orders.
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_unwarped.cpp waplns.cpp
+//        -o bench_unwarped
+
+int main()
+{
+	int const n = 8000*60;
+	std::vector<float> in(n);
+	std::vector<short> q(n);
+	for (int i=0; i<n; ++i) in[i] = 9000.0f * std::sin(i*0.13f) * std::sin(i*0.0011f);
+	float k[16];
+	for (int i=0; i<16; ++i) k[i] = 0.5f * std::pow(-0.7f,i);
+	pcm16_quantizer quant;
+	for (int ord=2; ord<=16; ord*=2) {
+		waplns ns;
+		ns.set_params(1e-20f,ord,k);
+		bench_result const warped = bench_best([&]{
+			ns.reset_state();
+			shape_block(ns,quant,&in[0],&q[0],n);
+		});
+		ns.set_params(0.0f,ord,k);
+		bench_result const unwarped = bench_best([&]{
+			ns.reset_state();
+			shape_block(ns,quant,&in[0],&q[0],n);
+		});
+		std::cout << "order " << ord << '\n';
+		bench_report("  warped path",warped,n);
+		bench_report("  unwarped path",unwarped,n);
+	}
+}
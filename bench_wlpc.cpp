@@ -0,0 +1,48 @@
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "bench.hpp"
+#include "wlpc.hpp"
+
+// Warped autocorrelation of 4096 frames of 1024 samples at order 24:
+// warped_autocorr() frame by frame versus warped_autocorr_batch().
+// Counts 6 flops per sample and stage (three multiply-adds).
+//
+//    g++ -std=c++11 -O2 -march=native -I. bench_wlpc.cpp wlpc.cpp
+//        -o bench_wlpc
+
+int main()
+{
+	int const frames = 4096;
+	int const n = 1024;
+	int const order = 24;
+	float const lam = 0.7f;
+	std::vector<float> x(frames*n);
+	for (std::size_t i=0; i<x.size(); ++i) {
+		x[i] = std::sin(0.01f*i) + 0.001f * (std::rand() % 1000);
+	}
+	std::vector<float const*> xp(frames);
+	for (int f=0; f<frames; ++f) xp[f] = &x[f*n];
+	std::vector<double> r1(frames*(order+1)), r2(r1.size());
+
+	bench_result const single = bench_best([&]{
+		for (int f=0; f<frames; ++f) {
+			warped_autocorr(xp[f],n,lam,order,&r1[f*(order+1)]);
+		}
+	},3);
+	bench_result const batch = bench_best([&]{
+		warped_autocorr_batch(frames,&xp[0],n,lam,order,&r2[0]);
+	},3);
+	double const flops = 6.0 * order * n * frames;
+	std::cout << "per frame: " << flops / single.ns << " GFLOP/s";
+	bench_report_energy(single,frames,"frame");
+	std::cout << "batched:   " << flops / batch.ns << " GFLOP/s";
+	bench_report_energy(batch,frames,"frame");
+
+	double worst = 0;
+	for (std::size_t i=0; i<r1.size(); ++i) {
+		int const f = static_cast<int>(i / (order+1));
+		worst = std::max(worst,std::fabs(r1[i]-r2[i]) / r1[f*(order+1)]);
+	}
+	std::cout << "largest difference relative to r[0]: " << worst << '\n';
+}
@@ -0,0 +1,147 @@
+
+/*
+ * File layout: file_header, then two slots, each a slot_header followed by
+ * max_streams records, slots aligned to 64 bytes. Sequence numbers only
+ * grow: a save() takes the next even number s above both slots, marks its
+ * slot s-1 (odd, so readers skip it), writes the records and publishes s
+ * with a release store. The slot written is always the one that does not
+ * hold the newest complete snapshot, so the reader's choice of the larger
+ * even number is the newest complete snapshot.
+ *
+ * The copy in read() may race with a writer (that is a seqlock's nature);
+ * the sequence check after an acquire fence discards such copies.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "checkpoint.hpp"
+
+namespace { // anonymous
+
+char const magic[8] = { 'W','A','P','L','C','K','P','1' };
+const uint32_t version = 1;
+const std::size_t slot_align = 64;
+
+std::size_t round_up(std::size_t n, std::size_t a)
+{
+	return (n + a - 1) / a * a;
+}
+
+} // anonymous namespace
+
+std::size_t bank_checkpoint::slot_bytes(int max_streams)
+{
+	return round_up(sizeof(slot_header) + sizeof(record) * max_streams,slot_align);
+}
+
+bank_checkpoint::slot_header* bank_checkpoint::slot(int i) const
+{
+	unsigned char* const base = static_cast<unsigned char*>(map_);
+	return reinterpret_cast<slot_header*>(base + slot_align
+		+ i * slot_bytes(max_streams_));
+}
+
+bank_checkpoint::record* bank_checkpoint::records(int i) const
+{
+	return reinterpret_cast<record*>(slot(i) + 1);
+}
+
+bank_checkpoint::bank_checkpoint(std::string const& path, int max_streams)
+: map_(0), bytes_(slot_align + 2 * slot_bytes(max_streams)),
+  max_streams_(max_streams), next_seq_(2), writing_(-1),
+  copy_(new record[max_streams])
+{
+	int const fd = open(path.c_str(),O_RDWR|O_CREAT,0666);
+	if (fd < 0) return;
+	struct stat sb;
+	bool fresh = fstat(fd,&sb) != 0
+		|| static_cast<std::size_t>(sb.st_size) != bytes_;
+	if (fresh && ftruncate(fd,bytes_) != 0) {
+		close(fd);
+		return;
+	}
+	void* const p = mmap(0,bytes_,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	close(fd);
+	if (p == MAP_FAILED) return;
+	map_ = p;
+	file_header* const h = static_cast<file_header*>(map_);
+	fresh = fresh || std::memcmp(h->magic,magic,sizeof(magic)) != 0
+		|| h->version != version
+		|| h->max_streams != static_cast<uint32_t>(max_streams)
+		|| h->max_order != static_cast<uint32_t>(max_wapl_filt_order)
+		|| h->slot_bytes != slot_bytes(max_streams);
+	if (fresh) {
+		std::memset(map_,0,bytes_);
+		h->version = version;
+		h->max_streams = max_streams;
+		h->max_order = max_wapl_filt_order;
+		h->slot_bytes = static_cast<uint32_t>(slot_bytes(max_streams));
+		for (int i=0; i<2; ++i) slot(i)->seq.store(0,std::memory_order_relaxed);
+		// the magic last: a half initialized file is fresh again next time
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(h->magic,magic,sizeof(magic));
+	}
+}
+
+bank_checkpoint::~bank_checkpoint()
+{
+	if (map_) munmap(map_,bytes_);
+	delete[] copy_;
+}
+
+bank_checkpoint::record* bank_checkpoint::begin_save(int streams)
+{
+	if (!map_ || streams > max_streams_) return 0;
+	uint64_t const s0 = slot(0)->seq.load(std::memory_order_relaxed);
+	uint64_t const s1 = slot(1)->seq.load(std::memory_order_relaxed);
+	// overwrite whichever slot is not the newest complete snapshot
+	bool const c0 = s0 && !(s0 & 1);
+	bool const c1 = s1 && !(s1 & 1);
+	writing_ = c0 && (!c1 || s0 > s1) ? 1 : 0;
+	// from the slots, not from our last save(): another writer (the
+	// primary, for a standby) may have saved since
+	next_seq_ = (std::max(s0,s1) | 1) + 1;
+	slot_header* const sh = slot(writing_);
+	sh->seq.store(next_seq_ - 1,std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	sh->streams = streams;
+	return records(writing_);
+}
+
+void bank_checkpoint::end_save()
+{
+	if (writing_ < 0) return;
+	slot(writing_)->seq.store(next_seq_,std::memory_order_release);
+	writing_ = -1;
+}
+
+bank_checkpoint::record const* bank_checkpoint::read(int & n)
+{
+	n = 0;
+	if (!map_) return 0;
+	for (;;) {
+		uint64_t const s0 = slot(0)->seq.load(std::memory_order_acquire);
+		uint64_t const s1 = slot(1)->seq.load(std::memory_order_acquire);
+		bool const c0 = s0 && !(s0 & 1);
+		bool const c1 = s1 && !(s1 & 1);
+		if (!c0 && !c1) return 0;
+		int const i = c0 && (!c1 || s0 > s1) ? 0 : 1;
+		uint64_t const s = i ? s1 : s0;
+		slot_header const* const sh = slot(i);
+		int const streams = static_cast<int>(sh->streams);
+		// a torn read, or a damaged file, may hold any count
+		bool const fits = 0 <= streams && streams <= max_streams_;
+		if (fits) std::memcpy(copy_,records(i),sizeof(record) * streams);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sh->seq.load(std::memory_order_relaxed) == s) {
+			if (!fits) return 0;
+			n = streams;
+			return copy_;
+		}
+		// the writer lapped us on this slot, look again
+	}
+}
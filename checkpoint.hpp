@@ -0,0 +1,105 @@
+#ifndef CHECKPOINT_HPP_INCLUDED
+#define CHECKPOINT_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include "waplns.hpp"
+
+/**
+ * A memory-mapped file that mirrors the shaper state of a waplns_bank, so
+ * that a standby process on the same host can take over the streams
+ * without restarting them from zero state.
+ *
+ * The file holds two snapshot slots. save() writes the slot that does not
+ * hold the newest snapshot, guarded by a sequence number: odd while the
+ * slot is being written, even (and larger than the other slot's) when it
+ * is complete. A reader copies a slot and accepts it only if the sequence
+ * number was the same even value before and after the copy. If the writer
+ * dies in the middle of a save(), the other slot still holds the previous
+ * complete snapshot, so there always is a consistent one once the first
+ * save() finished.
+ *
+ * The mapping is MAP_SHARED and never synced: other processes see the
+ * page cache, which is all a same-host standby needs. Snapshots do not
+ * survive a crash of the host.
+ *
+ * Records carry the stream's parameter id (chosen by the application,
+ * e.g. a preset number) next to its order, lambda, t[] and u. The standby
+ * only adopts the state of streams whose id and order match its own setup.
+ */
+class bank_checkpoint
+{
+public:
+	struct record
+	{
+		uint32_t param_id;
+		int32_t order;
+		float lambda;
+		float u;
+		float t[max_wapl_filt_order];
+	};
+
+private:
+	struct file_header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t max_streams;
+		uint32_t max_order;
+		uint32_t slot_bytes;
+	};
+
+	struct slot_header
+	{
+		std::atomic<uint64_t> seq;
+		uint32_t streams;
+		uint32_t reserved;
+	};
+
+	void* map_;
+	std::size_t bytes_;
+	int max_streams_;
+	uint64_t next_seq_;  // even sequence number of the save() in progress
+	int writing_;        // slot of the save() in progress, -1 if none
+	record* copy_;       // private copy for read()
+
+	bank_checkpoint(bank_checkpoint const&);
+	bank_checkpoint& operator=(bank_checkpoint const&);
+
+	static std::size_t slot_bytes(int max_streams);
+	slot_header* slot(int i) const;
+	record* records(int i) const;
+
+public:
+	/**
+	 * Opens path, creating or resizing it if it does not hold a mirror for
+	 * max_streams streams. An existing mirror of that size is kept, so a
+	 * standby can read() it and then continue with save() itself.
+	 * ok() is false if the file could not be opened or mapped.
+	 */
+	bank_checkpoint(std::string const& path, int max_streams);
+	~bank_checkpoint();
+
+	bool ok() const { return map_ != 0; }
+	int max_streams() const { return max_streams_; }
+
+	/**
+	 * Writer side, used by waplns_bank::save_state(): begin_save() returns
+	 * the records of the slot to fill (streams of them), end_save()
+	 * publishes them.
+	 */
+	record* begin_save(int streams);
+	void end_save();
+
+	/**
+	 * Reader side: copies the newest consistent snapshot and returns its
+	 * records (streams in n), or 0 if there is none. The pointer stays
+	 * valid until the next read(). Retries while the writer is busy with
+	 * the slot being copied.
+	 */
+	record const* read(int & n);
+};
+
+#endif // CHECKPOINT_HPP_INCLUDED
@@ -0,0 +1,268 @@
+
+/*
+ * The CRC uses the zlib convention (state inverted on entry and exit), so
+ * crc32c(crc32c(0,a),b) == crc32c(0,ab) and crc32c_combine() is zlib's
+ * crc32_combine() with the Castagnoli polynomial.
+ *
+ * wh64 works on 32 byte chunks, one 32 bit word per lane:
+ *
+ *    acc[l] = rotl((acc[l] ^ w[l]) * P1, 13)
+ *
+ * A partial last chunk is zero padded; the length goes into the final
+ * fold, which mixes the lanes into 64 bits and ends with fmix64 from
+ * MurmurHash3.
+ */
+
+#include <cinttypes>
+#include <cstring>
+#include "checksum.hpp"
+#if defined(__SSE4_2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace { // anonymous
+
+const uint32_t crc_poly = 0x82F63B78u; // reflected Castagnoli
+const uint32_t p1 = 0x9E3779B1u;
+const uint32_t p2 = 0x85EBCA77u;
+const uint64_t p64 = 0x9E3779B97F4A7C15ull;
+const int lanes = 8;
+const std::size_t chunk = lanes * 4;
+
+struct crc_tables
+{
+	uint32_t t[8][256];
+
+	crc_tables()
+	{
+		for (uint32_t n=0; n<256; ++n) {
+			uint32_t c = n;
+			for (int k=0; k<8; ++k) c = c & 1 ? (c >> 1) ^ crc_poly : c >> 1;
+			t[0][n] = c;
+		}
+		for (int k=1; k<8; ++k) {
+			for (int n=0; n<256; ++n) {
+				t[k][n] = (t[k-1][n] >> 8) ^ t[0][t[k-1][n] & 0xff];
+			}
+		}
+	}
+};
+
+crc_tables const& tables()
+{
+	static const crc_tables tabs;
+	return tabs;
+}
+
+inline uint32_t load32(unsigned char const* p)
+{
+	uint32_t v;
+	std::memcpy(&v,p,4);
+	return v;
+}
+
+inline uint32_t rotl32(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32-r));
+}
+
+void wh64_init(uint32_t* acc, uint64_t seed)
+{
+	for (int l=0; l<lanes; ++l) {
+		acc[l] = (static_cast<uint32_t>(seed) + p2*(l+1))
+			^ static_cast<uint32_t>(seed >> 32);
+	}
+}
+
+void wh64_chunks(uint32_t* acc, unsigned char const* p, std::size_t nchunks)
+{
+	for (std::size_t c=0; c<nchunks; ++c, p+=chunk) {
+		for (int l=0; l<lanes; ++l) {
+			acc[l] = rotl32((acc[l] ^ load32(p+4*l)) * p1, 13);
+		}
+	}
+}
+
+uint64_t wh64_finish(uint32_t* acc, unsigned char const* tail,
+	std::size_t bytes, uint64_t seed)
+{
+	std::size_t const rest = bytes % chunk;
+	if (rest) {
+		unsigned char pad[chunk] = {0};
+		std::memcpy(pad,tail,rest);
+		wh64_chunks(acc,pad,1);
+	}
+	uint64_t h = seed ^ (bytes * p64);
+	for (int l=0; l<lanes; ++l) {
+		h = (h ^ acc[l]) * p64;
+		h ^= h >> 29;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+uint32_t gf2_matrix_times(uint32_t const* mat, uint32_t vec)
+{
+	uint32_t sum = 0;
+	for (; vec; vec >>= 1, ++mat) {
+		if (vec & 1) sum ^= *mat;
+	}
+	return sum;
+}
+
+void gf2_matrix_square(uint32_t* square, uint32_t const* mat)
+{
+	for (int n=0; n<32; ++n) square[n] = gf2_matrix_times(mat,mat[n]);
+}
+
+} // anonymous namespace
+
+uint32_t crc32c_scalar(uint32_t crc, void const* data, std::size_t bytes)
+{
+	crc_tables const& tb = tables();
+	unsigned char const* p = static_cast<unsigned char const*>(data);
+	crc = ~crc;
+	for (; bytes >= 8; bytes -= 8, p += 8) {
+		uint32_t const lo = load32(p) ^ crc;
+		uint32_t const hi = load32(p+4);
+		crc = tb.t[7][lo & 0xff] ^ tb.t[6][(lo >> 8) & 0xff]
+			^ tb.t[5][(lo >> 16) & 0xff] ^ tb.t[4][lo >> 24]
+			^ tb.t[3][hi & 0xff] ^ tb.t[2][(hi >> 8) & 0xff]
+			^ tb.t[1][(hi >> 16) & 0xff] ^ tb.t[0][hi >> 24];
+	}
+	for (; bytes; --bytes, ++p) {
+		crc = (crc >> 8) ^ tb.t[0][(crc ^ *p) & 0xff];
+	}
+	return ~crc;
+}
+
+uint32_t crc32c(uint32_t crc, void const* data, std::size_t bytes)
+{
+#ifdef __SSE4_2__
+	unsigned char const* p = static_cast<unsigned char const*>(data);
+	uint64_t c = ~crc;
+	for (; bytes >= 8; bytes -= 8, p += 8) {
+		uint64_t w;
+		std::memcpy(&w,p,8);
+		c = _mm_crc32_u64(c,w);
+	}
+	uint32_t c32 = static_cast<uint32_t>(c);
+	for (; bytes; --bytes, ++p) c32 = _mm_crc32_u8(c32,*p);
+	return ~c32;
+#else
+	return crc32c_scalar(crc,data,bytes);
+#endif
+}
+
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, std::size_t bytes_b)
+{
+	if (bytes_b == 0) return crc_a;
+	uint32_t even[32];
+	uint32_t odd[32];
+	// operator for one zero bit
+	odd[0] = crc_poly;
+	uint32_t row = 1;
+	for (int n=1; n<32; ++n) {
+		odd[n] = row;
+		row <<= 1;
+	}
+	gf2_matrix_square(even,odd); // two zero bits
+	gf2_matrix_square(odd,even); // four zero bits
+	// apply bytes_b zero bytes to crc_a
+	do {
+		gf2_matrix_square(even,odd);
+		if (bytes_b & 1) crc_a = gf2_matrix_times(even,crc_a);
+		bytes_b >>= 1;
+		if (!bytes_b) break;
+		gf2_matrix_square(odd,even);
+		if (bytes_b & 1) crc_a = gf2_matrix_times(odd,crc_a);
+		bytes_b >>= 1;
+	} while (bytes_b);
+	return crc_a ^ crc_b;
+}
+
+uint64_t wh64_scalar(void const* data, std::size_t bytes, uint64_t seed)
+{
+	unsigned char const* p = static_cast<unsigned char const*>(data);
+	uint32_t acc[lanes];
+	wh64_init(acc,seed);
+	std::size_t const n = bytes / chunk;
+	wh64_chunks(acc,p,n);
+	return wh64_finish(acc,p+n*chunk,bytes,seed);
+}
+
+uint64_t wh64(void const* data, std::size_t bytes, uint64_t seed)
+{
+#ifdef __AVX2__
+	unsigned char const* p = static_cast<unsigned char const*>(data);
+	uint32_t acc[lanes];
+	wh64_init(acc,seed);
+	std::size_t const n = bytes / chunk;
+	__m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(acc));
+	__m256i const m = _mm256_set1_epi32(static_cast<int>(p1));
+	for (std::size_t c=0; c<n; ++c) {
+		__m256i const w = _mm256_loadu_si256(
+			reinterpret_cast<__m256i const*>(p+c*chunk));
+		a = _mm256_mullo_epi32(_mm256_xor_si256(a,w),m);
+		a = _mm256_or_si256(_mm256_slli_epi32(a,13),_mm256_srli_epi32(a,19));
+	}
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(acc),a);
+	return wh64_finish(acc,p+n*chunk,bytes,seed);
+#else
+	return wh64_scalar(data,bytes,seed);
+#endif
+}
+
+output_checksum::output_checksum(std::FILE* manifest)
+: file_crc_(0), file_hash_(0), bytes_(0), blocks_(0), manifest_(manifest)
+{}
+
+block_digest output_checksum::add_block(void const* data, std::size_t bytes)
+{
+	block_digest d;
+	d.crc = crc32c(0,data,bytes);
+	d.hash = wh64(data,bytes);
+	d.bytes = bytes;
+	file_crc_ = crc32c_combine(file_crc_,d.crc,bytes);
+	uint64_t const pair[2] = { d.hash, bytes };
+	file_hash_ = wh64(pair,sizeof(pair),file_hash_);
+	bytes_ += bytes;
+	if (manifest_) {
+		std::fprintf(manifest_,"block %lu %lu %08" PRIx32 " %016" PRIx64 "\n",
+			blocks_,static_cast<unsigned long>(bytes),d.crc,d.hash);
+	}
+	++blocks_;
+	return d;
+}
+
+block_digest output_checksum::so_far() const
+{
+	block_digest d;
+	d.crc = file_crc_;
+	d.hash = file_hash_;
+	d.bytes = bytes_;
+	return d;
+}
+
+block_digest output_checksum::finish()
+{
+	block_digest const d = so_far();
+	if (manifest_) {
+		std::fprintf(manifest_,"file %" PRIu64 " %08" PRIx32 " %016" PRIx64 "\n",
+			bytes_,file_crc_,file_hash_);
+		std::fflush(manifest_);
+	}
+	return d;
+}
+
+void output_checksum::resume(block_digest const& d, unsigned long blocks)
+{
+	file_crc_ = d.crc;
+	file_hash_ = d.hash;
+	bytes_ = d.bytes;
+	blocks_ = blocks;
+}
@@ -0,0 +1,121 @@
+#ifndef CHECKSUM_HPP_INCLUDED
+#define CHECKSUM_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdio>
+#include <algorithm>
+#include <stdint.h>
+#include "shaper.hpp"
+#include "streaming.hpp"
+
+/**
+ * Checksums for shaped output, computed right after a block was written
+ * while it is still in L1:
+ *
+ *    crc32c : CRC-32C (Castagnoli). Scalar form is table driven
+ *             (slicing by 8), the SIMD form uses the SSE4.2 crc32
+ *             instruction when compiled with it.
+ *    wh64   : fast non-cryptographic 64 bit hash over eight 32 bit lanes
+ *             (multiply/rotate per lane, lanes folded at the end). The
+ *             scalar form is a plain lane loop, the SIMD form uses AVX2
+ *             when compiled with it.
+ *
+ * Both forms produce the same values. Data is hashed as little-endian
+ * bytes.
+ */
+uint32_t crc32c_scalar(uint32_t crc, void const* data, std::size_t bytes);
+uint32_t crc32c(uint32_t crc, void const* data, std::size_t bytes);
+/** CRC of A followed by B, given crc(A), crc(B) and the length of B */
+uint32_t crc32c_combine(uint32_t crc_a, uint32_t crc_b, std::size_t bytes_b);
+
+uint64_t wh64_scalar(void const* data, std::size_t bytes, uint64_t seed = 0);
+uint64_t wh64(void const* data, std::size_t bytes, uint64_t seed = 0);
+
+struct block_digest
+{
+	uint32_t crc;
+	uint64_t hash;
+	std::size_t bytes;
+};
+
+/**
+ * Per-block and per-file digests of an output stream, optionally written
+ * to a sidecar manifest:
+ *
+ *    block <index> <bytes> <crc32c> <wh64>
+ *    ...
+ *    file <bytes> <crc32c> <wh64>
+ *
+ * The file CRC is the CRC of all bytes (combined from the block CRCs).
+ * The file hash chains wh64 over the (block hash, block bytes) pairs,
+ * seeded with the previous file hash, so a verifier has to use the same
+ * block boundaries, which is why they are listed.
+ *
+ * A file written in parts by different processes (chunks of a distributed
+ * render) is summed by resuming each part's output_checksum from the
+ * previous part's so_far() and blocks().
+ */
+class output_checksum
+{
+	uint32_t file_crc_;
+	uint64_t file_hash_;
+	uint64_t bytes_;
+	unsigned long blocks_;
+	std::FILE* manifest_;
+
+	output_checksum(output_checksum const&);
+	output_checksum& operator=(output_checksum const&);
+
+public:
+	/** manifest may be null (no sidecar) */
+	explicit output_checksum(std::FILE* manifest = 0);
+
+	block_digest add_block(void const* data, std::size_t bytes);
+	/** digest of everything added so far */
+	block_digest so_far() const;
+	/** so_far(), and writes the file line */
+	block_digest finish();
+	/** continues after an earlier part with so_far() d and blocks() blocks */
+	void resume(block_digest const& d, unsigned long blocks);
+
+	unsigned long blocks() const { return blocks_; }
+};
+
+/**
+ * shape_block() that checksums its output as one block of sums while it
+ * is hot, and also stores the block's digest in digest if given. Returns
+ * false if the state was reset, as shape_block() does.
+ */
+template<class Quant, class Gain>
+bool shape_block(waplns & ns, Quant & quant, Gain const& gain,
+	float const* s, typename Quant::code_type* q, int count,
+	output_checksum & sums, block_digest* digest = 0)
+{
+	bool const ok = shape_block(ns,quant,gain,s,q,count);
+	block_digest const d = sums.add_block(q,count*sizeof(*q));
+	if (digest) *digest = d;
+	return ok;
+}
+
+/**
+ * shape_block_streaming() that checksums every tile before it is streamed
+ * out, one block of sums per stream_tile codes
+ */
+template<class Quant, class Gain>
+bool shape_block_streaming(waplns & ns, Quant & quant, Gain const& gain,
+	float const* s, typename Quant::code_type* q, int count,
+	output_checksum & sums)
+{
+	typedef typename Quant::code_type code_type;
+	alignas(64) code_type tile[stream_tile];
+	bool ok = true;
+	for (int i0=0; i0<count; i0+=stream_tile) {
+		int const n = std::min(count-i0,stream_tile);
+		ok = shape_block(ns,quant,offset_gain<Gain>(gain,i0),s+i0,tile,n,sums) && ok;
+		stream_copy(q+i0,tile,n*sizeof(code_type));
+	}
+	stream_fence();
+	return ok;
+}
+
+#endif // CHECKSUM_HPP_INCLUDED
@@ -0,0 +1,130 @@
+
+/*
+ * Iterative decimation in time: bit-reversal permutation, then log2(n)
+ * passes of butterflies with twiddles from one std::polar() per pass and
+ * a running product (exact enough at the sizes used for analysis).
+ *
+ * fft_plan::real_power() transforms z[m] = x[2m] + j x[2m+1] and splits
+ * the result into the spectra of the even and odd samples,
+ * E[b] = (Z[b] + Z*[n-b]) / 2 and O[b] = (Z[b] - Z*[n-b]) / 2j, which
+ * combine to X[b] = E[b] + e^(-pi j b/n) O[b].
+ *
+ * Welch scaling: a segment's periodogram |X[b]|^2 / sum(w^2) has
+ * expectation v for white noise of variance v, on every bin.
+ */
+
+#include <cmath>
+#include "fft.hpp"
+
+namespace { // anonymous
+
+const double pi = 3.14159265358979323846;
+
+} // anonymous namespace
+
+void fft(std::complex<double>* x, int n)
+{
+	for (int i=1, j=0; i<n; ++i) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) j ^= bit;
+		j ^= bit;
+		if (i < j) std::swap(x[i],x[j]);
+	}
+	for (int len=2; len<=n; len<<=1) {
+		std::complex<double> const step = std::polar(1.0,-2*pi/len);
+		for (int i=0; i<n; i+=len) {
+			std::complex<double> w(1,0);
+			for (int m=0; m<len/2; ++m) {
+				std::complex<double> const a = x[i+m];
+				std::complex<double> const b = x[i+m+len/2] * w;
+				x[i+m] = a + b;
+				x[i+m+len/2] = a - b;
+				w *= step;
+			}
+		}
+	}
+}
+
+int welch_psd(float const* x, int n, int len, double* psd)
+{
+	std::vector<double> win(len);
+	double wsum = 0;
+	for (int i=0; i<len; ++i) {
+		win[i] = 0.5 - 0.5 * std::cos(2*pi*i/len);
+		wsum += win[i] * win[i];
+	}
+	std::vector<std::complex<double> > buf(len);
+	int segs = 0;
+	for (int s=0; s+len<=n; s+=len/2, ++segs) {
+		for (int i=0; i<len; ++i) buf[i] = x[s+i] * win[i];
+		fft(&buf[0],len);
+		for (int b=0; b<=len/2; ++b) psd[b] += std::norm(buf[b]) / wsum;
+	}
+	return segs;
+}
+
+fft_plan::fft_plan(int n)
+: n_(n), twr_(n/2), twi_(n/2), rtwr_(n+1), rtwi_(n+1)
+{
+	for (int i=1, j=0; i<n; ++i) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			swaps_.push_back(i);
+			swaps_.push_back(j);
+		}
+	}
+	for (int m=0; m<n/2; ++m) {
+		twr_[m] = static_cast<float>(std::cos(2*pi*m/n));
+		twi_[m] = static_cast<float>(-std::sin(2*pi*m/n));
+	}
+	for (int b=0; b<=n; ++b) {
+		rtwr_[b] = static_cast<float>(std::cos(pi*b/n));
+		rtwi_[b] = static_cast<float>(-std::sin(pi*b/n));
+	}
+}
+
+void fft_plan::forward(std::complex<float>* x) const
+{
+	for (std::size_t i=0; i<swaps_.size(); i+=2) std::swap(x[swaps_[i]],x[swaps_[i+1]]);
+	float* const v = reinterpret_cast<float*>(x);
+	for (int len=2, stride=n_/2; len<=n_; len<<=1, stride>>=1) {
+		int const half = len / 2;
+		for (int i=0; i<n_; i+=len) {
+			float* const a = v + 2*i;
+			float* const b = a + len;
+			for (int m=0; m<half; ++m) {
+				float const wr = twr_[m * stride], wi = twi_[m * stride];
+				float const br = b[2*m] * wr - b[2*m+1] * wi;
+				float const bi = b[2*m] * wi + b[2*m+1] * wr;
+				float const ar = a[2*m], ai = a[2*m+1];
+				b[2*m] = ar - br;
+				b[2*m+1] = ai - bi;
+				a[2*m] = ar + br;
+				a[2*m+1] = ai + bi;
+			}
+		}
+	}
+}
+
+void fft_plan::real_power(float* x, float* power) const
+{
+	forward(reinterpret_cast<std::complex<float>*>(x));
+	// x now holds Z as re, im pairs
+	float const r0 = x[0], i0 = x[1];
+	power[0] = (r0 + i0) * (r0 + i0);
+	power[n_] = (r0 - i0) * (r0 - i0);
+	for (int b=1; b<n_; ++b) {
+		float const zr = x[2*b], zi = x[2*b+1];
+		float const cr = x[2*(n_-b)], ci = -x[2*(n_-b)+1];
+		// e = (Z[b] + Z*[n-b]) / 2, o = (Z[b] - Z*[n-b]) / 2j
+		float const er = 0.5f * (zr + cr);
+		float const ei = 0.5f * (zi + ci);
+		float const or_ = 0.5f * (zi - ci);
+		float const oi = -0.5f * (zr - cr);
+		float const xr = er + rtwr_[b] * or_ - rtwi_[b] * oi;
+		float const xi = ei + rtwr_[b] * oi + rtwi_[b] * or_;
+		power[b] = xr * xr + xi * xi;
+	}
+}
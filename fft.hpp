@@ -0,0 +1,56 @@
+#ifndef FFT_HPP_INCLUDED
+#define FFT_HPP_INCLUDED
+
+#include <complex>
+#include <vector>
+
+/**
+ * Just enough spectral analysis for measuring noise shapes: an in-place
+ * radix-2 FFT and a Welch power spectrum. Not tuned for speed; the
+ * analysis tools spend their time in the shapers, not here.
+ */
+
+/** in-place forward DFT of n = 2^m points, X[k] = sum x[i] e^(-2 pi j ik/n) */
+void fft(std::complex<double>* x, int n);
+
+/**
+ * Welch estimate of the power spectrum of x[0..n): Hann windowed segments
+ * of len (a power of two) points with 50% overlap, averaged. psd gets
+ * len/2+1 bins for the frequencies pi * b / (len/2); it is scaled so that
+ * white noise of variance v gives psd[b] = v on average, i.e. the mean
+ * over the bins is the signal power. Adds to psd and returns the number
+ * of segments, so several signals can be averaged by the caller.
+ */
+int welch_psd(float const* x, int n, int len, double* psd);
+
+/**
+ * Repeated float transforms of one size n = 2^m, for per-block analysis:
+ * the bit reversal swaps and all twiddles are tabled at construction.
+ */
+class fft_plan
+{
+	int n_;
+	std::vector<int> swaps_;                  // index pairs to exchange
+	// e^(-2 pi j m/n), m < n/2, and e^(-pi j b/n), b <= n, as separate
+	// real and imaginary parts (std::complex<float> members go through
+	// the stack and stall store forwarding in the butterflies)
+	std::vector<float> twr_, twi_;
+	std::vector<float> rtwr_, rtwi_;
+
+public:
+	explicit fft_plan(int n);
+
+	int size() const { return n_; }
+
+	/** in-place forward DFT of n points, as fft() */
+	void forward(std::complex<float>* x) const;
+
+	/**
+	 * Power spectrum |X[b]|^2, b = 0..n, of the 2n real samples x by one
+	 * n-point transform of the even/odd samples packed as complex values.
+	 * x is overwritten.
+	 */
+	void real_power(float* x, float* power) const;
+};
+
+#endif // FFT_HPP_INCLUDED
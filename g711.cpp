@@ -0,0 +1,179 @@
+
+/*
+ * The reference coder follows the classic public domain g711.c (Sun
+ * Microsystems): mu-law works on pcm >> 2 with a bias of 33, A-law on
+ * pcm >> 3, both with eight segments of sixteen levels.
+ *
+ * In the branch-free block encoder the segment search is replaced by the
+ * exponent of the (exactly representable) value converted to float:
+ *
+ *    mu-law: v = min(|p| + 33,8191) in [33,8191]  -> seg = exp(v) - 5
+ *    A-law : v = |p| (one's complement for negative), v|16 in [16,4095]
+ *            -> seg = exp(v|16) - 4
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "g711.hpp"
+
+namespace { // anonymous
+
+const int ulaw_bias = 0x84;
+const int ulaw_clip = 8159;
+
+using g711_detail::float_exponent;
+
+int segment(int val, int first_end)
+{
+	int seg = 0;
+	for (int end=first_end; seg<8 && val>end; end=end*2+1) ++seg;
+	return seg;
+}
+
+unsigned char ulaw_encode(int pcm)
+{
+	int mask;
+	pcm >>= 2;
+	if (pcm < 0) {
+		pcm = -pcm;
+		mask = 0x7F;
+	} else {
+		mask = 0xFF;
+	}
+	if (pcm > ulaw_clip) pcm = ulaw_clip;
+	pcm += ulaw_bias >> 2;
+	int const seg = segment(pcm,0x3F);
+	if (seg >= 8) return static_cast<unsigned char>(0x7F ^ mask);
+	return static_cast<unsigned char>(((seg << 4) | ((pcm >> (seg+1)) & 0xF)) ^ mask);
+}
+
+int ulaw_decode(unsigned char code)
+{
+	int const u = ~code;
+	int t = ((u & 0x0F) << 3) + ulaw_bias;
+	t <<= (u & 0x70) >> 4;
+	return (u & 0x80) ? (ulaw_bias - t) : (t - ulaw_bias);
+}
+
+unsigned char alaw_encode(int pcm)
+{
+	int mask;
+	pcm >>= 3;
+	if (pcm >= 0) {
+		mask = 0xD5;
+	} else {
+		mask = 0x55;
+		pcm = -pcm - 1;
+	}
+	int const seg = segment(pcm,0x1F);
+	if (seg >= 8) return static_cast<unsigned char>(0x7F ^ mask);
+	int aval = seg << 4;
+	aval |= seg < 2 ? (pcm >> 1) & 0xF : (pcm >> seg) & 0xF;
+	return static_cast<unsigned char>(aval ^ mask);
+}
+
+int alaw_decode(unsigned char code)
+{
+	int const a = code ^ 0x55;
+	int t = (a & 0x0F) << 4;
+	int const seg = (a & 0x70) >> 4;
+	switch (seg) {
+	case 0:
+		t += 8;
+		break;
+	case 1:
+		t += 0x108;
+		break;
+	default:
+		t += 0x108;
+		t <<= seg - 1;
+	}
+	return (a & 0x80) ? t : -t;
+}
+
+void build_tables(g711_law law, g711_tables & tab)
+{
+	tab.shift = law == g711_mulaw ? 2 : 3;
+	int const n = 65536 >> tab.shift;
+	for (int i=0; i<n; ++i) {
+		tab.enc[i] = g711_encode(law,(i << tab.shift) - 32768);
+	}
+	int sorted[256];
+	for (int c=0; c<256; ++c) {
+		tab.dec[c] = static_cast<short>(g711_decode(law,static_cast<unsigned char>(c)));
+		sorted[c] = tab.dec[c];
+	}
+	std::sort(sorted,sorted+256);
+	for (int c=0; c<256; ++c) {
+		int const* p = std::lower_bound(sorted,sorted+256,int(tab.dec[c]));
+		int gap = 0;
+		if (p != sorted) gap = std::max(gap,*p - p[-1]);
+		while (p+1 != sorted+256 && p[1] == *p) ++p; // mu-law has +0 and -0
+		if (p+1 != sorted+256) gap = std::max(gap,p[1] - *p);
+		tab.half_step[c] = 0.5f * gap;
+	}
+}
+
+struct all_tables
+{
+	g711_tables mulaw;
+	g711_tables alaw;
+
+	all_tables()
+	{
+		build_tables(g711_mulaw,mulaw);
+		build_tables(g711_alaw,alaw);
+	}
+};
+
+} // anonymous namespace
+
+g711_tables const& get_g711_tables(g711_law law)
+{
+	static const all_tables tabs;
+	return law == g711_mulaw ? tabs.mulaw : tabs.alaw;
+}
+
+unsigned char g711_encode(g711_law law, int pcm)
+{
+	return law == g711_mulaw ? ulaw_encode(pcm) : alaw_encode(pcm);
+}
+
+int g711_decode(g711_law law, unsigned char code)
+{
+	return law == g711_mulaw ? ulaw_decode(code) : alaw_decode(code);
+}
+
+void g711_encode_block(g711_law law, short const* pcm,
+	unsigned char* code, int count)
+{
+	if (law == g711_mulaw) {
+		for (int i=0; i<count; ++i) {
+			int const p = pcm[i] >> 2;
+			int const neg = p < 0;
+			// clipping to 8191 instead of 8159+33 folds the seg >= 8 case
+			int const v = std::min((neg ? -p : p) + (ulaw_bias >> 2), 8191);
+			int const seg = float_exponent(v) - 5;
+			int const mant = (v >> (seg+1)) & 0xF;
+			int const mask = neg ? 0x7F : 0xFF;
+			code[i] = static_cast<unsigned char>(((seg << 4) | mant) ^ mask);
+		}
+	} else {
+		for (int i=0; i<count; ++i) {
+			int const p = pcm[i] >> 3;
+			int const neg = p < 0;
+			int const v = neg ? -p - 1 : p;
+			int const seg = float_exponent(v | 16) - 4;
+			int const mant = (v >> std::max(seg,1)) & 0xF;
+			int const mask = neg ? 0x55 : 0xD5;
+			code[i] = static_cast<unsigned char>(((seg << 4) | mant) ^ mask);
+		}
+	}
+}
+
+void g711_decode_block(g711_law law, unsigned char const* code,
+	short* pcm, int count)
+{
+	short const* dec = get_g711_tables(law).dec;
+	for (int i=0; i<count; ++i) pcm[i] = dec[code[i]];
+}
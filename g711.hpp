@@ -0,0 +1,208 @@
+#ifndef G711_HPP_INCLUDED
+#define G711_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstring>
+#include "tools.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+enum g711_law { g711_mulaw, g711_alaw };
+
+/** the lanes of g711_quantizer::quantize_lanes(), bank_lanes of waplns_bank */
+const int g711_lanes = 8;
+
+/**
+ * Tables for G.711 companding on the 16 bit PCM scale. enc is indexed by
+ * (pcm + 32768) >> shift (shift is 2 for mu-law, 3 for A-law), dec maps a
+ * code back to 16 bit PCM and half_step is half the distance to the
+ * neighbouring levels. Encoding truncates like the reference coder, which
+ * for G.711 yields the nearest reconstruction level.
+ */
+struct g711_tables
+{
+	int shift;
+	unsigned char enc[16384];
+	short dec[256];
+	float half_step[256];
+};
+
+g711_tables const& get_g711_tables(g711_law law);
+
+/** reference (scalar, branchy) coder, used to build the tables */
+unsigned char g711_encode(g711_law law, int pcm);
+int g711_decode(g711_law law, unsigned char code);
+
+/**
+ * Block coders without noise shaping. The encoder is written without
+ * tables and branches (the segment comes from the float exponent) so the
+ * compiler vectorizes it; results equal g711_encode().
+ */
+void g711_encode_block(g711_law law, short const* pcm,
+	unsigned char* code, int count);
+void g711_decode_block(g711_law law, unsigned char const* code,
+	short* pcm, int count);
+
+/**
+ * Quantizer policy for shape_block() and waplns_bank that produces 8 bit
+ * G.711 codes. Error feedback happens in the linear domain: qlin is the
+ * decoded level of the chosen code. Since the step size grows with the
+ * magnitude, the error that goes back into the shaper is clamped to
+ * thresh half-steps of the level that was just chosen.
+ *
+ * waplns_bank quantizes its lanes with quantize_lanes(): the same codes
+ * and levels as quantize(), computed without the encoder table and
+ * without branches (as in g711_encode_block()), so that a group's lanes
+ * go through in one vector. The half-steps still come from the table,
+ * with a gather where there is AVX2.
+ */
+class g711_quantizer
+{
+	g711_tables const* tab_;
+	float half_step_;
+
+public:
+	typedef unsigned char code_type;
+
+	float thresh;
+
+	explicit g711_quantizer(g711_law law)
+	: tab_(&get_g711_tables(law)), half_step_(1), thresh(1.0f) {}
+
+	code_type quantize(float w, float & qlin)
+	{
+		// negated compares so a NaN clamps too instead of reaching the cast
+		if (!(w >= -32768.0f)) w = -32768.0f;
+		else if (!(w <= 32767.0f)) w = 32767.0f;
+		long const r = round_to_long(w);
+		code_type const c = tab_->enc[(r + 32768) >> tab_->shift];
+		qlin = tab_->dec[c];
+		half_step_ = tab_->half_step[c];
+		return c;
+	}
+
+	float clamp_error(float x) const
+	{
+		float const th = thresh * half_step_;
+		if (x<-th) x=-th; else if (th<x) x=th;
+		return x;
+	}
+
+	/**
+	 * quantize() and clamp_error() of w = s[l] - u[l] for the lanes l with
+	 * live[l] != 0: codes into c[], errors into x[], one added to
+	 * clamped[l] if the error was clamped. Other lanes get x[l] = 0.
+	 */
+	void quantize_lanes(float const (&s)[g711_lanes], float const* u,
+		code_type (&c)[g711_lanes], float (&x)[g711_lanes],
+		int (&clamped)[g711_lanes], int const (&live)[g711_lanes]) const;
+};
+
+namespace g711_detail {
+
+// written with GCC/Clang vector types: the autovectorizer leaves the
+// selects of the lane loops as branches
+typedef float vec __attribute__((vector_size(g711_lanes*sizeof(float))));
+typedef int ivec __attribute__((vector_size(g711_lanes*sizeof(int))));
+
+inline ivec splat(int v)
+{
+	ivec const z = {0};
+	return z + v;
+}
+
+inline vec splat(float v)
+{
+	vec const z = {0};
+	return z + v;
+}
+
+/** floor(log2(v)) for 0 < v < 2^24, from the exponent of the float */
+inline int float_exponent(int v)
+{
+	float const f = static_cast<float>(v);
+	int bits;
+	std::memcpy(&bits,&f,sizeof(bits));
+	return (bits >> 23) - 127;
+}
+
+inline ivec float_exponent(ivec v)
+{
+	vec const f = __builtin_convertvector(v,vec);
+	ivec bits;
+	std::memcpy(&bits,&f,sizeof(bits));
+	return (bits >> 23) - 127;
+}
+
+} // namespace g711_detail
+
+inline void g711_quantizer::quantize_lanes(float const (&s)[g711_lanes],
+	float const* u, code_type (&c)[g711_lanes], float (&x)[g711_lanes],
+	int (&clamped)[g711_lanes], int const (&live)[g711_lanes]) const
+{
+	using namespace g711_detail;
+	vec sv, uv;
+	std::memcpy(&sv,s,sizeof(sv));
+	std::memcpy(&uv,u,sizeof(uv));
+	vec const wv = sv - uv;
+	vec v = wv >= splat(-32768.0f) ? wv : splat(-32768.0f);
+	v = v <= splat(32767.0f) ? v : splat(32767.0f);
+	// round_to_long() in 32 bits: to nearest even by way of 1.5 * 2^23
+	ivec const r = __builtin_convertvector((v + 12582912.0f) - 12582912.0f,ivec);
+	ivec code, t;
+	if (tab_->shift == 2) {
+		ivec const p = r >> 2;
+		ivec const neg = p < splat(0);
+		ivec a = (neg ? -p : p) + 33;
+		a = a < splat(8191) ? a : splat(8191);
+		ivec const seg = float_exponent(a) - 5;
+		ivec const mant = (a >> (seg + 1)) & 0xF;
+		code = ((seg << 4) | mant) ^ (neg ? splat(0x7F) : splat(0xFF));
+		t = (((mant << 3) + 0x84) << seg) - 0x84;
+		t = neg ? -t : t;
+	} else {
+		ivec const p = r >> 3;
+		ivec const neg = p < splat(0);
+		ivec const a = neg ? -p - 1 : p;
+		ivec const seg = float_exponent(a | 16) - 4;
+		ivec const mant = (a >> (seg > splat(1) ? seg : splat(1))) & 0xF;
+		code = ((seg << 4) | mant) ^ (neg ? splat(0x55) : splat(0xD5));
+		ivec const up = seg > splat(0) ? seg - 1 : splat(0);
+		t = seg == splat(0) ? (mant << 4) + 8 : ((mant << 4) + 0x108) << up;
+		t = neg ? -t : t;
+	}
+#ifdef __AVX2__
+	vec const hs = _mm256_i32gather_ps(tab_->half_step,__m256i(code),4);
+#else
+	vec hs;
+	for (int l=0; l<g711_lanes; ++l) hs[l] = tab_->half_step[code[l]];
+#endif
+	for (int l=0; l<g711_lanes; ++l) c[l] = static_cast<code_type>(code[l]);
+	vec const th = thresh * hs;
+	vec const e = __builtin_convertvector(t,vec) - wv;
+	vec xv = e < -th ? -th : e;
+	xv = xv > th ? th : xv;
+	ivec lv, cl;
+	std::memcpy(&lv,live,sizeof(lv));
+	std::memcpy(&cl,clamped,sizeof(cl));
+	lv = lv != splat(0);
+	xv = lv ? xv : splat(0.0f);
+	cl -= lv & (xv != e);
+	std::memcpy(x,&xv,sizeof(xv));
+	std::memcpy(clamped,&cl,sizeof(cl));
+}
+
+/**
+ * Picked over the generic quantize_lanes() of waplns_bank.hpp when the
+ * bank's groups have g711_lanes lanes.
+ */
+inline void quantize_lanes(g711_quantizer & quant, float const (&s)[g711_lanes],
+	float const* u, unsigned char (&c)[g711_lanes], float (&x)[g711_lanes],
+	int (&clamped)[g711_lanes], int const (&live)[g711_lanes])
+{
+	quant.quantize_lanes(s,u,c,x,clamped,live);
+}
+
+#endif // G711_HPP_INCLUDED
@@ -0,0 +1,306 @@
+
+/*
+ * A plane is shaped in bands of band_rows rows, a tile of columns at a
+ * time. A tile is first transposed into a lane-interleaved float buffer
+ * (buf[column][row], scaled to the 8 bit grid, odd rows read backwards for
+ * serpentine order), then shaped column by column with vector code, then
+ * the codes are transposed back into the rows. The transposes keep the
+ * shaping loop free of gathers and scatters, and with tile-sized buffers
+ * all three passes stay in L1. The band state carries over between tiles.
+ * Rows past the bottom of the plane repeat the last row and are not
+ * stored.
+ *
+ * A band is band_groups independent groups of bank_lanes rows. One lattice
+ * step is a chain of dependent multiply-adds, so running four groups side
+ * by side fills the latency of one with the others (two were measurably
+ * latency bound, eight spill registers at order 4). For orders up to
+ * max_unrolled_order the state lives in registers (lattice_lanes_uniform);
+ * higher orders run the same kernel on memory.
+ *
+ * Rounding uses the 1.5 * 2^23 trick of round_to_long(): after adding the
+ * magic constant the low mantissa bits hold the integer, so the clamped
+ * sum is stored as is and the code is its low byte.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "image_shaper.hpp"
+#include "lane_kernels.hpp"
+
+namespace { // anonymous
+
+const int band_groups = 4;
+const int band_rows = band_groups * bank_lanes;
+const int max_unrolled_order = 8;
+const int tile = 64;
+
+typedef unsigned lane_uivec __attribute__((vector_size(bank_lanes*sizeof(unsigned))));
+
+struct band_state
+{
+	lane_vec t[band_groups][max_wapl_filt_order];
+	lane_vec u[band_groups];
+};
+
+struct band_params
+{
+	int order;
+	float lam;
+	float s2;
+	float thresh;
+	float const* k;
+};
+
+inline void quantize_lanes(lane_vec const& w, float thresh, lane_vec & x,
+	lane_uivec & code)
+{
+	lane_vec const magic = lane_vec{} + 12582912.0f;
+	lane_vec const lo = magic;
+	lane_vec const hi = magic + 255.0f;
+	lane_vec const th = lane_vec{} + thresh;
+	lane_vec rm = w + magic;
+	rm = rm < lo ? lo : rm;
+	rm = rm > hi ? hi : rm;
+	lane_vec e = (rm - magic) - w;
+	e = e < -th ? -th : e;
+	x = e > th ? th : e;
+	std::memcpy(&code,&rm,sizeof(code));
+}
+
+template<int Order>
+void shape_band(band_params const& p, band_state & st,
+	float const* in, unsigned* out, int width)
+{
+	// local copies, so the compiler need not reload them after each store
+	float const lam = p.lam, s2 = p.s2, thresh = p.thresh;
+	float k[Order];
+	for (int i=0; i<Order; ++i) k[i] = p.k[i];
+	lane_vec t[band_groups][Order];
+	lane_vec u[band_groups];
+	for (int g=0; g<band_groups; ++g) {
+		u[g] = st.u[g];
+		for (int i=0; i<Order; ++i) t[g][i] = st.t[g][i];
+	}
+	for (int n=0; n<width; ++n) {
+#pragma GCC unroll 4
+		for (int g=0; g<band_groups; ++g) {
+			int const o = n*band_rows + g*bank_lanes;
+			lane_vec x;
+			lane_uivec code;
+			quantize_lanes(lanes(in+o) - u[g],thresh,x,code);
+			std::memcpy(out+o,&code,sizeof(code));
+			lattice_lanes_uniform<Order>(lam,s2,k,u[g],t[g],x);
+		}
+	}
+	for (int g=0; g<band_groups; ++g) {
+		st.u[g] = u[g];
+		for (int i=0; i<Order; ++i) st.t[g][i] = t[g][i];
+	}
+}
+
+void shape_band_generic(band_params const& p, band_state & st,
+	float const* in, unsigned* out, int width)
+{
+	for (int n=0; n<width; ++n) {
+		for (int g=0; g<band_groups; ++g) {
+			int const o = n*band_rows + g*bank_lanes;
+			lane_vec x;
+			lane_uivec code;
+			quantize_lanes(lanes(in+o) - st.u[g],p.thresh,x,code);
+			std::memcpy(out+o,&code,sizeof(code));
+			lattice_lanes_uniform(p.order,p.lam,p.s2,p.k,st.u[g],st.t[g],x);
+		}
+	}
+}
+
+typedef void (*band_fn)(band_params const&, band_state &,
+	float const*, unsigned*, int);
+
+band_fn const unrolled[max_unrolled_order+1] = {
+	shape_band_generic, shape_band<1>, shape_band<2>, shape_band<3>,
+	shape_band<4>, shape_band<5>, shape_band<6>, shape_band<7>,
+	shape_band<8>
+};
+
+
+#ifdef __AVX2__
+inline void transpose8(__m256 (&v)[8])
+{
+	__m256 const t0 = _mm256_unpacklo_ps(v[0],v[1]);
+	__m256 const t1 = _mm256_unpackhi_ps(v[0],v[1]);
+	__m256 const t2 = _mm256_unpacklo_ps(v[2],v[3]);
+	__m256 const t3 = _mm256_unpackhi_ps(v[2],v[3]);
+	__m256 const t4 = _mm256_unpacklo_ps(v[4],v[5]);
+	__m256 const t5 = _mm256_unpackhi_ps(v[4],v[5]);
+	__m256 const t6 = _mm256_unpacklo_ps(v[6],v[7]);
+	__m256 const t7 = _mm256_unpackhi_ps(v[6],v[7]);
+	__m256 const s0 = _mm256_shuffle_ps(t0,t2,0x44);
+	__m256 const s1 = _mm256_shuffle_ps(t0,t2,0xee);
+	__m256 const s2 = _mm256_shuffle_ps(t1,t3,0x44);
+	__m256 const s3 = _mm256_shuffle_ps(t1,t3,0xee);
+	__m256 const s4 = _mm256_shuffle_ps(t4,t6,0x44);
+	__m256 const s5 = _mm256_shuffle_ps(t4,t6,0xee);
+	__m256 const s6 = _mm256_shuffle_ps(t5,t7,0x44);
+	__m256 const s7 = _mm256_shuffle_ps(t5,t7,0xee);
+	v[0] = _mm256_permute2f128_ps(s0,s4,0x20);
+	v[1] = _mm256_permute2f128_ps(s1,s5,0x20);
+	v[2] = _mm256_permute2f128_ps(s2,s6,0x20);
+	v[3] = _mm256_permute2f128_ps(s3,s7,0x20);
+	v[4] = _mm256_permute2f128_ps(s0,s4,0x31);
+	v[5] = _mm256_permute2f128_ps(s1,s5,0x31);
+	v[6] = _mm256_permute2f128_ps(s2,s6,0x31);
+	v[7] = _mm256_permute2f128_ps(s3,s7,0x31);
+}
+#endif
+
+/*
+ * buf[n][r] = src row r at column n0+n, scaled. With AVX2 whole 8x8
+ * blocks go through vector loads and a register transpose; the rest of a
+ * tile (and everything without AVX2) is copied element by element.
+ */
+void load_tile(uint16_t const* const* src, int const* step, int n0, int len,
+	float scale, float* buf)
+{
+	int done = 0;
+#ifdef __AVX2__
+	__m128i const reverse = _mm_setr_epi8(14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1);
+	__m256 const sv = _mm256_set1_ps(scale);
+	for (; done+8<=len; done+=8) {
+		for (int r0=0; r0<band_rows; r0+=8) {
+			__m256 v[8];
+			for (int i=0; i<8; ++i) {
+				int const r = r0+i;
+				uint16_t const* s = src[r] + step[r]*(n0+done);
+				__m128i x;
+				if (step[r] > 0) {
+					x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s));
+				} else {
+					x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s-7));
+					x = _mm_shuffle_epi8(x,reverse);
+				}
+				v[i] = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(x)),sv);
+			}
+			transpose8(v);
+			for (int i=0; i<8; ++i) _mm256_store_ps(buf+(done+i)*band_rows+r0,v[i]);
+		}
+	}
+#endif
+	for (int r=0; r<band_rows; ++r) {
+		uint16_t const* s = src[r] + step[r]*n0;
+		int const d = step[r];
+		for (int n=done; n<len; ++n) buf[n*band_rows+r] = s[d*n] * scale;
+	}
+}
+
+/** the low bytes of codes[n][r] into the first rows rows at column n0+n */
+void store_tile(unsigned const* codes, unsigned char* const* dst,
+	int const* step, int rows, int n0, int len)
+{
+	int done = 0;
+#ifdef __AVX2__
+	__m256i const low = _mm256_set1_epi32(0xff);
+	for (; rows==band_rows && done+8<=len; done+=8) {
+		for (int r0=0; r0<band_rows; r0+=8) {
+			__m256 v[8];
+			for (int i=0; i<8; ++i) {
+				v[i] = _mm256_load_ps(reinterpret_cast<float const*>(
+					codes+(done+i)*band_rows+r0));
+			}
+			transpose8(v);
+			for (int i=0; i<8; ++i) {
+				int const r = r0+i;
+				__m256i x = _mm256_and_si256(_mm256_castps_si256(v[i]),low);
+				x = _mm256_packus_epi32(x,x);
+				x = _mm256_packus_epi16(x,x);
+				uint64_t b = static_cast<uint32_t>(_mm256_extract_epi32(x,0))
+					| uint64_t(static_cast<uint32_t>(_mm256_extract_epi32(x,4))) << 32;
+				unsigned char* o = dst[r] + step[r]*(n0+done);
+				if (step[r] < 0) {
+					b = __builtin_bswap64(b);
+					o -= 7;
+				}
+				std::memcpy(o,&b,8);
+			}
+		}
+	}
+#endif
+	for (int r=0; r<rows; ++r) {
+		unsigned char* o = dst[r] + step[r]*n0;
+		int const d = step[r];
+		for (int n=done; n<len; ++n) o[d*n] = static_cast<unsigned char>(codes[n*band_rows+r]);
+	}
+}
+
+} // anonymous namespace
+
+image_shaper::image_shaper(float lam, int ord, float const* k)
+: order_(0), serpentine_(false), thresh_(1.0f), lam_(0), s2_(1)
+{
+	set_params(lam,ord,k);
+}
+
+void image_shaper::set_params(float lam, int ord, float const* k)
+{
+	waplns ns;
+	ns.set_params(lam,ord,k);
+	order_ = ns.order();
+	lam_ = lam;
+	s2_ = 1.0f / ns.warp_gain();
+	for (int i=0; i<order_; ++i) k_[i] = ns.k(i);
+}
+
+void image_shaper::process_plane(uint16_t const* in, int in_stride,
+	int in_bits, unsigned char* out, int out_stride, int width, int height,
+	int first_row) const
+{
+	assert(8 < in_bits && in_bits <= 16);
+	float const scale = 1.0f / static_cast<float>(1 << (in_bits - 8));
+	band_params p;
+	p.order = order_;
+	p.lam = lam_;
+	p.s2 = s2_;
+	p.thresh = thresh_;
+	p.k = k_;
+	band_fn const shape = order_ <= max_unrolled_order
+		? unrolled[order_] : shape_band_generic;
+	alignas(32) float buf[tile * band_rows];
+	alignas(32) unsigned codes[tile * band_rows];
+	band_state st;
+	uint16_t const* src[band_rows];
+	unsigned char* dst[band_rows];
+	int step[band_rows];
+	for (int y0=0; y0<height; y0+=band_rows) {
+		int const rows = std::min(height-y0,band_rows);
+		for (int r=0; r<band_rows; ++r) {
+			int const y = y0 + std::min(r,rows-1);
+			bool const rev = serpentine_ && ((first_row + y) & 1);
+			src[r] = in + static_cast<long>(y) * in_stride + (rev ? width-1 : 0);
+			dst[r] = out + static_cast<long>(y) * out_stride + (rev ? width-1 : 0);
+			step[r] = rev ? -1 : 1;
+		}
+		std::memset(&st,0,sizeof(st));
+		// tile by tile, so both transposes and the shaping stay in L1
+		for (int n0=0; n0<width; n0+=tile) {
+			int const len = std::min(width-n0,tile);
+			load_tile(src,step,n0,len,scale,buf);
+			shape(p,st,buf,codes,len);
+			store_tile(codes,dst,step,rows,n0,len);
+		}
+	}
+}
+
+void image_shaper::process_yuv(uint16_t const* const* in,
+	int const* in_stride, int in_bits, unsigned char* const* out,
+	int const* out_stride, int width, int height, int cx, int cy) const
+{
+	process_plane(in[0],in_stride[0],in_bits,out[0],out_stride[0],width,height);
+	int const cw = (width + (1 << cx) - 1) >> cx;
+	int const ch = (height + (1 << cy) - 1) >> cy;
+	for (int p=1; p<3; ++p) {
+		process_plane(in[p],in_stride[p],in_bits,out[p],out_stride[p],cw,ch);
+	}
+}
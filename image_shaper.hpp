@@ -0,0 +1,56 @@
+#ifndef IMAGE_SHAPER_HPP_INCLUDED
+#define IMAGE_SHAPER_HPP_INCLUDED
+
+#include <stdint.h>
+#include "waplns_bank.hpp"
+
+/**
+ * Noise-shaped bit depth reduction of video planes (9..16 bit samples in
+ * uint16_t to 8 bit) with the warped lattice of waplns. Shaping runs along
+ * the scanlines: several groups of bank_lanes rows at a time, one row per
+ * vector lane, each row with its own t[] state that starts at zero. All
+ * rows of a plane share one set of parameters.
+ *
+ * With serpentine order every second row is shaped right to left, which
+ * keeps the error from piling up at the left edge in the same way in
+ * every row (visible as vertical streaks in flat areas).
+ *
+ * The object holds no per-plane state, so bands of rows may be handed to
+ * separate image_shaper objects on separate threads.
+ */
+class image_shaper
+{
+	int order_;
+	bool serpentine_;
+	float thresh_;
+	float lam_;
+	float s2_;
+	float k_[max_wapl_filt_order];
+
+public:
+	image_shaper(float lam, int ord, float const* k);
+
+	void set_params(float lam, int ord, float const* k);
+	void set_serpentine(bool on) { serpentine_ = on; }
+	/** restricts the fed back error, in output LSB (default 1) */
+	void set_thresh(float t) { thresh_ = t; }
+
+	/**
+	 * Requantizes width x height samples of in_bits each. Strides are in
+	 * elements. Rows are numbered from first_row for the serpentine
+	 * direction, so bands of one plane keep the global pattern.
+	 */
+	void process_plane(uint16_t const* in, int in_stride, int in_bits,
+		unsigned char* out, int out_stride, int width, int height,
+		int first_row = 0) const;
+
+	/**
+	 * Planar YUV: plane 0 is width x height, planes 1 and 2 are subsampled
+	 * by 2^cx horizontally and 2^cy vertically (cx = cy = 1 for 4:2:0).
+	 */
+	void process_yuv(uint16_t const* const* in, int const* in_stride,
+		int in_bits, unsigned char* const* out, int const* out_stride,
+		int width, int height, int cx, int cy) const;
+};
+
+#endif // IMAGE_SHAPER_HPP_INCLUDED
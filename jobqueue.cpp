@@ -0,0 +1,182 @@
+
+/*
+ * Temporary files are named ".<name>.<host>.<pid>" in the target
+ * directory so the final rename() never crosses file systems and two
+ * writers never share a temporary. Directory listings skip dot files.
+ *
+ * A ticket holds "attempts <n>" and the host.pid of its last claimer.
+ * Only the lease owner rewrites it (temp file and rename, which also
+ * renews the heartbeat), so the count needs no further locking.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "jobqueue.hpp"
+
+namespace { // anonymous
+
+char const* const subdirs[] = { "todo", "leases", "done", "failed", "jobs", "state" };
+
+bool first_entry(std::string const& dir, std::string & name)
+{
+	DIR* d = opendir(dir.c_str());
+	if (!d) return false;
+	bool found = false;
+	while (dirent* e = readdir(d)) {
+		if (e->d_name[0] == '.') continue;
+		name = e->d_name;
+		found = true;
+		break;
+	}
+	closedir(d);
+	return found;
+}
+
+std::string ticket_content(int attempts, std::string const& owner)
+{
+	return "attempts " + std::to_string(attempts) + "\n" + owner + "\n";
+}
+
+} // anonymous namespace
+
+job_queue::job_queue(std::string const& dir, int max_attempts)
+: dir_(dir), max_attempts_(max_attempts)
+{
+	mkdir(dir_.c_str(),0777);
+	for (unsigned i=0; i<sizeof(subdirs)/sizeof(*subdirs); ++i) {
+		mkdir((dir_ + "/" + subdirs[i]).c_str(),0777);
+	}
+	char host[256] = "localhost";
+	gethostname(host,sizeof(host)-1);
+	owner_ = std::string(host) + "." + std::to_string(getpid());
+}
+
+std::string job_queue::path(char const* sub, std::string const& name) const
+{
+	return dir_ + "/" + sub + "/" + name;
+}
+
+bool job_queue::write_file(char const* sub, std::string const& name,
+	std::string const& content)
+{
+	std::string const tmp = path(sub,"." + name + "." + owner_);
+	int const fd = open(tmp.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0666);
+	if (fd < 0) return false;
+	bool ok = write(fd,content.data(),content.size())
+		== static_cast<ssize_t>(content.size());
+	ok = fsync(fd) == 0 && ok;
+	ok = close(fd) == 0 && ok;
+	if (ok) ok = rename(tmp.c_str(),path(sub,name).c_str()) == 0;
+	if (!ok) unlink(tmp.c_str());
+	return ok;
+}
+
+bool job_queue::read_file(char const* sub, std::string const& name,
+	std::string & content) const
+{
+	std::FILE* f = std::fopen(path(sub,name).c_str(),"rb");
+	if (!f) return false;
+	content.clear();
+	char buf[4096];
+	std::size_t n;
+	while ((n = std::fread(buf,1,sizeof(buf),f)) > 0) content.append(buf,n);
+	std::fclose(f);
+	return true;
+}
+
+bool job_queue::put(std::string const& ticket)
+{
+	return write_file("todo",ticket,ticket_content(0,owner_));
+}
+
+bool job_queue::claim(std::string & ticket)
+{
+	std::string name;
+	// another worker may win the race for the entry we saw; retry
+	while (first_entry(dir_ + "/todo",name)) {
+		std::string const todo = path("todo",name);
+		// rename() keeps the mtime, so the heartbeat goes first: a lease
+		// that shows up with the time it was queued looks expired to
+		// recover() on other hosts
+		utimes(todo.c_str(),0);
+		std::string const lease = path("leases",name);
+		if (rename(todo.c_str(),lease.c_str()) == 0) {
+			std::string text;
+			int attempts = 0;
+			if (read_file("leases",name,text)) {
+				std::sscanf(text.c_str(),"attempts %d",&attempts);
+			}
+			if (attempts >= max_attempts_) {
+				rename(lease.c_str(),path("failed",name).c_str());
+				continue;
+			}
+			write_file("leases",name,ticket_content(attempts+1,owner_));
+			ticket = name;
+			return true;
+		}
+		if (errno != ENOENT) return false;
+	}
+	return false;
+}
+
+void job_queue::heartbeat(std::string const& ticket)
+{
+	utimes(path("leases",ticket).c_str(),0);
+}
+
+bool job_queue::owns(std::string const& ticket) const
+{
+	std::string text;
+	if (!read_file("leases",ticket,text)) return false;
+	std::string::size_type const nl = text.find('\n');
+	if (nl == std::string::npos) return false;
+	return text.compare(nl+1,std::string::npos,owner_ + "\n") == 0;
+}
+
+bool job_queue::complete(std::string const& ticket)
+{
+	if (!owns(ticket)) return false;
+	return rename(path("leases",ticket).c_str(),path("done",ticket).c_str()) == 0;
+}
+
+int job_queue::recover(int timeout_s)
+{
+	DIR* d = opendir((dir_ + "/leases").c_str());
+	if (!d) return 0;
+	int n = 0;
+	std::time_t const now = std::time(0);
+	while (dirent* e = readdir(d)) {
+		if (e->d_name[0] == '.') continue;
+		std::string const lease = path("leases",e->d_name);
+		struct stat st;
+		if (stat(lease.c_str(),&st) != 0) continue;
+		if (now - st.st_mtime <= timeout_s) continue;
+		if (rename(lease.c_str(),path("todo",e->d_name).c_str()) == 0) ++n;
+	}
+	closedir(d);
+	return n;
+}
+
+bool job_queue::idle() const
+{
+	std::string name;
+	return !first_entry(dir_ + "/todo",name) && !first_entry(dir_ + "/leases",name);
+}
+
+bool job_queue::is_done(std::string const& ticket) const
+{
+	struct stat st;
+	return stat(path("done",ticket).c_str(),&st) == 0;
+}
+
+bool job_queue::is_failed(std::string const& ticket) const
+{
+	struct stat st;
+	return stat(path("failed",ticket).c_str(),&st) == 0;
+}
@@ -0,0 +1,77 @@
+#ifndef JOBQUEUE_HPP_INCLUDED
+#define JOBQUEUE_HPP_INCLUDED
+
+#include <string>
+
+/**
+ * A job queue on a shared directory (e.g. an NFS volume), without any
+ * broker. Tickets are empty-ish files that move between subdirectories:
+ *
+ *    todo/<ticket>    ready to be claimed
+ *    leases/<ticket>  claimed; the file's mtime is the owner's heartbeat
+ *    done/<ticket>    finished
+ *    failed/<ticket>  given up after max_attempts claims
+ *
+ * Moves are rename()s, which are atomic on the same file system, so when
+ * several hosts try to claim the same ticket exactly one rename succeeds.
+ * A lease whose heartbeat is older than the timeout belongs to a crashed
+ * worker; recover() moves it back to todo/ (again by rename, so only one
+ * recoverer wins). Work done for a ticket therefore has to be idempotent:
+ * after a crash it may be done twice.
+ *
+ * A claim also writes the claimer into the ticket, so a worker can tell
+ * that its lease went to someone else (owns()) before it writes results.
+ * The check and the following write are not atomic; a lease lost in
+ * between still means the work is done twice, which idempotence covers.
+ *
+ * A ticket counts its claims in its content. A failing worker leaves its
+ * lease to expire like a crashed one, so the ticket goes to another
+ * worker; the claim that would exceed max_attempts moves it to failed/
+ * instead, and the queue can become idle.
+ *
+ * Other files (job descriptions, carried state) are written with
+ * write_file() which writes a temporary file and renames it into place,
+ * so readers never see partial content.
+ */
+class job_queue
+{
+	std::string dir_;
+	std::string owner_;
+	int max_attempts_;
+
+public:
+	/** opens (and if needed creates) the queue in dir */
+	explicit job_queue(std::string const& dir, int max_attempts = 3);
+
+	std::string path(char const* sub, std::string const& name) const;
+
+	/** makes a ticket claimable */
+	bool put(std::string const& ticket);
+	/**
+	 * claims any ready ticket; false if there is none. Tickets claimed
+	 * max_attempts times already are moved to failed/ on the way.
+	 */
+	bool claim(std::string & ticket);
+	void heartbeat(std::string const& ticket);
+	/**
+	 * true if the lease on ticket is still ours: a worker that stalled past
+	 * the timeout may have lost it to recover() and another claimer, and
+	 * must not publish anything for the ticket any more
+	 */
+	bool owns(std::string const& ticket) const;
+	/** moves the lease to done/ if it is still ours, else false */
+	bool complete(std::string const& ticket);
+	/** moves leases older than timeout_s back to todo/, returns count */
+	int recover(int timeout_s);
+	/** true if there is nothing ready and nothing leased */
+	bool idle() const;
+	bool is_done(std::string const& ticket) const;
+	bool is_failed(std::string const& ticket) const;
+
+	bool write_file(char const* sub, std::string const& name,
+		std::string const& content);
+	bool read_file(char const* sub, std::string const& name,
+		std::string & content) const;
+};
+
+#endif // JOBQUEUE_HPP_INCLUDED
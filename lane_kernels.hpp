@@ -0,0 +1,201 @@
+#ifndef LANE_KERNELS_HPP_INCLUDED
+#define LANE_KERNELS_HPP_INCLUDED
+
+#include <cstring>
+#include "waplns_bank.hpp"
+
+/**
+ * Lattice kernels that run bank_lanes independent shapers side by side.
+ * Parameters and state are lane-interleaved (k[stage][lane]). Shared by
+ * waplns_bank, uniform_bank, warped_lattice_bank and the image shaper;
+ * not meant as a public interface.
+ */
+
+typedef float lane_vec __attribute__((vector_size(bank_lanes*sizeof(float))));
+typedef int lane_ivec __attribute__((vector_size(bank_lanes*sizeof(int))));
+
+// unaligned access to the lane rows of a group
+typedef float lane_uvec __attribute__((vector_size(bank_lanes*sizeof(float)),aligned(4)));
+
+inline lane_uvec & lanes(float* p)
+{
+	return *reinterpret_cast<lane_uvec*>(p);
+}
+
+inline lane_uvec const& lanes(float const* p)
+{
+	return *reinterpret_cast<lane_uvec const*>(p);
+}
+
+/*
+ * One x_was() for all lanes of a group. With Masked, lanes whose mask is
+ * zero compute along but keep their t[] and u, so they can sit out samples
+ * while the other lanes continue. Written with GCC/Clang vector types since
+ * the autovectorizer tends to scalarize the two interleaved lattices.
+ */
+template<bool Masked>
+inline void lattice_lanes(int order, float const* lam, float const* s2,
+	float* u, float const (*k)[bank_lanes], float (*t)[bank_lanes],
+	float const* x, int const* mask)
+{
+	lane_ivec m = {0};
+	if (Masked) std::memcpy(&m,mask,sizeof(m));
+	lane_vec const lv = lanes(lam);
+	// y + u = x  <=>  y = x - u
+	lane_vec a = lanes(x) - lanes(u);
+	lane_vec b = a;
+	lane_vec nua = {0};
+	lane_vec nub = {0};
+	for (int i=0; i<order; ++i) {
+		lane_vec const ki = lanes(k[i]);
+		lane_vec const ti = lanes(t[i]);
+		// apply_D_alter_t(b,t,lam) and apply_D_keep_t(nub,t,lam)
+		lane_vec const nt = b + lv * ti;
+		b = ti - lv * nt;
+		lanes(t[i]) = Masked ? (m ? nt : ti) : nt;
+		lane_vec const nnt = nub + lv * nt;
+		nub = nt - lv * nnt;
+		// lattice_step(a,b,k) and lattice_step(nua,nub,k)
+		lane_vec const ak = a * ki;
+		a -= b * ki;
+		b -= ak;
+		lane_vec const nuak = nua * ki;
+		nua -= nub * ki;
+		nub -= nuak;
+	}
+	lane_vec const nu = nua * lanes(s2);
+	lanes(u) = Masked ? (m ? nu : lanes(u)) : nu;
+}
+
+/*
+ * lattice_lanes<false>() for lanes that share lam, s2 and k, with a fixed
+ * order and the state in t[] and u, so that after inlining into a sample
+ * loop over local variables the state stays in registers. The push
+ * variants take y (= x - u) itself, for the plain filters of
+ * warped_lattice_bank, where y is the input (analysis) or the output
+ * (synthesis).
+ */
+template<int Order>
+inline void lattice_push_uniform(float lam, float s2, float const* k,
+	lane_vec & u, lane_vec (&t)[Order], lane_vec const& y)
+{
+	lane_vec a = y;
+	lane_vec b = a;
+	lane_vec nua = {0};
+	lane_vec nub = {0};
+#pragma GCC unroll 8
+	for (int i=0; i<Order; ++i) {
+		float const ki = k[i];
+		lane_vec const ti = t[i];
+		lane_vec const nt = b + lam * ti;
+		b = ti - lam * nt;
+		t[i] = nt;
+		lane_vec const nnt = nub + lam * nt;
+		nub = nt - lam * nnt;
+		lane_vec const ak = a * ki;
+		a -= b * ki;
+		b -= ak;
+		lane_vec const nuak = nua * ki;
+		nua -= nub * ki;
+		nub -= nuak;
+	}
+	u = nua * s2;
+}
+
+template<int Order>
+inline void lattice_lanes_uniform(float lam, float s2, float const* k,
+	lane_vec & u, lane_vec (&t)[Order], lane_vec const& x)
+{
+	lattice_push_uniform<Order>(lam,s2,k,u,t,x - u);
+}
+
+/*
+ * The same with a run time order and the state in memory, for orders too
+ * high to keep in registers. Parameters are still scalars, so a stage
+ * loads only its t[] and broadcasts k.
+ */
+inline void lattice_push_uniform(int order, float lam, float s2,
+	float const* k, lane_vec & u, lane_vec* t, lane_vec const& y)
+{
+	lane_vec a = y;
+	lane_vec b = a;
+	lane_vec nua = {0};
+	lane_vec nub = {0};
+	for (int i=0; i<order; ++i) {
+		float const ki = k[i];
+		lane_vec const ti = t[i];
+		lane_vec const nt = b + lam * ti;
+		b = ti - lam * nt;
+		t[i] = nt;
+		lane_vec const nnt = nub + lam * nt;
+		nub = nt - lam * nnt;
+		lane_vec const ak = a * ki;
+		a -= b * ki;
+		b -= ak;
+		lane_vec const nuak = nua * ki;
+		nua -= nub * ki;
+		nub -= nuak;
+	}
+	u = nua * s2;
+}
+
+inline void lattice_lanes_uniform(int order, float lam, float s2,
+	float const* k, lane_vec & u, lane_vec* t, lane_vec const& x)
+{
+	lattice_push_uniform(order,lam,s2,k,u,t,x - u);
+}
+
+/* u of lanes that share lam, s2 and k, from their current t[] */
+inline lane_vec derived_u_uniform(int order, float lam, float s2,
+	float const* k, lane_vec const* t)
+{
+	lane_vec nua = {0};
+	lane_vec nub = {0};
+	for (int i=0; i<order; ++i) {
+		float const ki = k[i];
+		lane_vec const nt = nub + lam * t[i];
+		nub = t[i] - lam * nt;
+		lane_vec const nuak = nua * ki;
+		nua -= nub * ki;
+		nub -= nuak;
+	}
+	return nua * s2;
+}
+
+/*
+ * waplns::update_derived_and_u() for all lanes of a group: s2 and u from
+ * lam, k and the current t. Only lanes with a nonzero mask are stored.
+ */
+inline void derived_lanes(int order, float const* lam, float* s2,
+	float* u, float const (*k)[bank_lanes], float const (*t)[bank_lanes],
+	int const* mask)
+{
+	lane_ivec m;
+	std::memcpy(&m,mask,sizeof(m));
+	lane_vec const lv = lanes(lam);
+	lane_vec const neg = -lv;
+	lane_vec a = lv * 0 + 1;
+	lane_vec b = a;
+	lane_vec nua = {0};
+	lane_vec nub = {0};
+	for (int i=0; i<order; ++i) {
+		lane_vec const ki = lanes(k[i]);
+		lane_vec const ti = lanes(t[i]);
+		// b *= -lam and lattice_step(a,b,k) give s2 = 1/a
+		b *= neg;
+		lane_vec const ak = a * ki;
+		a -= b * ki;
+		b -= ak;
+		// apply_D_keep_t(nub,t,lam) and lattice_step(nua,nub,k)
+		lane_vec const nt = nub + lv * ti;
+		nub = ti - lv * nt;
+		lane_vec const nuak = nua * ki;
+		nua -= nub * ki;
+		nub -= nuak;
+	}
+	lane_vec const ns2 = 1 / a;
+	lanes(s2) = m ? ns2 : lanes(s2);
+	lanes(u) = m ? nua * ns2 : lanes(u);
+}
+
+#endif // LANE_KERNELS_HPP_INCLUDED
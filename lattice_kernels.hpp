@@ -0,0 +1,102 @@
+#ifndef LATTICE_KERNELS_HPP_INCLUDED
+#define LATTICE_KERNELS_HPP_INCLUDED
+
+#include "tools.hpp"
+
+/**
+ * Scalar building blocks of the warped lattice (the structure is drawn in
+ * waplns.cpp), shared by waplns and warped_lattice. The state t[] is in
+ * float, the signal path in double. Not meant as a public interface.
+ */
+
+template<class T>
+inline void lattice_step(T & a, T & b,   // 4 FLOPS
+	typename identity<T>::type k)
+{
+	T const ak = a * k;
+	a -= b*k;
+	b -= ak;
+}
+
+inline void apply_D_alter_t(double & io, float & t, float lambda) // 4 FLOPS
+{
+	float next_t = io + lambda * t;
+	io = t - lambda * next_t;
+	t = next_t;
+}
+
+inline void apply_D_keep_t(double & io, float t, float lambda) // 4 FLOPS
+{
+	float next_t = io + lambda * t;
+	io = t - lambda * next_t;
+}
+
+/*
+ * Feeds y[n] (already scaled by s1) into the lattice: advances t[] and
+ * returns u[n+1] / s2. 16 * order FLOPS.
+ */
+inline double lattice_push(int order, float lam, float const* k, float* t,
+	double y)
+{
+	double a = y;
+	double b = a;
+	double nua = 0;
+	double nub = 0;
+	for (int i=0; i<order; ++i) {
+		apply_D_alter_t( b,t[i],lam);
+		apply_D_keep_t(nub,t[i],lam);
+		lattice_step(  a,  b,k[i]);
+		lattice_step(nua,nub,k[i]);
+	}
+	return nua;
+	// u is only a linear combination of the ts which could be computed
+	// with 2*order FLOPS instead of 8*order FLOPS assuming we know the
+	// weights (not yet precomputed).
+}
+
+/*
+ * lattice_push() for lam = 0, where D is a unit delay (o = t, next t = i)
+ * and s1 = s2 = 1. The u path then collapses as well: every stage
+ * overwrites nub with its new t, so u is simply -sum k_i * t_i. Same
+ * rounding as lattice_push(). 6 * order FLOPS.
+ */
+inline double lattice_push_unwarped(int order, float const* k, float* t,
+	double y)
+{
+	double a = y;
+	double b = a;
+	double nua = 0;
+	for (int i=0; i<order; ++i) {
+		const float ki = k[i];
+		const float ti = t[i];
+		t[i] = b;
+		b = ti;
+		lattice_step(a,b,ki);
+		nua -= t[i] * static_cast<double>(ki);
+	}
+	return nua;
+}
+
+/*
+ * The derived parameters in a single pass: returns 1/s2 (with s1 = 1) for
+ * lam and k, and sets nu to u / s2 for the current t[].
+ */
+inline double lattice_derived(int order, float lam, float const* k,
+	float const* t, double & nu)
+{
+	const double negative_lam = -lam;
+	double a = 1;
+	double b = 1;
+	double nua = 0;
+	double nub = 0;
+	for (int i=0; i<order; ++i) {
+		b *= negative_lam;
+		lattice_step(a,b,k[i]);
+		apply_D_keep_t(nub,t[i],lam);
+		lattice_step(nua,nub,k[i]);
+	}
+	nu = nua;
+	return a;
+}
+
+#endif // LATTICE_KERNELS_HPP_INCLUDED
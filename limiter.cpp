@@ -0,0 +1,102 @@
+
+/*
+ * Interpolation phase p (1..3) estimates the signal at t = c + p/4 where
+ * c = tp_taps/2 - 1 is the centre of the history window (index 0 is the
+ * oldest sample). Its taps are a Hann-windowed sinc. The detector output
+ * for a sample is max(|x[c]|, |phase 1..3|), i.e. it covers the interval
+ * between x[c] and x[c+1]; that is tp_taps/2 samples behind the newest
+ * input, which is the first part of latency().
+ *
+ * The minimum hold followed by an average over the same length L is the
+ * usual trick to get a smooth attack that never overshoots: if the peak
+ * needs gain r at sample p, all hold values for p..p+L-1 are <= r, so the
+ * average that is applied to sample p is <= r as well.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "limiter.hpp"
+
+tp_limiter::tp_limiter(float ceiling, int lookahead, float release)
+: ceiling_(ceiling), release_(release),
+  lookahead_(std::max(1,std::min(lookahead,max_tp_lookahead)))
+{
+	const double pi = 3.14159265358979323846;
+	int const c = tp_taps/2 - 1;
+	for (int p=1; p<tp_phases; ++p) {
+		double const t = c + static_cast<double>(p)/tp_phases;
+		for (int j=0; j<tp_taps; ++j) {
+			double const x = t - j;
+			double const sinc = std::sin(pi*x) / (pi*x);
+			double const win = 0.5 + 0.5 * std::cos(pi*x/(tp_taps/2));
+			coef_[p-1][j] = static_cast<float>(sinc*win);
+		}
+	}
+	reset_state();
+}
+
+void tp_limiter::reset_state()
+{
+	for (int i=0; i<2*tp_taps; ++i) hist_[i] = 0;
+	hpos_ = 0;
+	for (int i=0; i<ring; ++i) {
+		delay_[i] = 0;
+		box_[i] = 1;
+	}
+	dpos_ = 0;
+	mhead_ = mtail_ = 0;
+	n_ = 0;
+	smooth_ = 1;
+	box_sum_ = lookahead_;
+}
+
+float tp_limiter::true_peak()
+{
+	float const* h = hist_ + hpos_;
+	float peak = std::fabs(h[tp_taps/2-1]);
+	for (int p=0; p<tp_phases-1; ++p) {
+		float acc = 0;
+		for (int j=0; j<tp_taps; ++j) acc += coef_[p][j] * h[j];
+		peak = std::max(peak,std::fabs(acc));
+	}
+	return peak;
+}
+
+float tp_limiter::step(float s)
+{
+	// detector
+	hist_[hpos_] = hist_[hpos_+tp_taps] = s;
+	if (++hpos_ == tp_taps) hpos_ = 0;
+	float const peak = true_peak();
+	float const req = peak > ceiling_ ? ceiling_ / peak : 1.0f;
+
+	// minimum over the last lookahead_ required gains
+	unsigned const n = n_++;
+	while (mhead_ != mtail_ && req <= minv_[(mtail_-1) & ring_mask]) --mtail_;
+	minv_[mtail_ & ring_mask] = req;
+	mini_[mtail_ & ring_mask] = n;
+	++mtail_;
+	if (n - mini_[mhead_ & ring_mask] >= static_cast<unsigned>(lookahead_)) ++mhead_;
+	float const hold = minv_[mhead_ & ring_mask];
+
+	// instant attack, smooth release
+	smooth_ = hold < smooth_ ? hold : smooth_ + release_ * (hold - smooth_);
+
+	// moving average over the look-ahead window
+	float & oldest = box_[(n - lookahead_) & ring_mask];
+	box_sum_ += smooth_ - oldest;
+	box_[n & ring_mask] = smooth_;
+	float const g = static_cast<float>(box_sum_ / lookahead_);
+
+	// delay the signal to line up with the gain
+	delay_[dpos_ & ring_mask] = s;
+	float const out = delay_[(dpos_ - latency()) & ring_mask];
+	++dpos_;
+	return out * g;
+}
+
+void tp_limiter::process(float const* s, float* out, int count)
+{
+	for (int i=0; i<count; ++i) out[i] = step(s[i]);
+}
@@ -0,0 +1,96 @@
+#ifndef LIMITER_HPP_INCLUDED
+#define LIMITER_HPP_INCLUDED
+
+#include "shaper.hpp"
+
+const int max_tp_lookahead = 256;
+
+/**
+ * Look-ahead true-peak limiter that can feed the shaper directly.
+ *
+ * The detector oversamples 4x with a windowed-sinc interpolator
+ * (tp_taps taps per phase) to see inter-sample peaks. The gain computer
+ * holds the minimum required gain over the look-ahead window, releases
+ * with a one-pole smoother and finally averages over the window again,
+ * which gives a ramp that reaches the required gain exactly at the peak:
+ *
+ *    s --[4x peak]--> ceiling/peak --[min hold L]--[release]--[avg L]--> g
+ *    s --[delay latency()]------------------------------------------(x)--> out
+ *
+ * The fused process() overload runs this and shape_block()'s loop body in
+ * the same pass, so the limited signal never goes through a float buffer.
+ * All state lives in fixed-size arrays like waplns' (no heap).
+ */
+class tp_limiter
+{
+public:
+	enum { tp_phases = 4, tp_taps = 12 };
+
+private:
+	enum { ring = 512, ring_mask = ring-1 };
+
+	float ceiling_;
+	float release_;
+	int lookahead_;
+	float coef_[tp_phases-1][tp_taps];
+
+	// interpolator history, stored twice so a window is always contiguous
+	float hist_[2*tp_taps];
+	int hpos_;
+
+	// sample delay line
+	float delay_[ring];
+	unsigned dpos_;
+
+	// sliding minimum (monotonic queue) over the look-ahead window
+	float minv_[ring];
+	unsigned mini_[ring];
+	unsigned mhead_, mtail_;
+	unsigned n_;
+
+	// release smoother and moving average
+	float smooth_;
+	float box_[ring];
+	double box_sum_;
+
+	float true_peak();
+
+public:
+	/**
+	 * ceiling: maximum true-peak magnitude (on the integer grid),
+	 * lookahead: window length in samples (1..max_tp_lookahead),
+	 * release: per-sample release coefficient (0..1, larger is faster)
+	 */
+	tp_limiter(float ceiling, int lookahead, float release);
+
+	void reset_state();
+	/** delay between input and output in samples */
+	int latency() const { return tp_taps/2 + lookahead_ - 1; }
+	float ceiling() const { return ceiling_; }
+
+	/** consumes one input sample, returns one delayed limited sample */
+	float step(float s);
+
+	/** limiter only: out[] = limited and delayed s[] */
+	void process(float const* s, float* out, int count);
+
+	/** limiter and shaper in one streaming loop; returns as shape_block() */
+	template<class Quant>
+	bool process(waplns & ns, Quant & quant,
+		float const* s, typename Quant::code_type* q, int count);
+};
+
+template<class Quant>
+bool tp_limiter::process(waplns & ns, Quant & quant,
+	float const* s, typename Quant::code_type* q, int count)
+{
+	for (int i=0; i<count; ++i) {
+		float const w = step(s[i]) - ns.u();
+		float qlin;
+		q[i] = quant.quantize(w,qlin);
+		ns.x_was(quant.clamp_error(qlin - w));
+	}
+	return ns.check_state();
+}
+
+#endif // LIMITER_HPP_INCLUDED
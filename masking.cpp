@@ -0,0 +1,213 @@
+
+/*
+ * Per block: window, real FFT into power_[], log2 of every bin in lane
+ * vectors (exponent bits plus a quadratic in the mantissa, about 0.005
+ * off, plenty for a flatness measure), then per band the energy and the
+ * sum of the logs. The spectral flatness measure SFM = geometric /
+ * arithmetic mean in dB is taken over the band and its two neighbours:
+ * low bands hold only a few bins, about the width of a Hann main lobe, so
+ * a tone would look flat within its own band. Tonality is
+ * min(SFM / -60 dB, 1) and the masking offset below the
+ * spread energy is alpha (14.5 + z) + (1 - alpha) 5.5 dB (Johnston).
+ * The spread energy of band i is the sum over maskers j of
+ * spread_[i][j] E[j], with Schroeder's spreading function normalized so
+ * that a flat spectrum spreads to itself. Each bin of the band gets the
+ * band threshold divided by its number of bins, floored at the ATH.
+ *
+ * Units: welch_psd() style power per bin. A tone of variance V has the
+ * power V n/2 summed over its bins (n = block), so a tone at the
+ * threshold in quiet gives the per-bin floor V_ath n/2 with V_ath the
+ * variance of a sine at that SPL.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "lane_kernels.hpp"
+#include "masking.hpp"
+#include "trace.hpp"
+
+namespace { // anonymous
+
+const double pi = 3.14159265358979323846;
+
+// the threshold in quiet tops out here, above full scale it is moot
+const double ath_max_db = 96;
+
+double bark(double f)
+{
+	return 13 * std::atan(0.00076 * f) + 3.5 * std::atan((f / 7500) * (f / 7500));
+}
+
+// Schroeder's spreading function, dz = maskee - masker in Bark, in dB
+double spreading_db(double dz)
+{
+	double const d = dz + 0.474;
+	return 15.81 + 7.5 * d - 17.5 * std::sqrt(1 + d * d);
+}
+
+inline lane_vec fast_log2(lane_vec x)
+{
+	lane_ivec bits;
+	std::memcpy(&bits,&x,sizeof(bits));
+	lane_vec const e = __builtin_convertvector(((bits >> 23) & 0xff) - 127,lane_vec);
+	lane_ivec const mb = (bits & 0x7fffff) | 0x3f800000;
+	lane_vec m;
+	std::memcpy(&m,&mb,sizeof(m));
+	return e + (-0.34484843f * m + 2.02466578f) * m - 1.67487759f;
+}
+
+} // anonymous namespace
+
+masking_model::masking_model(double fs, int block, float lam, double full_scale_spl)
+: block_(block), bins_(block/2 + 1), bands_(0), fft_(block/2),
+  fitter_(block/2 + 1,lam), own_(0)
+{
+	workspace_spec const spec(0,block,1);
+	own_ = new workspace_buffer(workspace_bytes(spec));
+	workspace_arena ws(own_->data(),own_->size());
+	layout(ws,spec,this);
+	init(fs,full_scale_spl);
+}
+
+masking_model::masking_model(workspace_spec const& spec, void* mem,
+	std::size_t bytes, double fs, float lam, double full_scale_spl)
+: block_(spec.block), bins_(spec.block/2 + 1), bands_(0), fft_(spec.block/2),
+  fitter_(spec.block/2 + 1,lam), own_(0)
+{
+	workspace_arena ws(mem,bytes);
+	layout(ws,spec,this);
+	init(fs,full_scale_spl);
+}
+
+masking_model::~masking_model()
+{
+	delete own_;
+}
+
+std::size_t masking_model::workspace_bytes(workspace_spec const& spec)
+{
+	workspace_arena ws;
+	layout(ws,spec,0);
+	return ws.used();
+}
+
+void masking_model::layout(workspace_arena & ws, workspace_spec const& spec,
+	masking_model* m)
+{
+	std::size_t const block = spec.block;
+	std::size_t const bins = block/2 + 1;
+	std::size_t const padded = (bins + bank_lanes - 1) / bank_lanes * bank_lanes;
+	std::size_t const bands = std::min<std::size_t>(bins,max_bands);
+	ws.take(m ? &m->window_ : 0,block);
+	ws.take(m ? &m->ath_ : 0,bins);
+	ws.take(m ? &m->band_lo_ : 0,bands + 1);
+	ws.take(m ? &m->band_z_ : 0,bands);
+	ws.take(m ? &m->spread_ : 0,bands * bands);
+	ws.take(m ? &m->buf_ : 0,block);
+	ws.take(m ? &m->power_ : 0,padded);
+	ws.take(m ? &m->logp_ : 0,padded);
+	ws.take(m ? &m->energy_ : 0,bands);
+	ws.take(m ? &m->logsum_ : 0,bands);
+	ws.take(m ? &m->tonality_ : 0,bands);
+	ws.take(m ? &m->thresh_ : 0,bins);
+}
+
+void masking_model::init(double fs, double full_scale_spl)
+{
+	int const block = block_;
+	window_.resize(block);
+	ath_.resize(bins_);
+	buf_.resize(block);
+	power_.resize(power_.capacity());
+	logp_.resize(logp_.capacity());
+	thresh_.resize(bins_);
+	for (int i=0; i<block; ++i) window_[i] = static_cast<float>(0.5 - 0.5 * std::cos(2*pi*i/block));
+	// welch_psd() scaling: divide by the window energy, folded into the window
+	double wsum = 0;
+	for (int i=0; i<block; ++i) wsum += window_[i] * window_[i];
+	for (int i=0; i<block; ++i) window_[i] = static_cast<float>(window_[i] / std::sqrt(wsum));
+
+	double const full_scale_var = 32768.0 * 32768.0 / 2;
+	for (int b=0; b<bins_; ++b) {
+		double const db = std::min(ath_db(b * fs / block),ath_max_db) - full_scale_spl;
+		ath_[b] = static_cast<float>(full_scale_var * std::pow(10.0,db / 10) * block / 2);
+	}
+
+	// bands: runs of bins within the same whole Bark
+	double zsum[max_bands];
+	int cur = -1;
+	for (int b=0; b<bins_; ++b) {
+		double const z = bark(b * fs / block);
+		if (static_cast<int>(z) != cur || b == 0) {
+			cur = static_cast<int>(z);
+			zsum[band_lo_.size()] = 0;
+			band_lo_.push_back(b);
+		}
+		zsum[band_lo_.size() - 1] += z;
+	}
+	bands_ = static_cast<int>(band_lo_.size());
+	band_lo_.push_back(bins_);
+	for (int i=0; i<bands_; ++i) {
+		band_z_.push_back(static_cast<float>(zsum[i] / (band_lo_[i+1] - band_lo_[i])));
+	}
+	spread_.resize(bands_ * bands_);
+	for (int i=0; i<bands_; ++i) {
+		double sum = 0;
+		for (int j=0; j<bands_; ++j) {
+			double const s = std::pow(10.0,spreading_db(band_z_[i] - band_z_[j]) / 10);
+			spread_[i*bands_ + j] = static_cast<float>(s);
+			sum += s;
+		}
+		for (int j=0; j<bands_; ++j) spread_[i*bands_ + j] /= static_cast<float>(sum);
+	}
+	energy_.resize(bands_);
+	logsum_.resize(bands_);
+	tonality_.resize(bands_);
+}
+
+void masking_model::analyze(float const* x)
+{
+	WAPLNS_TRACE_SCOPE(trace_analyze);
+	for (int i=0; i<block_; ++i) buf_[i] = x[i] * window_[i];
+	fft_.real_power(&buf_[0],&power_[0]);
+	// the floor keeps log2 finite on digital silence
+	int const nv = static_cast<int>(power_.size());
+	for (int b=0; b<nv; b+=bank_lanes) {
+		lane_vec const p = lanes(&power_[b]) + 1e-20f;
+		lanes(&logp_[b]) = fast_log2(p);
+	}
+
+	for (int i=0; i<bands_; ++i) {
+		float e = 0, l = 0;
+		for (int b=band_lo_[i]; b<band_lo_[i+1]; ++b) {
+			e += power_[b];
+			l += logp_[b];
+		}
+		energy_[i] = e;
+		logsum_[i] = l;
+	}
+	float const db_per_log2 = 3.0103f;
+	for (int i=0; i<bands_; ++i) {
+		int const i0 = std::max(i-1,0), i1 = std::min(i+1,bands_-1);
+		float e = 0, l = 0;
+		for (int j=i0; j<=i1; ++j) {
+			e += energy_[j];
+			l += logsum_[j];
+		}
+		float const n = static_cast<float>(band_lo_[i1+1] - band_lo_[i0]);
+		// 10 log10(geometric / arithmetic mean), <= 0
+		float const sfm = db_per_log2 * (l / n - std::log2(e / n + 1e-20f));
+		tonality_[i] = std::max(0.0f,std::min(sfm / -60.0f,1.0f));
+	}
+	for (int i=0; i<bands_; ++i) {
+		float const* const s = &spread_[i*bands_];
+		float c = 0;
+		for (int j=0; j<bands_; ++j) c += s[j] * energy_[j];
+		float const a = tonality_[i];
+		float const offset_db = a * (14.5f + band_z_[i]) + (1 - a) * 5.5f;
+		int const lo = band_lo_[i], hi = band_lo_[i+1];
+		float const t = c * std::pow(10.0f,-0.1f * offset_db) / (hi - lo);
+		for (int b=lo; b<hi; ++b) thresh_[b] = std::max(t,ath_[b]);
+	}
+}
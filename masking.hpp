@@ -0,0 +1,93 @@
+#ifndef MASKING_HPP_INCLUDED
+#define MASKING_HPP_INCLUDED
+
+#include "fft.hpp"
+#include "wlpc.hpp"
+#include "workspace.hpp"
+
+/**
+ * A fast simultaneous masking model that turns a block of signal into a
+ * target noise spectrum for adaptive shaping: Hann windowed FFT of the
+ * block, energies in bands of one Bark, a spreading function across the
+ * bands, a tonality estimate per band from its spectral flatness, and the
+ * absolute threshold of hearing as the floor. fit() hands the threshold to
+ * a wlpc_fitter and yields k for waplns::set_params() (or
+ * waplns_bank::update_params()) with the lambda given at construction.
+ *
+ * The signal is in LSB of the 16 bit output, as fed to the shaper, and a
+ * full scale sine is taken to play at full_scale_spl dB SPL. threshold()
+ * holds the allowed noise per bin in the units of welch_psd(): white
+ * noise of variance v is v on every bin, so plain rounding is 1/12.
+ *
+ * One model analyzes any number of channels in turn; the results are
+ * overwritten by the next analyze(). For stereo with one shared filter,
+ * fit the minimum of the two thresholds with fitter().
+ *
+ * The per bin and per band arrays live in workspace memory (see
+ * workspace.hpp, spec.block is the block); the FFT plan and the fitter
+ * keep their own tables.
+ */
+class masking_model
+{
+	int block_;
+	int bins_;
+	int bands_;
+	fft_plan fft_;
+	wlpc_fitter fitter_;
+	workspace_buffer* own_;
+	ws_array<float> window_;
+	ws_array<float> ath_;           // per bin
+	ws_array<int> band_lo_;         // first bin of each band, then bins_
+	ws_array<float> band_z_;        // band centre in Bark
+	ws_array<float> spread_;        // [maskee * bands_ + masker]
+	ws_array<float> buf_;           // windowed block
+	ws_array<float> power_;         // per bin, padded to whole lane vectors
+	ws_array<float> logp_;
+	ws_array<float> energy_;        // per band
+	ws_array<float> logsum_;        // per band, sum of log2 power
+	ws_array<float> tonality_;
+	ws_array<float> thresh_;        // per bin
+
+	masking_model(masking_model const&);
+	masking_model& operator=(masking_model const&);
+
+	static void layout(workspace_arena & ws, workspace_spec const& spec,
+		masking_model* m);
+	void init(double fs, double full_scale_spl);
+
+public:
+	/** bands are whole Barks, and the Bark scale stays below 26 */
+	static const int max_bands = 26;
+
+	/** block is a power of two of at least 64 samples */
+	masking_model(double fs, int block, float lam, double full_scale_spl = 96);
+	/** block spec.block, in caller memory */
+	masking_model(workspace_spec const& spec, void* mem, std::size_t bytes,
+		double fs, float lam, double full_scale_spl = 96);
+	~masking_model();
+
+	static std::size_t workspace_bytes(workspace_spec const& spec);
+
+	int block() const { return block_; }
+	/** block/2 + 1 bins from 0 to fs/2 */
+	int bins() const { return bins_; }
+	int bands() const { return bands_; }
+	float lambda() const { return fitter_.lambda(); }
+
+	/** analyzes block() samples */
+	void analyze(float const* x);
+
+	float const* threshold() const { return &thresh_[0]; }
+	/** 0 (noise-like) .. 1 (tonal) for band b of the last block */
+	float tonality(int b) const { return tonality_[b]; }
+
+	/**
+	 * k[0..order) of a shaper whose noise follows threshold(); returns
+	 * the flatness as wlpc_fit() does
+	 */
+	double fit(int order, float* k) const { return fitter_.fit(threshold(),order,k); }
+	/** the fitter behind fit(), for targets combined from several analyses */
+	wlpc_fitter const& fitter() const { return fitter_; }
+};
+
+#endif // MASKING_HPP_INCLUDED
@@ -0,0 +1,298 @@
+
+/*
+ * Workers sleep on the futex word gen_ and wake up when the callback bumps
+ * it. The futex syscall in begin_cycle() is the only kernel entry on the
+ * callback side; it never sleeps. Completion goes the other way: pending_
+ * counts the workers still busy and the last one stores the generation
+ * into done_, which the callback polls.
+ *
+ * Deadline accounting uses CLOCK_MONOTONIC. The deadline is stored before
+ * the generation is released, so a worker that observes the new generation
+ * also observes the matching deadline.
+ */
+
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <ctime>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "rt_executor.hpp"
+#include "rt_log.hpp"
+#include "trace.hpp"
+
+namespace { // anonymous
+
+inline long long now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+inline int* futex_word(std::atomic<int> & a)
+{
+	return reinterpret_cast<int*>(&a);
+}
+
+inline void futex_wait(std::atomic<int> & a, int expected)
+{
+	syscall(SYS_futex,futex_word(a),FUTEX_WAIT_PRIVATE,expected,0,0,0);
+}
+
+inline void futex_wake(std::atomic<int> & a)
+{
+	syscall(SYS_futex,futex_word(a),FUTEX_WAKE_PRIVATE,INT_MAX,0,0,0);
+}
+
+inline void store_max(std::atomic<long long> & a, long long v)
+{
+	// single writer, so load/store is enough
+	if (a.load(std::memory_order_relaxed) < v)
+		a.store(v,std::memory_order_relaxed);
+}
+
+inline void bump(std::atomic<unsigned long> & a)
+{
+	a.store(a.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+}
+
+} // anonymous namespace
+
+rt_executor::rt_executor(int nworkers, int max_streams,
+	int const* cpus, int priority)
+: nworkers_(nworkers), max_streams_(max_streams), nstreams_(0),
+  priority_(priority), running_(false),
+  workers_(new worker[nworkers]), streams_(new stream[max_streams]),
+  gen_(0), done_(0), pending_(0), quit_(0), deadline_ns_(0),
+  cycles_(0), skipped_(0)
+{
+	assert(nworkers>0);
+	for (int i=0; i<nworkers; ++i) {
+		worker & w = workers_[i];
+		w.owner = this;
+		w.cpu = cpus ? cpus[i] : i;
+		w.first = -1;
+		w.seen = 0;
+		w.load = 0;
+		w.realtime = false;
+		w.log = 0;
+		w.blocks = 0;
+		w.misses = 0;
+		w.worst_ns = 0;
+	}
+}
+
+rt_executor::~rt_executor()
+{
+	stop();
+}
+
+int rt_executor::add_stream(block_fn fn, void* ctx, float weight,
+	trace_stage stage)
+{
+	assert(!running_ && nstreams_<max_streams_);
+	int best = 0;
+	for (int i=1; i<nworkers_; ++i) {
+		if (workers_[i].load < workers_[best].load) best = i;
+	}
+	int const id = nstreams_++;
+	stream & s = streams_[id];
+	s.fn = fn;
+	s.ctx = ctx;
+	s.stage = stage;
+	s.misses = 0;
+	// append so streams run in the order they were added
+	s.next = -1;
+	int* link = &workers_[best].first;
+	while (*link >= 0) link = &streams_[*link].next;
+	*link = id;
+	workers_[best].load += weight;
+	return id;
+}
+
+void rt_executor::set_log(int w, rt_log_ring* ring)
+{
+	assert(!running_ && 0<=w && w<nworkers_);
+	workers_[w].log = ring;
+}
+
+int rt_executor::worker_of(int stream) const
+{
+	assert(0<=stream && stream<nstreams_);
+	for (int i=0; i<nworkers_; ++i) {
+		for (int s=workers_[i].first; s>=0; s=streams_[s].next) {
+			if (s==stream) return i;
+		}
+	}
+	return -1;
+}
+
+void* rt_executor::thread_main(void* arg)
+{
+	worker & w = *static_cast<worker*>(arg);
+#ifdef WAPLNS_TRACE
+	char name[32];
+	std::snprintf(name,sizeof(name),"rt worker cpu %d",w.cpu);
+	trace_register_thread(name);
+#endif
+	w.owner->run(w);
+	return 0;
+}
+
+void rt_executor::run(worker & w)
+{
+	int seen = w.seen;
+	for (;;) {
+		int g;
+		while ((g = gen_.load(std::memory_order_acquire)) == seen) {
+			futex_wait(gen_,seen);
+		}
+		seen = g;
+		if (quit_.load(std::memory_order_relaxed)) break;
+		long long const deadline = deadline_ns_.load(std::memory_order_relaxed);
+		long long const t0 = now_ns();
+		long long t = t0;
+		for (int i=w.first; i>=0; i=streams_[i].next) {
+			stream & s = streams_[i];
+			{
+				WAPLNS_TRACE_SCOPE(s.stage);
+				s.fn(s.ctx);
+			}
+			t = now_ns();
+			if (deadline < t) {
+				bump(s.misses);
+				bump(w.misses);
+				if (w.log) {
+					w.log->log(rt_log_deadline_miss,
+						static_cast<int>(&w - workers_.get()),i,float(t - deadline));
+				}
+			}
+			bump(w.blocks);
+		}
+		store_max(w.worst_ns,t-t0);
+		if (pending_.fetch_sub(1,std::memory_order_acq_rel) == 1) {
+			done_.store(g,std::memory_order_release);
+			futex_wake(done_);
+		}
+	}
+}
+
+bool rt_executor::start()
+{
+	assert(!running_);
+	quit_ = 0;
+	for (int i=0; i<nworkers_; ++i) {
+		worker & w = workers_[i];
+		// after a stop() gen_ is not 0 and is not a cycle to run
+		w.seen = gen_.load(std::memory_order_relaxed);
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(w.cpu,&set);
+		pthread_attr_setaffinity_np(&attr,sizeof(set),&set);
+		sched_param param;
+		param.sched_priority = priority_;
+		pthread_attr_setinheritsched(&attr,PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr,SCHED_FIFO);
+		pthread_attr_setschedparam(&attr,&param);
+		w.realtime = pthread_create(&w.thread,&attr,thread_main,&w) == 0;
+		bool created = w.realtime;
+		if (!created) {
+			// not permitted (no CAP_SYS_NICE / rtprio limit): keep the
+			// pinning and fall back to the default policy
+			pthread_attr_setinheritsched(&attr,PTHREAD_INHERIT_SCHED);
+			created = pthread_create(&w.thread,&attr,thread_main,&w) == 0
+				// the core does not exist, run unpinned
+				|| pthread_create(&w.thread,0,thread_main,&w) == 0;
+		}
+		pthread_attr_destroy(&attr);
+		if (!created) {
+			join(i);
+			return false;
+		}
+	}
+	running_ = true;
+	return true;
+}
+
+void rt_executor::stop()
+{
+	if (!running_) return;
+	wait_cycle();
+	join(nworkers_);
+	running_ = false;
+}
+
+void rt_executor::join(int n)
+{
+	quit_.store(1,std::memory_order_relaxed);
+	gen_.fetch_add(1,std::memory_order_release);
+	futex_wake(gen_);
+	for (int i=0; i<n; ++i) {
+		pthread_join(workers_[i].thread,0);
+	}
+	// the quit generation is not a real cycle
+	done_.store(gen_.load(std::memory_order_relaxed),std::memory_order_relaxed);
+}
+
+bool rt_executor::realtime() const
+{
+	for (int i=0; i<nworkers_; ++i) {
+		if (!workers_[i].realtime) return false;
+	}
+	return true;
+}
+
+bool rt_executor::begin_cycle(long long budget_ns)
+{
+	assert(running_);
+	// without workers the cycle would never be done
+	if (!running_) return false;
+	if (!cycle_done()) {
+		++skipped_;
+		return false;
+	}
+	deadline_ns_.store(now_ns()+budget_ns,std::memory_order_relaxed);
+	pending_.store(nworkers_,std::memory_order_relaxed);
+	gen_.fetch_add(1,std::memory_order_release);
+	futex_wake(gen_);
+	++cycles_;
+	return true;
+}
+
+void rt_executor::wait_cycle()
+{
+	for (;;) {
+		int const d = done_.load(std::memory_order_acquire);
+		if (d == gen_.load(std::memory_order_relaxed)) break;
+		futex_wait(done_,d);
+	}
+}
+
+rt_executor::counters rt_executor::get_counters() const
+{
+	counters c;
+	c.cycles = cycles_;
+	c.skipped = skipped_;
+	c.blocks = 0;
+	c.deadline_misses = 0;
+	c.worst_cycle_ns = 0;
+	for (int i=0; i<nworkers_; ++i) {
+		worker const& w = workers_[i];
+		c.blocks += w.blocks.load(std::memory_order_relaxed);
+		c.deadline_misses += w.misses.load(std::memory_order_relaxed);
+		long long const ns = w.worst_ns.load(std::memory_order_relaxed);
+		if (c.worst_cycle_ns < ns) c.worst_cycle_ns = ns;
+	}
+	return c;
+}
+
+unsigned long rt_executor::stream_misses(int stream) const
+{
+	assert(0<=stream && stream<nstreams_);
+	return streams_[stream].misses.load(std::memory_order_relaxed);
+}
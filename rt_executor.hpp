@@ -0,0 +1,178 @@
+#ifndef RT_EXECUTOR_HPP_INCLUDED
+#define RT_EXECUTOR_HPP_INCLUDED
+
+#include <atomic>
+#include <memory>
+#include <pthread.h>
+#include "rt_log.hpp"
+#include "shaper.hpp"
+#include "trace.hpp"
+
+/**
+ * Real-time executor for shaper blocks.
+ *
+ * Every worker is a thread pinned to one core and (if permitted) scheduled
+ * with SCHED_FIFO. Streams are assigned to workers once, before start(),
+ * by a greedy least-loaded rule on their weights (e.g. filter order), so a
+ * stream always runs on the same core and keeps its t_[] state in that
+ * core's cache.
+ *
+ * A cycle is driven from the audio callback:
+ *
+ *    if (ex.cycle_done()) {
+ *       // consume output of the previous cycle, provide new input
+ *       ex.begin_cycle(budget_ns);
+ *    }
+ *
+ * begin_cycle() bumps a generation counter and wakes the workers with a
+ * futex; the worker that finishes last publishes the generation as done.
+ * There is no barrier and no mutex, so the callback never waits. If a
+ * cycle is still running, begin_cycle() refuses and counts the cycle as
+ * skipped instead of blocking.
+ *
+ * Each block is checked against the deadline of its cycle (cycle start
+ * plus budget). Misses are counted per stream and per worker, and with
+ * set_log() reported as rt_log_deadline_miss records from the worker.
+ */
+class rt_executor
+{
+public:
+	typedef void (*block_fn)(void* ctx);
+
+	struct counters
+	{
+		unsigned long cycles;          // cycles started
+		unsigned long skipped;         // begin_cycle() refused (overrun)
+		unsigned long blocks;          // blocks processed
+		unsigned long deadline_misses; // blocks finished after deadline
+		long long worst_cycle_ns;      // longest worker time in a cycle
+	};
+
+private:
+	struct stream
+	{
+		block_fn fn;
+		void* ctx;
+		int next;                      // next stream of the same worker
+		trace_stage stage;             // what fn() does, for tracing
+		std::atomic<unsigned long> misses;
+	};
+
+	struct worker
+	{
+		rt_executor* owner;
+		pthread_t thread;
+		int cpu;
+		int first;                     // first stream (linked list)
+		int seen;                      // generation at start()
+		float load;
+		bool realtime;
+		rt_log_ring* log;
+		std::atomic<unsigned long> blocks;
+		std::atomic<unsigned long> misses;
+		std::atomic<long long> worst_ns;
+	};
+
+	int nworkers_;
+	int max_streams_;
+	int nstreams_;
+	int priority_;
+	bool running_;
+	std::unique_ptr<worker[]> workers_;
+	std::unique_ptr<stream[]> streams_;
+
+	// cycle control, the futex words are gen_ and done_
+	std::atomic<int> gen_;
+	std::atomic<int> done_;
+	std::atomic<int> pending_;
+	std::atomic<int> quit_;
+	std::atomic<long long> deadline_ns_;
+	unsigned long cycles_;
+	unsigned long skipped_;
+
+	static void* thread_main(void* arg);
+	void run(worker & w);
+	void join(int n);
+
+	rt_executor(rt_executor const&);
+	rt_executor& operator=(rt_executor const&);
+
+public:
+	/**
+	 * Creates an executor with nworkers threads. cpus[i] is the core of
+	 * worker i (null: worker i goes to core i). priority is the SCHED_FIFO
+	 * priority used by start().
+	 */
+	rt_executor(int nworkers, int max_streams,
+		int const* cpus = 0, int priority = 80);
+	~rt_executor();
+
+	/**
+	 * assigns a stream to a worker; only valid before start(). With
+	 * WAPLNS_TRACE every call of fn is recorded as stage.
+	 */
+	int add_stream(block_fn fn, void* ctx, float weight = 1.0f,
+		trace_stage stage = trace_shape);
+	int worker_of(int stream) const;
+	/** gives worker w a ring for diagnostics; only valid before start() */
+	void set_log(int w, rt_log_ring* ring);
+
+	/**
+	 * Starts the workers; false (and no worker running) if a thread could
+	 * not be created even unpinned. start() after stop() is fine.
+	 */
+	bool start();
+	void stop();
+	/** true if all workers got SCHED_FIFO (false if not permitted) */
+	bool realtime() const;
+
+	/**
+	 * starts a cycle; never blocks, returns false on overrun. Only valid
+	 * between start() and stop().
+	 */
+	bool begin_cycle(long long budget_ns);
+	bool cycle_done() const
+	{ return done_.load(std::memory_order_acquire)
+		== gen_.load(std::memory_order_relaxed); }
+	/** blocks until the current cycle is done (not for the callback) */
+	void wait_cycle();
+
+	counters get_counters() const;
+	unsigned long stream_misses(int stream) const;
+};
+
+/**
+ * A ready-made stream for rt_executor: shapes one block of in[] into
+ * out[] whenever the executor runs it. A NaN state reset is reported to
+ * log (null: not reported) as rt_log_nan_state of stream, and a block in
+ * which more than a share storm of the samples had their error clamped as
+ * rt_log_clamp_storm (storm < 0: not reported); log must be the ring of
+ * the worker the job runs on (see worker_of()).
+ */
+struct shape_job
+{
+	waplns* ns;
+	pcm16_quantizer quant;
+	float const* in;
+	short* out;
+	int count;
+	rt_log_ring* log;
+	int source;
+	int stream;
+	float storm;
+
+	static void run(void* ctx)
+	{
+		shape_job & j = *static_cast<shape_job*>(ctx);
+		int clamped;
+		bool const ok = shape_block(*j.ns, j.quant, unity_gain(), j.in, j.out,
+			j.count, clamped);
+		if (!j.log) return;
+		if (!ok) j.log->log(rt_log_nan_state, j.source, j.stream);
+		if (j.storm >= 0 && clamped > j.storm * j.count) {
+			j.log->log(rt_log_clamp_storm, j.source, j.stream, clamped, j.count);
+		}
+	}
+};
+
+#endif // RT_EXECUTOR_HPP_INCLUDED
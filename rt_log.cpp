@@ -0,0 +1,140 @@
+
+/*
+ * The ring is the classic single-producer single-consumer queue: head_
+ * counts records written, tail_ records consumed, both only grow. The
+ * producer owns head_ and reads tail_ (acquire) to see free slots; the
+ * consumer owns tail_ and reads head_ (acquire) to see filled slots. Each
+ * side stores its counter with release after touching the slots, so a
+ * slot is never read while written. The two counters sit on their own
+ * cache lines so the sides do not bounce one line on every record.
+ */
+
+#include <cassert>
+#include <chrono>
+#include <ctime>
+#include "rt_log.hpp"
+
+namespace { // anonymous
+
+inline uint64_t now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return uint64_t(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+}
+
+char const* const event_names[] = {
+	"deadline miss", "NaN state reset", "clamp storm", "event"
+};
+
+} // anonymous namespace
+
+rt_log_ring::rt_log_ring(int log2_size)
+: slots_(new rt_log_record[std::size_t(1) << log2_size]),
+  mask_((uint64_t(1) << log2_size) - 1), head_(0), dropped_(0), tail_(0)
+{
+}
+
+bool rt_log_ring::log(rt_log_event ev, int source, int stream, float a, float b)
+{
+	uint64_t const h = head_.load(std::memory_order_relaxed);
+	if (h - tail_.load(std::memory_order_acquire) > mask_) {
+		// single writer, so load/store is enough
+		dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+			std::memory_order_relaxed);
+		return false;
+	}
+	rt_log_record & r = slots_[h & mask_];
+	r.time_ns = now_ns();
+	r.event = ev;
+	r.source = source;
+	r.stream = stream;
+	r.a = a;
+	r.b = b;
+	head_.store(h + 1,std::memory_order_release);
+	return true;
+}
+
+int rt_log_ring::drain(rt_log_record* out, int max)
+{
+	uint64_t const t = tail_.load(std::memory_order_relaxed);
+	uint64_t const h = head_.load(std::memory_order_acquire);
+	int n = 0;
+	for (uint64_t i=t; i!=h && n<max; ++i) out[n++] = slots_[i & mask_];
+	tail_.store(t + n,std::memory_order_release);
+	return n;
+}
+
+rt_log_drain::rt_log_drain(std::FILE* out, int period_ms)
+: out_(out), period_ms_(period_ms), nrings_(0), quit_(false)
+{
+}
+
+rt_log_drain::~rt_log_drain()
+{
+	stop();
+}
+
+bool rt_log_drain::add(rt_log_ring* ring, char const* name)
+{
+	assert(!thread_.joinable());
+	if (nrings_ == max_rings) return false;
+	entry & e = rings_[nrings_++];
+	e.ring = ring;
+	e.name = name;
+	e.reported_drops = 0;
+	return true;
+}
+
+void rt_log_drain::start()
+{
+	assert(!thread_.joinable());
+	quit_ = false;
+	thread_ = std::thread(&rt_log_drain::run,this);
+}
+
+void rt_log_drain::stop()
+{
+	if (!thread_.joinable()) return;
+	quit_ = true;
+	thread_.join();
+}
+
+void rt_log_drain::run()
+{
+	while (!quit_.load(std::memory_order_relaxed)) {
+		poll();
+		std::this_thread::sleep_for(std::chrono::milliseconds(period_ms_));
+	}
+	poll();
+}
+
+int rt_log_drain::poll()
+{
+	int total = 0;
+	rt_log_record buf[64];
+	for (int i=0; i<nrings_; ++i) {
+		entry & e = rings_[i];
+		int n;
+		while ((n = e.ring->drain(buf,64)) > 0) {
+			for (int j=0; j<n; ++j) {
+				rt_log_record const& r = buf[j];
+				// log() takes any int cast to rt_log_event
+				int const ev = r.event >= 0 && r.event <= rt_log_user
+					? r.event : rt_log_user;
+				std::fprintf(out_,"%.6f %s[%d]: %s, stream %d (%g, %g)\n",
+					r.time_ns * 1e-9,e.name,r.source,event_names[ev],r.stream,
+					r.a,r.b);
+			}
+			total += n;
+		}
+		uint64_t const d = e.ring->dropped();
+		if (d != e.reported_drops) {
+			std::fprintf(out_,"%s: %llu records dropped\n",e.name,
+				static_cast<unsigned long long>(d - e.reported_drops));
+			e.reported_drops = d;
+		}
+	}
+	if (total) std::fflush(out_);
+	return total;
+}
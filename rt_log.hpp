@@ -0,0 +1,107 @@
+#ifndef RT_LOG_HPP_INCLUDED
+#define RT_LOG_HPP_INCLUDED
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+
+/**
+ * Diagnostics from real-time threads without ever blocking them.
+ *
+ * A thread that must not block logs into its own rt_log_ring: a fixed
+ * array of binary records with one producer and one consumer. log() is
+ * wait-free and costs a clock read, a record store and a release store
+ * of the head; when the ring is full the record is counted as dropped
+ * instead. Formatting, stdio and everything else that may block happen in
+ * an rt_log_drain thread that empties the rings periodically.
+ *
+ * Rings are created (allocated) before the real-time work starts and
+ * must outlive the drain they are added to.
+ */
+
+enum rt_log_event
+{
+	rt_log_deadline_miss,  // a: ns past the deadline
+	rt_log_nan_state,      // shaper state was NaN/inf and got reset
+	rt_log_clamp_storm,    // a: samples with clamped error, b: block length
+	rt_log_user            // application defined, a and b free
+};
+
+struct rt_log_record
+{
+	uint64_t time_ns;      // CLOCK_MONOTONIC
+	int32_t event;
+	int32_t source;        // worker, bank, ... as chosen by the producer
+	int32_t stream;        // stream id or -1
+	float a, b;
+};
+
+class rt_log_ring
+{
+	std::unique_ptr<rt_log_record[]> slots_;
+	uint64_t mask_;
+	alignas(64) std::atomic<uint64_t> head_;    // written by the producer
+	std::atomic<uint64_t> dropped_;
+	alignas(64) std::atomic<uint64_t> tail_;    // written by the consumer
+
+	rt_log_ring(rt_log_ring const&);
+	rt_log_ring& operator=(rt_log_ring const&);
+
+public:
+	/** room for 2^log2_size records */
+	explicit rt_log_ring(int log2_size = 10);
+
+	/** producer side, wait-free; false if the record was dropped */
+	bool log(rt_log_event ev, int source, int stream,
+		float a = 0, float b = 0);
+
+	/** consumer side: moves up to max records to out, returns the count */
+	int drain(rt_log_record* out, int max);
+
+	uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+};
+
+/**
+ * Background thread that drains a set of rings every period_ms and writes
+ * the records as text lines to out, plus a line whenever a ring's drop
+ * count grew. stop() (or the destructor) drains one last time.
+ */
+class rt_log_drain
+{
+	static const int max_rings = 64;
+
+	struct entry
+	{
+		rt_log_ring* ring;
+		char const* name;
+		uint64_t reported_drops;
+	};
+
+	std::FILE* out_;
+	int period_ms_;
+	int nrings_;
+	entry rings_[max_rings];
+	std::atomic<bool> quit_;
+	std::thread thread_;
+
+	rt_log_drain(rt_log_drain const&);
+	rt_log_drain& operator=(rt_log_drain const&);
+
+	void run();
+
+public:
+	explicit rt_log_drain(std::FILE* out, int period_ms = 50);
+	~rt_log_drain();
+
+	/** only before start(); name is kept as a pointer */
+	bool add(rt_log_ring* ring, char const* name);
+
+	void start();
+	void stop();
+	/** drains all rings now; for the drain thread, or when not started */
+	int poll();
+};
+
+#endif // RT_LOG_HPP_INCLUDED
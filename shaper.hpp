@@ -0,0 +1,141 @@
+#ifndef SHAPER_HPP_INCLUDED
+#define SHAPER_HPP_INCLUDED
+
+#include "tools.hpp"
+#include "waplns.hpp"
+
+/**
+ * Quantizer policy for 16 bit PCM output. The signal is expected to be
+ * scaled to the integer grid already (1.0 = 1 LSB). quantize() turns
+ * w (plus optional TPDF dither) into a clipped integer code and reports
+ * the value the code stands for, so the caller can compute the error
+ * that goes back into the shaper.
+ */
+struct pcm16_quantizer
+{
+	typedef short code_type;
+
+	float thresh;    // restrict magnitude of x to prevent overload
+	float dither;    // TPDF dither amplitude in LSB (0 = no dither)
+	unsigned seed;   // state of the dither noise generator
+
+	pcm16_quantizer() : thresh(1.0f), dither(0), seed(1) {}
+
+	float tpdf()
+	{
+		// two draws of a 32 bit LCG, the top 24 bits of each: the low bits
+		// of an LCG have short periods and follow the high ones
+		seed = seed * 1664525u + 1013904223u;
+		float const r1 = static_cast<float>(seed >> 8) * (1.0f/16777216);
+		seed = seed * 1664525u + 1013904223u;
+		float const r2 = static_cast<float>(seed >> 8) * (1.0f/16777216);
+		return (r1 - r2) * dither;
+	}
+
+	code_type quantize(float w, float & qlin)
+	{
+		float v = dither != 0 ? w + tpdf() : w;
+		// negated compares so a NaN clamps too instead of reaching the cast
+		if (!(v >= -32768.0f)) v = -32768.0f;
+		else if (!(v <= 32767.0f)) v = 32767.0f;
+		long const r = round_to_long(v);
+		qlin = static_cast<float>(r);
+		return static_cast<code_type>(r);
+	}
+
+	float clamp_error(float x) const
+	{
+		if (x<-thresh) x=-thresh; else if (thresh<x) x=thresh;
+		return x;
+	}
+};
+
+/**
+ * Gain policies for shape_block(). gain(i) is the factor for sample i of
+ * the block; it is applied to s[i] right before w = s - u, so trim gains
+ * and fades cost no extra pass over the float signal.
+ *
+ *    unity_gain : no gain
+ *    gain_ramp  : linear ramp from g0 (first sample) towards g1
+ *                 (first sample of the next block); a fade curve is applied
+ *                 by evaluating it at the block boundaries
+ *    gain_curve : one factor per sample from a table (e.g. an equal-power
+ *                 fade shape computed once)
+ */
+struct unity_gain
+{
+	float operator()(int) const { return 1.0f; }
+};
+
+struct gain_ramp
+{
+	float from;
+	float step;
+
+	gain_ramp(float g) : from(g), step(0) {}
+	gain_ramp(float g0, float g1, int count)
+	: from(g0), step(count>0 ? (g1-g0)/count : 0) {}
+
+	float operator()(int i) const { return from + step * i; }
+};
+
+struct gain_curve
+{
+	float const* curve;
+	float scale;
+
+	explicit gain_curve(float const* c, float s = 1.0f)
+	: curve(c), scale(s) {}
+
+	float operator()(int i) const { return curve[i] * scale; }
+};
+
+/**
+ * Block shaping entry point: requantizes count samples of s[] into q[]
+ * with the noise shaper ns. This is the clipping-aware loop from the
+ * documentation of waplns, with the quantizer and an optional gain as
+ * policies. s[] is read once and q[] is written once.
+ *
+ * A NaN or inf that got into the state (from the signal) is cleared at
+ * the end of the block by waplns::check_state(), so the shaper does not
+ * stay dead; the return value is false then.
+ *
+ * The overload with clamped also counts the samples whose fed back error
+ * clamp_error() had to clamp. A few are normal near full scale; most of a
+ * block (a clamp storm) means the signal overloads the quantizer and the
+ * shaping is effectively off.
+ */
+template<class Quant, class Gain>
+bool shape_block(waplns & ns, Quant & quant, Gain const& gain,
+	float const* s, typename Quant::code_type* q, int count, int & clamped)
+{
+	int n_clamped = 0;
+	for (int i=0; i<count; ++i) {
+		float const w = gain(i) * s[i] - ns.u();
+		float qlin;
+		q[i] = quant.quantize(w,qlin);
+		float const e = qlin - w;
+		float const x = quant.clamp_error(e);
+		n_clamped += x != e;
+		ns.x_was(x);
+	}
+	clamped = n_clamped;
+	return ns.check_state();
+}
+
+template<class Quant, class Gain>
+inline bool shape_block(waplns & ns, Quant & quant, Gain const& gain,
+	float const* s, typename Quant::code_type* q, int count)
+{
+	int clamped; // the count is dead code here and optimized out
+	return shape_block(ns,quant,gain,s,q,count,clamped);
+}
+
+template<class Quant>
+inline bool shape_block(waplns & ns, Quant & quant,
+	float const* s, typename Quant::code_type* q, int count)
+{
+	return shape_block(ns,quant,unity_gain(),s,q,count);
+}
+
+#endif // SHAPER_HPP_INCLUDED
@@ -0,0 +1,46 @@
+
+/*
+ * The head up to the first 32 byte boundary of dst and the tail of less
+ * than a vector are copied normally; everything in between goes through
+ * streaming stores, with AVX2 32 bytes at a time, with SSE2 16. Loads are
+ * unaligned, src is normally a small hot tile anyway.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include "streaming.hpp"
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+void stream_copy(void* dst, void const* src, std::size_t bytes)
+{
+	unsigned char* d = static_cast<unsigned char*>(dst);
+	unsigned char const* s = static_cast<unsigned char const*>(src);
+#if defined(__SSE2__) || defined(__AVX2__)
+	std::size_t const head = std::min(bytes,
+		(32 - reinterpret_cast<std::uintptr_t>(d) % 32) % 32);
+	std::memcpy(d,s,head);
+	d += head;
+	s += head;
+	bytes -= head;
+#ifdef __AVX2__
+	for (; bytes>=32; bytes-=32, d+=32, s+=32) {
+		__m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(s));
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(d),v);
+	}
+#endif
+	for (; bytes>=16; bytes-=16, d+=16, s+=16) {
+		__m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s));
+		_mm_stream_si128(reinterpret_cast<__m128i*>(d),v);
+	}
+#endif
+	std::memcpy(d,s,bytes);
+}
+
+void stream_fence()
+{
+#if defined(__SSE2__) || defined(__AVX2__)
+	_mm_sfence();
+#endif
+}
@@ -0,0 +1,56 @@
+#ifndef STREAMING_HPP_INCLUDED
+#define STREAMING_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include "shaper.hpp"
+
+/**
+ * Output that is written once and not read again soon (renders far larger
+ * than the caches) should not displace the input, the shaper state and
+ * the code. stream_copy() writes with non-temporal stores, which go to
+ * memory through write-combining buffers without allocating cache lines;
+ * without SSE2 it is a plain memcpy. Streamed data is only ordered with
+ * later stores after stream_fence(); the functions below fence before they
+ * return.
+ */
+void stream_copy(void* dst, void const* src, std::size_t bytes);
+void stream_fence();
+
+/** codes per tile of shape_block_streaming(), small enough for L1 */
+const int stream_tile = 4096;
+
+/** gain policy adapter for shaping a tile that starts at sample off */
+template<class Gain>
+struct offset_gain
+{
+	Gain const& gain;
+	int off;
+
+	offset_gain(Gain const& g, int o) : gain(g), off(o) {}
+	float operator()(int i) const { return gain(off + i); }
+};
+
+/**
+ * shape_block() with streaming output: codes are produced into a tile on
+ * the stack and streamed to q[]. Same results as shape_block(). q should
+ * be 32 byte aligned, a misaligned head is stored normally. Returns false
+ * if the state was reset as by shape_block().
+ */
+template<class Quant, class Gain>
+bool shape_block_streaming(waplns & ns, Quant & quant, Gain const& gain,
+	float const* s, typename Quant::code_type* q, int count)
+{
+	typedef typename Quant::code_type code_type;
+	alignas(64) code_type tile[stream_tile];
+	bool ok = true;
+	for (int i0=0; i0<count; i0+=stream_tile) {
+		int const n = std::min(count-i0,stream_tile);
+		ok = shape_block(ns,quant,offset_gain<Gain>(gain,i0),s+i0,tile,n) && ok;
+		stream_copy(q+i0,tile,n*sizeof(code_type));
+	}
+	stream_fence();
+	return ok;
+}
+
+#endif // STREAMING_HPP_INCLUDED
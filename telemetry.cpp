@@ -0,0 +1,231 @@
+
+/*
+ * shape_batch(): series are sorted by descending length and taken
+ * bank_lanes at a time. Each group loads the per-lane parameters of its
+ * presets into the lane-interleaved layout of waplns_bank (lanes of lower
+ * order get k=0 stages) and runs lattice_lanes<true>() with the lanes
+ * that are done masked off. Quantization is done with lane vectors as
+ * well, so per sample there is one gather of the inputs and one scatter
+ * of the codes and everything else is vector code.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include "lane_kernels.hpp"
+#include "shaper.hpp"
+#include "telemetry.hpp"
+#include "wlpc.hpp"
+
+namespace { // anonymous
+
+const double pi = 3.14159265358979323846;
+
+// descending length, ties by index (stable without a temporary buffer)
+struct longer
+{
+	int const* len;
+	bool operator()(int a, int b) const
+	{
+		return len[a] > len[b] || (len[a] == len[b] && a < b);
+	}
+};
+
+} // anonymous namespace
+
+telemetry_shaper::telemetry_shaper(int max_batch)
+: own_(0)
+{
+	workspace_spec const spec(max_wapl_filt_order,0,max_batch);
+	own_ = new workspace_buffer(workspace_bytes(spec));
+	workspace_arena ws(own_->data(),own_->size());
+	layout(ws,max_batch,this);
+}
+
+telemetry_shaper::telemetry_shaper(workspace_spec const& spec,
+	void* mem, std::size_t bytes)
+: own_(0)
+{
+	workspace_arena ws(mem,bytes);
+	layout(ws,spec.channels,this);
+}
+
+telemetry_shaper::~telemetry_shaper()
+{
+	delete own_;
+}
+
+std::size_t telemetry_shaper::workspace_bytes(workspace_spec const& spec)
+{
+	workspace_arena ws;
+	layout(ws,spec.channels,0);
+	return ws.used();
+}
+
+void telemetry_shaper::layout(workspace_arena & ws, std::size_t n,
+	telemetry_shaper* t)
+{
+	ws.take(t ? &t->sorted_ : 0,n);
+}
+
+int telemetry_shaper::add_preset(telemetry_format const& fmt,
+	float lam, int ord, float const* k)
+{
+	assert(fmt.bits==8 || fmt.bits==12 || fmt.bits==16);
+	assert(fmt.step > 0);
+	preset p;
+	p.proto.set_params(lam,ord,k);
+	p.proto.reset_state();
+	p.fmt = fmt;
+	p.thresh = 1.0f;
+	presets_.push_back(p);
+	return presets() - 1;
+}
+
+int telemetry_shaper::add_band_preset(telemetry_format const& fmt, double fs,
+	double f_lo, double f_hi, int ord, double depth_db)
+{
+	float lam;
+	float k[max_wapl_filt_order];
+	ord = std::min(ord,max_wapl_filt_order);
+	design_band_shaper(2*pi*f_lo/fs,2*pi*f_hi/fs,std::pow(10.0,-depth_db/10),
+		ord,lam,k);
+	return add_preset(fmt,lam,ord,k);
+}
+
+void telemetry_shaper::shape(int p, float const* in, int n, int* codes) const
+{
+	preset const& pr = presets_[p];
+	waplns ns = pr.proto;
+	telemetry_quantizer quant(pr.fmt);
+	quant.thresh = pr.thresh;
+	shape_block(ns,quant,gain_ramp(1.0f/pr.fmt.step),in,codes,n);
+}
+
+void telemetry_shaper::shape_batch(int count, int const* p,
+	float const* const* in, int const* len, int* const* codes)
+{
+	sorted_.resize(count);
+	for (int i=0; i<count; ++i) sorted_[i] = i;
+	longer cmp = { len };
+	std::sort(sorted_.begin(),sorted_.end(),cmp);
+	for (int g0=0; g0<count; g0+=bank_lanes) {
+		int const nl = std::min(count-g0,bank_lanes);
+		alignas(32) float lam[bank_lanes], s2[bank_lanes], u[bank_lanes];
+		alignas(32) float scale[bank_lanes], bias[bank_lanes];
+		alignas(32) float lo[bank_lanes], hi[bank_lanes], th[bank_lanes];
+		alignas(32) float k[max_wapl_filt_order][bank_lanes];
+		alignas(32) float t[max_wapl_filt_order][bank_lanes];
+		float const* ip[bank_lanes];
+		int* op[bank_lanes];
+		int n_of[bank_lanes];
+		int order = 0;
+		for (int l=0; l<bank_lanes; ++l) {
+			// unused lanes copy lane 0 and stay masked
+			int const s = sorted_[g0 + (l<nl ? l : 0)];
+			preset const& pr = presets_[p[s]];
+			telemetry_quantizer const q(pr.fmt);
+			lam[l] = pr.proto.lambda();
+			s2[l] = 1.0f / pr.proto.warp_gain();
+			u[l] = 0;
+			scale[l] = 1.0f / pr.fmt.step;
+			bias[l] = q.bias;
+			lo[l] = q.lo;
+			hi[l] = q.hi;
+			th[l] = pr.thresh;
+			ip[l] = in[s];
+			op[l] = codes[s];
+			n_of[l] = l<nl ? len[s] : 0;
+			order = std::max(order,pr.proto.order());
+		}
+		for (int i=0; i<order; ++i) {
+			for (int l=0; l<bank_lanes; ++l) {
+				waplns const& ns = presets_[p[sorted_[g0 + (l<nl ? l : 0)]]].proto;
+				k[i][l] = i<ns.order() ? ns.k(i) : 0.0f;
+				t[i][l] = 0;
+			}
+		}
+		lane_vec const magic = lane_vec{} + 12582912.0f;
+		int const longest = n_of[0];
+		for (int n=0; n<longest; ++n) {
+			alignas(32) int mask[bank_lanes];
+			alignas(32) float s[bank_lanes];
+			for (int l=0; l<bank_lanes; ++l) {
+				mask[l] = n < n_of[l] ? -1 : 0;
+				s[l] = mask[l] ? ip[l][n] : 0.0f;
+			}
+			lane_vec const w = lanes(s) * lanes(scale) - lanes(u);
+			lane_vec v = w - lanes(bias);
+			// compares a NaN fails, so it clamps to lo before the int cast
+			v = v >= lanes(lo) ? v : lanes(lo);
+			v = v <= lanes(hi) ? v : lanes(hi);
+			lane_vec const r = (v + magic) - magic;
+			lane_vec e = r + lanes(bias) - w;
+			e = e < -lanes(th) ? -lanes(th) : e;
+			e = e > lanes(th) ? lanes(th) : e;
+			alignas(32) float x[bank_lanes];
+			lanes(x) = e;
+			for (int l=0; l<nl; ++l) {
+				if (mask[l]) op[l][n] = static_cast<int>(r[l]);
+			}
+			lattice_lanes<true>(order,lam,s2,u,k,t,x,mask);
+		}
+	}
+}
+
+std::size_t packed_bytes(int n, int bits)
+{
+	assert(bits==8 || bits==12 || bits==16);
+	std::size_t const un = static_cast<std::size_t>(n);
+	return bits==8 ? un : bits==16 ? 2*un : (3*un + 1) / 2;
+}
+
+void pack_codes(int const* codes, int n, int bits, unsigned char* out)
+{
+	if (bits == 8) {
+		for (int i=0; i<n; ++i) out[i] = static_cast<unsigned char>(codes[i]);
+	} else if (bits == 16) {
+		for (int i=0; i<n; ++i) {
+			out[2*i] = static_cast<unsigned char>(codes[i]);
+			out[2*i+1] = static_cast<unsigned char>(codes[i] >> 8);
+		}
+	} else {
+		int i = 0;
+		for (; i+1<n; i+=2, out+=3) {
+			unsigned const a = codes[i] & 0xfff;
+			unsigned const b = codes[i+1] & 0xfff;
+			out[0] = static_cast<unsigned char>(a);
+			out[1] = static_cast<unsigned char>((a >> 8) | (b << 4));
+			out[2] = static_cast<unsigned char>(b >> 4);
+		}
+		if (i < n) {
+			unsigned const a = codes[i] & 0xfff;
+			out[0] = static_cast<unsigned char>(a);
+			out[1] = static_cast<unsigned char>(a >> 8);
+		}
+	}
+}
+
+void unpack_codes(unsigned char const* in, int n, int bits, int* codes)
+{
+	if (bits == 8) {
+		for (int i=0; i<n; ++i) codes[i] = static_cast<signed char>(in[i]);
+	} else if (bits == 16) {
+		for (int i=0; i<n; ++i) {
+			codes[i] = static_cast<short>(in[2*i] | (in[2*i+1] << 8));
+		}
+	} else {
+		// sign extend 12 bit values through the top of an int
+		int i = 0;
+		for (; i+1<n; i+=2, in+=3) {
+			int const a = in[0] | ((in[1] & 0x0f) << 8);
+			int const b = (in[1] >> 4) | (in[2] << 4);
+			codes[i] = (a ^ 0x800) - 0x800;
+			codes[i+1] = (b ^ 0x800) - 0x800;
+		}
+		if (i < n) {
+			int const a = in[0] | ((in[1] & 0x0f) << 8);
+			codes[i] = (a ^ 0x800) - 0x800;
+		}
+	}
+}
@@ -0,0 +1,131 @@
+#ifndef TELEMETRY_HPP_INCLUDED
+#define TELEMETRY_HPP_INCLUDED
+
+#include <cstddef>
+#include <vector>
+#include "tools.hpp"
+#include "waplns.hpp"
+#include "workspace.hpp"
+
+/**
+ * Shaped requantization of non-audio sample streams (vibration,
+ * acceleration, ...). A stream is described by its code format: code c
+ * stands for the value offset + c * step, and codes are signed integers
+ * of 8, 12 or 16 bits. The noise shaper moves the quantization error out
+ * of a band of interest, see design_band_shaper() in wlpc.hpp.
+ */
+struct telemetry_format
+{
+	float step;
+	float offset;
+	int bits;      // 8, 12 or 16
+};
+
+/**
+ * Quantizer policy for shape_block() in grid units: the caller scales the
+ * signal by 1/step (e.g. with gain_ramp), bias is offset/step.
+ */
+struct telemetry_quantizer
+{
+	typedef int code_type;
+
+	float bias;
+	float lo, hi;    // code range
+	float thresh;    // restrict magnitude of the fed back error
+
+	telemetry_quantizer(telemetry_format const& fmt)
+	: bias(fmt.offset / fmt.step),
+	  lo(-static_cast<float>(1 << (fmt.bits-1))),
+	  hi(static_cast<float>((1 << (fmt.bits-1)) - 1)),
+	  thresh(1.0f) {}
+
+	code_type quantize(float w, float & qlin)
+	{
+		float v = w - bias;
+		// negated compares so a NaN clamps too instead of reaching the cast
+		if (!(v >= lo)) v = lo; else if (!(v <= hi)) v = hi;
+		long const r = round_to_long(v);
+		qlin = static_cast<float>(r) + bias;
+		return static_cast<code_type>(r);
+	}
+
+	float clamp_error(float x) const
+	{
+		if (x<-thresh) x=-thresh; else if (thresh<x) x=thresh;
+		return x;
+	}
+};
+
+/**
+ * Presets bundle a format with shaper parameters. A preset keeps a ready
+ * waplns (derived parameters computed, state zero), so shaping a series
+ * starts from a copy of it instead of set_params() and reset_state(),
+ * which dominate for short series. shape_batch() goes further and runs
+ * bank_lanes series at a time through the lane kernels of waplns_bank.
+ */
+class telemetry_shaper
+{
+	struct preset
+	{
+		waplns proto;
+		telemetry_format fmt;
+		float thresh;
+	};
+
+	std::vector<preset> presets_; // grows during setup only
+	workspace_buffer* own_;
+	ws_array<int> sorted_;        // scratch for shape_batch()
+
+	telemetry_shaper(telemetry_shaper const&);
+	telemetry_shaper& operator=(telemetry_shaper const&);
+
+	static void layout(workspace_arena & ws, std::size_t n, telemetry_shaper* t);
+
+public:
+	/** shape_batch() takes up to max_batch series per call */
+	explicit telemetry_shaper(int max_batch);
+	/** same with spec.channels as max_batch, in caller memory */
+	telemetry_shaper(workspace_spec const& spec, void* mem, std::size_t bytes);
+	~telemetry_shaper();
+
+	static std::size_t workspace_bytes(workspace_spec const& spec);
+
+	int add_preset(telemetry_format const& fmt, float lam, int ord, float const* k);
+	/**
+	 * Designs the shaper for a band of interest [f_lo, f_hi] (Hz at sample
+	 * rate fs); depth_db is the in-band noise attenuation asked of the fit
+	 * (the achieved attenuation is lower, a few dB per order 4).
+	 */
+	int add_band_preset(telemetry_format const& fmt, double fs,
+		double f_lo, double f_hi, int ord, double depth_db = 30);
+	int presets() const { return static_cast<int>(presets_.size()); }
+	waplns const& shaper(int p) const { return presets_[p].proto; }
+	telemetry_format const& format(int p) const { return presets_[p].fmt; }
+	void set_thresh(int p, float t) { presets_[p].thresh = t; }
+
+	/** shapes one series from zero state */
+	void shape(int p, float const* in, int n, int* codes) const;
+
+	/**
+	 * Shapes count (up to max_batch) independent series from zero state:
+	 * series i has len[i] samples in in[i], uses preset p[i] and gets its
+	 * codes in codes[i]. Series are grouped by length so that lanes finish
+	 * close together. The lane kernels compute in float where waplns uses
+	 * double accumulators, so a few codes in a million may differ by one
+	 * from shape().
+	 */
+	void shape_batch(int count, int const* p, float const* const* in,
+		int const* len, int* const* codes);
+};
+
+/** bytes needed for n codes of the given width */
+std::size_t packed_bytes(int n, int bits);
+/**
+ * Little endian packing. 12 bit codes go two per three bytes (the low
+ * nibble of the middle byte belongs to the first code); an odd last code
+ * takes two bytes.
+ */
+void pack_codes(int const* codes, int n, int bits, unsigned char* out);
+void unpack_codes(unsigned char const* in, int n, int bits, int* codes);
+
+#endif // TELEMETRY_HPP_INCLUDED
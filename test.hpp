@@ -0,0 +1,32 @@
+#ifndef TEST_HPP_INCLUDED
+#define TEST_HPP_INCLUDED
+
+#include <iostream>
+
+/**
+ * Tiny helpers shared by the test_*.cpp programs: check() reports and
+ * counts a failed expectation, test_result() prints "ok" or "FAILED" and
+ * gives the exit status of main().
+ */
+
+inline int & test_failures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+inline void check(bool ok, char const* what)
+{
+	if (!ok) {
+		std::cout << "FAIL: " << what << '\n';
+		++test_failures();
+	}
+}
+
+inline int test_result()
+{
+	std::cout << (test_failures() ? "FAILED" : "ok") << '\n';
+	return test_failures() != 0;
+}
+
+#endif // TEST_HPP_INCLUDED
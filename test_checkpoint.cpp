@@ -0,0 +1,156 @@
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "checkpoint.hpp"
+#include "shaper.hpp"
+#include "test.hpp"
+#include "waplns_bank.hpp"
+
+// Checkpoint round trip and failover of a waplns_bank, with the standby's
+// file mapped before the primary's last saves, and slots with a damaged
+// stream count.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_checkpoint.cpp checkpoint.cpp
+//        waplns_bank.cpp waplns.cpp workspace.cpp rt_log.cpp -o test_checkpoint -pthread
+
+namespace { // anonymous
+
+const int streams = 40;
+const int block = 64;
+char const* const path = "/tmp/test_checkpoint.bin";
+
+void setup(waplns_bank & b)
+{
+	float k[max_wapl_filt_order];
+	for (int s=0; s<streams; ++s) {
+		int const ord = 1 + s % 24;
+		for (int i=0; i<ord; ++i) k[i] = 0.3f * std::pow(-0.7f,i) * (1 + 0.01f*s);
+		b.add_stream(0.6f,ord,k);
+		b.set_param_id(s,s % 5);
+	}
+	b.repack();
+}
+
+struct signal
+{
+	std::vector<float> in;
+	std::vector<float const*> ip;
+	int n;
+
+	signal() : in(streams*block), ip(streams), n(0)
+	{
+		for (int s=0; s<streams; ++s) ip[s] = &in[s*block];
+	}
+
+	void next()
+	{
+		for (int s=0; s<streams; ++s) {
+			for (int i=0; i<block; ++i) {
+				in[s*block+i] = 2000.0f * std::sin(0.013f * (n*block+i) * (1+s%9)) + 0.37f*s;
+			}
+		}
+		++n;
+	}
+};
+
+// one block of b into codes
+void run(waplns_bank & b, signal const& x, std::vector<short> & codes)
+{
+	codes.resize(streams*block);
+	std::vector<short*> op(streams);
+	for (int s=0; s<streams; ++s) op[s] = &codes[s*block];
+	pcm16_quantizer quant;
+	quant.dither = 0;
+	b.process(quant,&x.ip[0],&op[0],block);
+}
+
+bool same_state(waplns_bank const& a, waplns_bank const& b)
+{
+	for (int s=0; s<streams; ++s) {
+		waplns::state sa, sb;
+		a.stream(s).get_state(sa);
+		b.stream(s).get_state(sb);
+		if (sa.u != sb.u) return false;
+		for (int i=0; i<a.stream(s).order(); ++i) {
+			if (sa.t[i] != sb.t[i]) return false;
+		}
+	}
+	return true;
+}
+
+} // anonymous namespace
+
+int main()
+{
+	std::remove(path);
+	waplns_bank primary(streams), standby(streams), third(streams);
+	setup(primary);
+	setup(standby);
+	setup(third);
+	signal x;
+	std::vector<short> c1, c2;
+
+	bank_checkpoint cp(path,streams);
+	check(cp.ok(),"map the checkpoint file");
+	int n = -1;
+	check(cp.read(n) == 0 && n == 0,"no snapshot before the first save");
+	for (int b=0; b<3; ++b) {
+		x.next();
+		run(primary,x,c1);
+		primary.save_state(cp);
+	}
+	check(third.load_state(cp) == streams,"round trip adopts every stream");
+	check(same_state(primary,third),"round trip restores t[] and u exactly");
+
+	// the standby maps the file now, the primary keeps saving
+	bank_checkpoint cp2(path,streams);
+	for (int b=0; b<3; ++b) {
+		x.next();
+		run(primary,x,c1);
+		primary.save_state(cp);
+	}
+	check(standby.load_state(cp2) == streams,"failover adopts every stream");
+	check(same_state(primary,standby),"failover takes the newest snapshot");
+	x.next();
+	run(primary,x,c1);
+	run(standby,x,c2);
+	check(c1 == c2,"standby continues with the primary's codes");
+
+	// the primary is gone; what the standby saves must become the newest
+	for (int b=0; b<2; ++b) {
+		x.next();
+		run(standby,x,c2);
+		standby.save_state(cp2);
+	}
+	bank_checkpoint cp3(path,streams);
+	check(third.load_state(cp3) == streams,"second failover adopts every stream");
+	check(same_state(standby,third),"standby's saves supersede the primary's");
+
+	// streams whose parameter id differs keep their own state
+	third.set_param_id(0,99);
+	third.reset_state(0);
+	check(third.load_state(cp3) == streams - 1,"mismatching id is not adopted");
+	waplns::state st;
+	third.stream(0).get_state(st);
+	check(st.u == 0,"mismatching stream keeps its state");
+
+	// a damaged stream count in the newest slots: no snapshot, rather than
+	// a copy of a negative or oversized count (or waiting for ever)
+	std::size_t const slot = (16 + sizeof(bank_checkpoint::record) * streams + 63) / 64 * 64;
+	uint32_t const damaged[] = { 0xffffffffu, streams + 1 };
+	for (int d=0; d<2; ++d) {
+		std::FILE* const f = std::fopen(path,"r+b");
+		for (int i=0; f && i<2; ++i) {
+			std::fseek(f,static_cast<long>(64 + i*slot + 8),SEEK_SET);
+			std::fwrite(&damaged[d],sizeof(damaged[d]),1,f);
+		}
+		check(f && std::fclose(f) == 0,"damage the stream counts");
+		bank_checkpoint cp4(path,streams);
+		n = -1;
+		check(cp4.read(n) == 0 && n == 0,
+			d ? "too many streams are rejected" : "a negative stream count is rejected");
+	}
+
+	std::remove(path);
+	return test_result();
+}
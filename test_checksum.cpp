@@ -0,0 +1,107 @@
+#include <cstring>
+#include <limits>
+#include <vector>
+#include "checksum.hpp"
+#include "shaper.hpp"
+#include "test.hpp"
+
+// CRC-32C and wh64: the SIMD forms against the scalar ones at every length
+// and alignment around the chunk sizes, crc32c_combine() against the CRC
+// of the concatenation, and the per-file digest of output_checksum, also
+// when resumed from an earlier part.
+// Build with -march=native (or -msse4.2 -mavx2) to cover the SIMD forms.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_checksum.cpp checksum.cpp
+//        waplns.cpp -o test_checksum
+
+int main()
+{
+	std::vector<unsigned char> buf(4096 + 64);
+	unsigned s = 12345;
+	for (std::size_t i=0; i<buf.size(); ++i) {
+		s = s * 1664525u + 1013904223u;
+		buf[i] = static_cast<unsigned char>(s >> 24);
+	}
+
+	// the check value of CRC-32C
+	char const digits[] = "123456789";
+	check(crc32c_scalar(0,digits,9) == 0xe3069283u,"crc32c_scalar check value");
+	check(crc32c(0,digits,9) == 0xe3069283u,"crc32c check value");
+
+	bool crc_same = true, hash_same = true, incremental = true;
+	for (int off=0; off<8; ++off) {
+		for (std::size_t n=0; n<300; ++n) {
+			unsigned char const* const p = &buf[off];
+			uint32_t const c = crc32c_scalar(0,p,n);
+			crc_same = crc_same && crc32c(0,p,n) == c;
+			crc_same = crc_same && crc32c(0x89abcdefu,p,n) == crc32c_scalar(0x89abcdefu,p,n);
+			hash_same = hash_same && wh64(p,n) == wh64_scalar(p,n);
+			hash_same = hash_same && wh64(p,n,n*977) == wh64_scalar(p,n,n*977);
+			// crc of a then b is the crc of b continued from crc(a)
+			std::size_t const a = n / 3;
+			incremental = incremental && crc32c(crc32c(0,p,a),p+a,n-a) == c;
+		}
+	}
+	check(crc_same,"crc32c matches crc32c_scalar");
+	check(hash_same,"wh64 matches wh64_scalar");
+	check(incremental,"crc32c continues from a previous crc");
+	check(wh64(&buf[0],4096) != wh64(&buf[0],4096,1),"wh64 depends on the seed");
+	check(wh64(&buf[0],4095) != wh64(&buf[1],4095),"wh64 depends on the data");
+
+	bool combined = true;
+	std::size_t const splits[] = { 0, 1, 7, 8, 9, 63, 64, 1000, 4095, 4096 };
+	for (unsigned i=0; i<sizeof(splits)/sizeof(*splits); ++i) {
+		std::size_t const a = splits[i];
+		uint32_t const ca = crc32c(0,&buf[0],a);
+		uint32_t const cb = crc32c(0,&buf[a],4096-a);
+		combined = combined && crc32c_combine(ca,cb,4096-a) == crc32c(0,&buf[0],4096);
+	}
+	check(combined,"crc32c_combine matches the crc of the concatenation");
+
+	// shaped blocks of uneven sizes, the file crc covers all bytes
+	std::vector<float> in(10000);
+	std::vector<short> out(in.size());
+	for (std::size_t i=0; i<in.size(); ++i) in[i] = 1000.5f * ((i * 37) % 101) / 101;
+	float const k[] = { 0.4f, -0.2f, 0.1f };
+	waplns ns;
+	ns.set_params(0.5f,3,k);
+	pcm16_quantizer quant;
+	output_checksum sums;
+	bool blocks_ok = true, state_ok = true;
+	int const sizes[] = { 1, 100, 4096, 333, 5470 };
+	int pos = 0;
+	for (int i=0; i<5; ++i) {
+		block_digest d;
+		state_ok = shape_block(ns,quant,unity_gain(),&in[pos],&out[pos],
+			sizes[i],sums,&d) && state_ok;
+		blocks_ok = blocks_ok && d.bytes == sizes[i]*sizeof(short)
+			&& d.crc == crc32c_scalar(0,&out[pos],d.bytes)
+			&& d.hash == wh64_scalar(&out[pos],d.bytes);
+		pos += sizes[i];
+	}
+	block_digest const f = sums.finish();
+	check(blocks_ok,"block digests of shape_block()");
+	check(state_ok,"shape_block() with checksums keeps a finite state");
+	check(sums.blocks() == 5 && f.bytes == out.size()*sizeof(short),"file digest size");
+	check(f.crc == crc32c_scalar(0,&out[0],f.bytes),"file crc is the crc of all bytes");
+
+	// the same blocks summed in two parts, the second resuming the first
+	output_checksum part1, part2;
+	pos = 0;
+	for (int i=0; i<5; ++i) {
+		(i < 2 ? part1 : part2).add_block(&out[pos],sizes[i]*sizeof(short));
+		if (i == 1) part2.resume(part1.so_far(),part1.blocks());
+		pos += sizes[i];
+	}
+	block_digest const r = part2.finish();
+	check(part2.blocks() == 5 && r.bytes == f.bytes && r.crc == f.crc && r.hash == f.hash,
+		"resumed digest equals the one-part digest");
+
+	// a NaN in the signal: the state is reset and shape_block() says so
+	in[10] = std::numeric_limits<float>::quiet_NaN();
+	output_checksum nan_sums;
+	check(!shape_block(ns,quant,unity_gain(),&in[0],&out[0],100,nan_sums),
+		"shape_block() with checksums reports a state reset");
+
+	return test_result();
+}
@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "g711.hpp"
+#include "shaper.hpp"
+#include "test.hpp"
+
+// G.711: the branch-free block encoder and the table encoder of
+// g711_quantizer against the reference coder over all 65536 inputs, the
+// decoders against each other, quantize_lanes() against quantize(), and
+// the spectrum of the decoded error of a shaped encode.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_g711.cpp g711.cpp waplns.cpp
+//        -o test_g711
+
+namespace { // anonymous
+
+/** mean |X(f)|^2 of r over bins lo..hi-1 of 256 point blocks */
+double band_power(std::vector<double> const& r, int lo, int hi)
+{
+	double const pi = 3.14159265358979;
+	double sum = 0;
+	int blocks = 0;
+	for (std::size_t b=0; b+256<=r.size(); b+=256, ++blocks) {
+		for (int f=lo; f<hi; ++f) {
+			double re = 0, im = 0;
+			for (int i=0; i<256; ++i) {
+				re += r[b+i] * std::cos(2*pi*f*i/256);
+				im -= r[b+i] * std::sin(2*pi*f*i/256);
+			}
+			sum += re*re + im*im;
+		}
+	}
+	return sum / (blocks * (hi - lo));
+}
+
+/**
+ * Shaped encode of a noisy signal: the error of the decoded output has
+ * the spectrum of the shaper's noise transfer, the error fed back being
+ * about white. Compares the power of the error in a low and a high band
+ * with the noise transfer function's, from its impulse response.
+ */
+void test_shaped_spectrum(g711_law law)
+{
+	float const k[] = { 0.6f, -0.3f, 0.1f };
+	int const n = 256 * 64;
+	waplns ns;
+	ns.set_params(0.5f,3,k);
+	std::vector<double> h(n), r(n);
+	for (int i=0; i<n; ++i) {
+		float const x = i == 0 ? 1.0f : 0.0f;
+		h[i] = x - ns.u();
+		ns.x_was(x);
+	}
+	double const want = band_power(h,1,26) / band_power(h,102,128);
+
+	ns.reset_state();
+	g711_quantizer shaped(law);
+	shaped.thresh = 1.5f;
+	uint32_t seed = 1;
+	int clamped = 0;
+	for (int i=0; i<n; ++i) {
+		seed = seed * 1664525u + 1013904223u;
+		float const s = 2000.0f * std::sin(0.05f * i)
+			+ static_cast<float>(static_cast<int>(seed >> 20) - 2048);
+		float const w = s - ns.u();
+		float qlin;
+		unsigned char const q = shaped.quantize(w,qlin);
+		float const e = qlin - w;
+		float const x = shaped.clamp_error(e);
+		clamped += x != e;
+		ns.x_was(x);
+		r[i] = g711_decode(law,q) - s;
+	}
+	double const got = band_power(r,1,26) / band_power(r,102,128);
+	check(clamped < n/100,"shaped encode rarely clamps");
+	check(want < 0.5 || want > 2,"the shaper's noise transfer is not flat");
+	check(got > want/1.5 && got < want*1.5,
+		"decoded error has the shaper's spectrum");
+}
+
+void test_law(g711_law law)
+{
+	g711_tables const& tab = get_g711_tables(law);
+	std::vector<short> pcm(65536);
+	for (int i=0; i<65536; ++i) pcm[i] = static_cast<short>(i - 32768);
+
+	std::vector<unsigned char> code(65536);
+	g711_encode_block(law,&pcm[0],&code[0],65536);
+	bool block_ok = true, table_ok = true;
+	g711_quantizer quant(law);
+	for (int i=0; i<65536; ++i) {
+		unsigned char const ref = g711_encode(law,pcm[i]);
+		block_ok = block_ok && code[i] == ref;
+		float qlin;
+		table_ok = table_ok && quant.quantize(pcm[i],qlin) == ref
+			&& qlin == g711_decode(law,ref);
+	}
+	check(block_ok,"g711_encode_block matches g711_encode");
+	check(table_ok,"g711_quantizer matches g711_encode and g711_decode");
+
+	// a NaN (an unstable shaper) clamps like -inf rather than reaching
+	// the float to long conversion
+	float nan_lin, lo_lin;
+	check(quant.quantize(std::numeric_limits<float>::quiet_NaN(),nan_lin)
+		== quant.quantize(-1e30f,lo_lin) && nan_lin == lo_lin,
+		"g711_quantizer clamps a NaN");
+
+	// odd lengths and offsets, for the vectorized loop's tails
+	bool tails_ok = true;
+	for (int off=0; off<5; ++off) {
+		for (int n=0; n<70; ++n) {
+			unsigned char c[70];
+			g711_encode_block(law,&pcm[1000*off + 13],c,n);
+			for (int i=0; i<n; ++i) {
+				tails_ok = tails_ok && c[i] == code[1000*off + 13 + i];
+			}
+		}
+	}
+	check(tails_ok,"g711_encode_block at odd lengths and offsets");
+
+	unsigned char all[256];
+	for (int c=0; c<256; ++c) all[c] = static_cast<unsigned char>(c);
+	short dec[256];
+	g711_decode_block(law,all,dec,256);
+	bool dec_ok = true, round_trip = true;
+	for (int c=0; c<256; ++c) {
+		dec_ok = dec_ok && dec[c] == g711_decode(law,all[c]) && tab.dec[c] == dec[c];
+		// mu-law has +0 and -0, both encode to the same code
+		unsigned char const back = g711_encode(law,dec[c]);
+		round_trip = round_trip && (back == c || g711_decode(law,back) == dec[c]);
+	}
+	check(dec_ok,"g711_decode_block matches g711_decode");
+	check(round_trip,"encoding a reconstruction level gives its code");
+
+	// quantize_lanes() against quantize() and clamp_error(), over the
+	// whole range, beyond it and with NaN, lanes that are not live left out
+	g711_quantizer shaped(law);
+	shaped.thresh = 0.75f;
+	bool lanes_ok = true;
+	for (int i=0; i<70000; i+=8) {
+		float s[8], u[8], w[8];
+		unsigned char c[8];
+		float x[8];
+		int clamped[8] = {0}, live[8];
+		for (int l=0; l<8; ++l) {
+			s[l] = 0.625f * (i + l) - 21875.0f;
+			u[l] = -s[l];
+			w[l] = s[l] - u[l];
+			live[l] = (i/8 + l) % 5 != 0;
+		}
+		if (i == 0) s[1] = w[1] = std::numeric_limits<float>::quiet_NaN();
+		shaped.quantize_lanes(s,u,c,x,clamped,live);
+		for (int l=0; l<8; ++l) {
+			float qlin;
+			unsigned char const ref = shaped.quantize(w[l],qlin);
+			float const e = qlin - w[l];
+			float const xr = shaped.clamp_error(e);
+			if (!live[l]) {
+				lanes_ok = lanes_ok && x[l] == 0 && clamped[l] == 0;
+			} else if (w[l] == w[l]) {
+				lanes_ok = lanes_ok && c[l] == ref && x[l] == xr
+					&& clamped[l] == (xr != e);
+			} else {
+				lanes_ok = lanes_ok && c[l] == ref;
+			}
+		}
+	}
+	check(lanes_ok,"quantize_lanes matches quantize and clamp_error");
+
+	test_shaped_spectrum(law);
+}
+
+} // anonymous namespace
+
+int main()
+{
+	test_law(g711_mulaw);
+	test_law(g711_alaw);
+	return test_result();
+}
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "image_shaper.hpp"
+#include "test.hpp"
+#include "waplns.hpp"
+
+// image_shaper against a scalar waplns per row, at widths around the 8
+// column blocks of the AVX2 tile transposes and the 64 column tiles, and
+// heights that leave the last band of 32 rows partly empty (the rows past
+// the plane take the scalar store path and are not stored). Serpentine
+// rows are the mirror images of scanline rows of the mirrored plane, with
+// first_row choosing which rows run backwards.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_image_shaper.cpp
+//        image_shaper.cpp waplns.cpp -o test_image_shaper
+
+namespace { // anonymous
+
+const int bits = 10;
+const float lam = 0.3f;
+const int ord = 4;
+const float k[] = { 0.7f, -0.3f, 0.15f, -0.05f };
+const float thresh = 0.75f;
+
+/** one row as image_shaper shapes it, step -1 from the right end */
+void reference_row(uint16_t const* in, unsigned char* out, int width, int step)
+{
+	waplns ns;
+	ns.set_params(lam,ord,k);
+	float const scale = 1.0f / (1 << (bits - 8));
+	int const first = step < 0 ? width-1 : 0;
+	for (int n=0; n<width; ++n) {
+		int const i = first + step*n;
+		float const w = in[i] * scale - ns.u();
+		float rm = w + 12582912.0f;
+		rm = std::max(rm,12582912.0f);
+		rm = std::min(rm,12582912.0f + 255.0f);
+		float const q = rm - 12582912.0f;
+		out[i] = static_cast<unsigned char>(q);
+		float const e = q - w;
+		ns.x_was(std::max(-thresh,std::min(e,thresh)));
+	}
+}
+
+struct plane
+{
+	int width, height, in_stride, out_stride;
+	std::vector<uint16_t> in;
+	std::vector<unsigned char> out;
+
+	plane(int w, int h)
+	: width(w), height(h), in_stride(w + 3), out_stride(w + 5),
+	  in(in_stride * h), out(out_stride * (h + 1), 0xA5)
+	{
+		for (int y=0; y<h; ++y) {
+			for (int x=0; x<w; ++x) {
+				// a gradient with noise, clipping at both ends in places
+				int const v = 4 * ((x * 7 + y * 13) % 300) - 100 + std::rand() % 9;
+				in[y*in_stride + x] = static_cast<uint16_t>(std::max(0,std::min(v,1023)));
+			}
+		}
+	}
+
+	void shape(image_shaper const& sh, int first_row = 0)
+	{
+		sh.process_plane(&in[0],in_stride,bits,&out[0],out_stride,width,height,first_row);
+	}
+
+	/** mirrors every row of the input */
+	void mirror()
+	{
+		for (int y=0; y<height; ++y) {
+			std::reverse(&in[y*in_stride],&in[y*in_stride + width]);
+		}
+	}
+
+	/** the padding of the rows and the row below the plane are untouched */
+	bool padding_kept() const
+	{
+		for (int y=0; y<=height; ++y) {
+			for (int x=y<height ? width : 0; x<out_stride; ++x) {
+				if (out[y*out_stride + x] != 0xA5) return false;
+			}
+		}
+		return true;
+	}
+};
+
+} // anonymous namespace
+
+int main()
+{
+	image_shaper sh(lam,ord,k);
+	sh.set_thresh(thresh);
+	int const widths[] = { 1, 7, 8, 9, 63, 64, 65, 100, 136 };
+	int const heights[] = { 1, 5, 32, 37, 64 };
+	bool ref_ok = true, pad_ok = true, serp_ok = true, first_ok = true;
+	for (int wi=0; wi<9; ++wi) {
+		for (int hi=0; hi<5; ++hi) {
+			int const w = widths[wi], h = heights[hi];
+			plane p(w,h);
+			sh.set_serpentine(false);
+			p.shape(sh);
+			pad_ok = pad_ok && p.padding_kept();
+			std::vector<unsigned char> row(w);
+			for (int y=0; y<h; ++y) {
+				reference_row(&p.in[y*p.in_stride],&row[0],w,1);
+				ref_ok = ref_ok && std::equal(row.begin(),row.end(),&p.out[y*p.out_stride]);
+			}
+
+			// serpentine: odd rows run backwards, the mirror image of the
+			// mirrored row in scanline order
+			plane m = p;
+			m.mirror();
+			m.shape(sh);
+			plane s = p;
+			sh.set_serpentine(true);
+			s.shape(sh);
+			pad_ok = pad_ok && s.padding_kept();
+			for (int y=0; y<h; ++y) {
+				unsigned char const* const so = &s.out[y*s.out_stride];
+				unsigned char const* const po = &p.out[y*p.out_stride];
+				unsigned char const* const mo = &m.out[y*m.out_stride];
+				serp_ok = serp_ok && (y & 1 ? std::equal(so,so+w,
+					std::reverse_iterator<unsigned char const*>(mo+w)) : std::equal(so,so+w,po));
+			}
+			// first_row 1: now the even rows run backwards
+			s.shape(sh,1);
+			for (int y=0; y<h; ++y) {
+				unsigned char const* const so = &s.out[y*s.out_stride];
+				unsigned char const* const po = &p.out[y*p.out_stride];
+				unsigned char const* const mo = &m.out[y*m.out_stride];
+				first_ok = first_ok && (y & 1 ? std::equal(so,so+w,po) : std::equal(so,so+w,
+					std::reverse_iterator<unsigned char const*>(mo+w)));
+			}
+		}
+	}
+	check(ref_ok,"rows match the scalar shaper");
+	check(pad_ok,"row padding and rows below the plane are not written");
+	check(serp_ok,"serpentine rows mirror the scanline rows of the mirrored plane");
+	check(first_ok,"first_row picks the rows that run backwards");
+	return test_result();
+}
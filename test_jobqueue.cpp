@@ -0,0 +1,43 @@
+#include <cstdlib>
+#include <string>
+#include "jobqueue.hpp"
+#include "test.hpp"
+
+// Lease ownership in job_queue: a worker whose lease was taken over by
+// another claimer (recovered after a stall, then claimed again) must see
+// that in owns() and must not be able to complete the ticket.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_jobqueue.cpp jobqueue.cpp
+//        -o test_jobqueue
+
+int main()
+{
+	char dir[] = "/tmp/test_jobqueue.XXXXXX";
+	if (!mkdtemp(dir)) {
+		check(false,"mkdtemp");
+		return test_result();
+	}
+	job_queue q(dir);
+
+	std::string t;
+	check(q.put("a.0") && q.claim(t) && t == "a.0","claim a put ticket");
+	check(q.owns(t),"a fresh claim owns its lease");
+	check(q.complete(t) && q.is_done(t),"the owner completes");
+	check(!q.owns(t),"a done ticket is nobody's lease");
+
+	// another host claimed the ticket after recover(): same file, new owner
+	check(q.put("b.0") && q.claim(t) && t == "b.0","claim a second ticket");
+	check(q.write_file("leases",t,"attempts 2\nother-host.1\n"),"hand over the lease");
+	check(!q.owns(t),"a lease claimed by someone else is not ours");
+	check(!q.complete(t),"complete() refuses a lease that is not ours");
+	check(!q.is_done(t),"the other owner's lease stays where it is");
+
+	// recovered but not claimed again: not ours either
+	check(q.put("c.0") && q.claim(t) && t == "c.0","claim a third ticket");
+	check(q.recover(-1) >= 1,"recover() takes back the lease");
+	check(!q.owns(t) && !q.complete(t),"a recovered lease is not ours");
+
+	std::string const rm = std::string("rm -rf ") + dir;
+	if (std::system(rm.c_str()) != 0) check(false,"remove the queue directory");
+	return test_result();
+}
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+#include "fft.hpp"
+#include "test.hpp"
+#include "warped_lattice.hpp"
+#include "wlpc.hpp"
+
+// warped_lattice and warped_lattice_bank with k from the warped LPC of the
+// signal, for unrolled and run time orders, warped and unwarped, on
+// channel counts that leave the last lane group partly empty: analysis
+// whitens, synthesis undoes it, the bank follows the scalar filter, and
+// split blocks and in-place processing change nothing.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_lattice.cpp warped_lattice.cpp
+//        wlpc.cpp fft.cpp workspace.cpp -o test_lattice
+
+namespace { // anonymous
+
+/** check() that names the filter */
+void check(bool ok, char const* what, int ord, float lam)
+{
+	std::ostringstream s;
+	s << what << " (order " << ord << ", lambda " << lam << ")";
+	::check(ok,s.str().c_str());
+}
+
+double flatness_db(float const* x, int n)
+{
+	int const len = 512;
+	std::vector<double> psd(len/2 + 1);
+	welch_psd(x,n,len,&psd[0]);
+	double lg = 0, ar = 0;
+	for (int b=1; b<len/2; ++b) {
+		lg += std::log(psd[b]);
+		ar += psd[b];
+	}
+	return 10 * std::log10(std::exp(lg / (len/2 - 1)) / (ar / (len/2 - 1)));
+}
+
+double max_diff(float const* a, float const* b, int n)
+{
+	double d = 0;
+	for (int i=0; i<n; ++i) d = std::max(d,static_cast<double>(std::fabs(a[i] - b[i])));
+	return d;
+}
+
+void test(int channels, int ord, float lam)
+{
+	int const n = 8192;
+	std::vector<float> in(channels*n);
+	unsigned s = 1;
+	for (int c=0; c<channels; ++c) {
+		for (int i=0; i<n; ++i) {
+			s = s * 1664525u + 1013904223u;
+			in[c*n+i] = 0.3f * std::sin(i*(0.011f+0.002f*c))
+				+ 0.2f * std::sin(i*0.3f)
+				+ 0.01f * (static_cast<float>(s >> 8) / 16777216 - 0.5f);
+		}
+	}
+	double r[max_wapl_filt_order+1];
+	float k[max_wapl_filt_order];
+	warped_autocorr(&in[0],n,lam,ord,r);
+	levinson(r,ord,k);
+
+	// scalar: whitening, round trip, split blocks, in place
+	std::vector<float> res(channels*n), back(channels*n), part(n), inplace(in);
+	warped_lattice a, b;
+	a.set_params(lam,ord,k);
+	b.set_params(lam,ord,k);
+	double err = 0;
+	bool split_ok = true, inplace_ok = true;
+	for (int c=0; c<channels; ++c) {
+		a.reset_state();
+		b.reset_state();
+		a.analyze(&in[c*n],&res[c*n],n);
+		b.synthesize(&res[c*n],&back[c*n],n);
+		err = std::max(err,max_diff(&back[c*n],&in[c*n],n));
+		a.reset_state();
+		a.analyze(&in[c*n],&part[0],1000);
+		a.analyze(&in[c*n+1000],&part[1000],n-1000);
+		split_ok = split_ok && max_diff(&part[0],&res[c*n],n) == 0;
+		a.reset_state();
+		a.analyze(&inplace[c*n],&inplace[c*n],n);
+		inplace_ok = inplace_ok && max_diff(&inplace[c*n],&res[c*n],n) == 0;
+	}
+	check(flatness_db(&res[0],n) > flatness_db(&in[0],n) + 5,"analysis whitens",ord,lam);
+	check(err < 1e-4,"analysis then synthesis restores the input",ord,lam);
+	check(split_ok,"split blocks",ord,lam);
+	check(inplace_ok,"in place",ord,lam);
+
+	// the bank against the scalar filter
+	std::vector<float> bres(channels*n), bback(channels*n);
+	std::vector<float const*> ip(channels), rp(channels);
+	std::vector<float*> ro(channels), bo(channels);
+	for (int c=0; c<channels; ++c) {
+		ip[c] = &in[c*n];
+		rp[c] = &bres[c*n];
+		ro[c] = &bres[c*n];
+		bo[c] = &bback[c*n];
+	}
+	warped_lattice_bank bank(channels,max_wapl_filt_order);
+	bank.set_params(lam,ord,k);
+	bank.analyze(&ip[0],&ro[0],n/2);
+	for (int c=0; c<channels; ++c) {
+		ip[c] += n/2;
+		ro[c] += n/2;
+	}
+	bank.analyze(&ip[0],&ro[0],n - n/2);
+	double diff = 0;
+	for (int c=0; c<channels; ++c) diff = std::max(diff,max_diff(&bres[c*n],&res[c*n],n));
+	check(diff < 1e-4,"bank analysis follows the scalar filter",ord,lam);
+
+	// the state handed out by channel() continues like the bank
+	warped_lattice ch = bank.channel(channels-1);
+	float const probe[4] = { 0.1f, -0.2f, 0.05f, 0 };
+	float out1[4];
+	ch.analyze(probe,out1,4);
+	std::vector<float> zeros(4*channels), bout(4*channels);
+	std::vector<float const*> zp(channels);
+	std::vector<float*> bp(channels);
+	for (int c=0; c<channels; ++c) {
+		for (int i=0; i<4; ++i) zeros[c*4+i] = probe[i];
+		zp[c] = &zeros[c*4];
+		bp[c] = &bout[c*4];
+	}
+	bank.analyze(&zp[0],&bp[0],4);
+	check(max_diff(out1,&bout[(channels-1)*4],4) < 1e-5,"channel() continues like the bank",ord,lam);
+
+	bank.reset_state();
+	bank.synthesize(&rp[0],&bo[0],n);
+	double berr = 0;
+	for (int c=0; c<channels; ++c) berr = std::max(berr,max_diff(&bback[c*n],&in[c*n],n));
+	check(berr < 1e-4,"bank analysis then synthesis restores the input",ord,lam);
+}
+
+} // anonymous namespace
+
+int main()
+{
+	float const lams[] = { 0.0f, warp_lambda_bark(48000) };
+	int const orders[] = { 1, 3, 8, 9, 16, 32 };
+	for (int l=0; l<2; ++l) {
+		for (int o=0; o<6; ++o) {
+			test(3,orders[o],lams[l]);
+			test(21,orders[o],lams[l]);
+		}
+	}
+	return test_result();
+}
@@ -0,0 +1,63 @@
+#!/bin/sh
+# Distributed render with three local workers on one queue directory:
+#
+#  - a job split into chunks, with the first ticket left as the stale
+#    lease of a dead worker, must come out byte-identical to a single
+#    process render, with the same file size and CRC in its manifest
+#  - the manifest must not depend on the output path (streamed or not)
+#  - a job whose input disappears must end in failed/, with the workers
+#    and wait exiting 1 instead of retrying forever
+#
+#    sh test_render.sh [path/to/waplns_render]
+#
+# The input is digital silence; with dither the codes still depend on the
+# shaper state and the dither seed carried from chunk to chunk.
+
+render=${1:-./waplns_render}
+case $render in /*) ;; *) render=$(pwd)/$render ;; esac
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+k="0.5 -0.3 0.2 -0.1 0.05 -0.02"
+failures=0
+
+fail()
+{
+	echo "FAIL: $1"
+	failures=$((failures+1))
+}
+
+# bytes and CRC of a manifest's file line; the hash depends on the blocks
+file_sum()
+{
+	sed -n 's/^file \([0-9]*\) \([0-9a-f]*\) .*/\1 \2/p' "$1"
+}
+
+head -c 4000000 /dev/zero > in.f32
+"$render" render in.f32 ref.s16 0.6 1 $k || fail "single process render"
+[ -n "$(file_sum ref.s16.sum)" ] || fail "render wrote no manifest"
+WAPLNS_RENDER_STREAM=0 "$render" render in.f32 ref2.s16 0.6 1 $k || fail "render without streaming"
+cmp -s ref.s16.sum ref2.s16.sum || fail "manifest depends on the output path"
+
+"$render" submit q job in.f32 out.s16 100000 0.6 1 $k > /dev/null || fail "submit"
+mv q/todo/job.0 q/leases/job.0
+touch -d '1 hour ago' q/leases/job.0
+for i in 1 2 3; do "$render" worker q 2 & done
+wait
+"$render" wait q job 2 || fail "wait for the job"
+cmp -s ref.s16 out.s16 || fail "distributed render differs from render"
+[ "$(file_sum ref.s16.sum)" = "$(file_sum out.s16.sum)" ] || fail "distributed manifest differs"
+
+head -c 40000 /dev/zero > gone.f32
+"$render" submit q bad gone.f32 bad.s16 1000 0.6 1 $k > /dev/null || fail "submit"
+rm gone.f32
+pids=
+for i in 1 2 3; do "$render" worker q 1 2> /dev/null & pids="$pids $!"; done
+errors=0
+for p in $pids; do wait $p || errors=$((errors+1)); done
+[ $errors -gt 0 ] || fail "no worker reported the failed chunk"
+[ -e q/failed/bad.0 ] || fail "failing ticket not in failed/"
+"$render" wait q bad 1 2> /dev/null && fail "wait succeeded on a failed job"
+
+if [ $failures -eq 0 ]; then echo ok; else echo FAILED; fi
+[ $failures -eq 0 ]
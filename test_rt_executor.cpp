@@ -0,0 +1,126 @@
+#include <atomic>
+#include <ctime>
+#include "rt_executor.hpp"
+#include "test.hpp"
+
+// rt_executor cycles: every stream runs once per cycle, on the worker it
+// was assigned to, blocks that end after the deadline are counted per
+// stream and in total, a cycle begun while one is running is skipped,
+// and the executor runs again after stop() and start().
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_rt_executor.cpp
+//        rt_executor.cpp rt_log.cpp -o test_rt_executor -pthread
+
+namespace { // anonymous
+
+const int workers = 2;
+const int streams = 7;
+
+struct counting_job
+{
+	std::atomic<int> runs;
+	std::atomic<int> sleep_us;    // how long the next runs take
+	pthread_t last_thread;
+
+	static void run(void* ctx)
+	{
+		counting_job & j = *static_cast<counting_job*>(ctx);
+		j.last_thread = pthread_self();
+		int const us = j.sleep_us.load(std::memory_order_relaxed);
+		if (us > 0) {
+			timespec const ts = { 0, us * 1000L };
+			nanosleep(&ts,0);
+		}
+		j.runs.fetch_add(1,std::memory_order_relaxed);
+	}
+};
+
+counting_job jobs[streams];
+
+/** every job ran n times */
+bool all_ran(int n)
+{
+	bool ok = true;
+	for (int s=0; s<streams; ++s) ok = ok && jobs[s].runs.load() == n;
+	return ok;
+}
+
+/** begin_cycle() with a budget, then waits for the cycle */
+bool cycle(rt_executor & ex, long long budget_ns)
+{
+	if (!ex.begin_cycle(budget_ns)) return false;
+	ex.wait_cycle();
+	return ex.cycle_done();
+}
+
+} // anonymous namespace
+
+int main()
+{
+	rt_executor ex(workers,streams);
+	for (int s=0; s<streams; ++s) {
+		jobs[s].runs = 0;
+		jobs[s].sleep_us = 0;
+		ex.add_stream(counting_job::run,&jobs[s],1.0f + s % 3);
+	}
+	int per_worker[workers] = {0};
+	for (int s=0; s<streams; ++s) ++per_worker[ex.worker_of(s)];
+	check(per_worker[0] > 0 && per_worker[1] > 0,"streams go to both workers");
+	check(ex.cycle_done(),"no cycle before start()");
+
+	check(ex.start(),"start()");
+	long long const second = 1000000000LL;
+	bool cycles_ok = true, runs_ok = true;
+	for (int c=1; c<=20; ++c) {
+		cycles_ok = cycles_ok && cycle(ex,second);
+		runs_ok = runs_ok && all_ran(c);
+	}
+	check(cycles_ok,"cycles start and finish");
+	check(runs_ok,"every stream runs once per cycle");
+	bool same_thread = true;
+	for (int s=0; s<streams; ++s) {
+		for (int t=0; t<streams; ++t) {
+			bool const same_worker = ex.worker_of(s) == ex.worker_of(t);
+			same_thread = same_thread && same_worker
+				== (pthread_equal(jobs[s].last_thread,jobs[t].last_thread) != 0);
+		}
+	}
+	check(same_thread,"streams of a worker run on its thread");
+
+	rt_executor::counters c = ex.get_counters();
+	check(c.cycles == 20 && c.skipped == 0,"cycles are counted");
+	check(c.blocks == 20UL * streams,"blocks are counted");
+	check(c.deadline_misses == 0,"no misses within a second");
+
+	// a budget of 0: every block ends after the deadline
+	check(cycle(ex,0) && all_ran(21),"a cycle with no budget runs");
+	c = ex.get_counters();
+	check(c.deadline_misses == streams,"every late block is a miss");
+	bool stream_ok = true;
+	for (int s=0; s<streams; ++s) stream_ok = stream_ok && ex.stream_misses(s) == 1;
+	check(stream_ok,"misses are counted per stream");
+
+	// a slow stream holds the cycle up, the next one is refused
+	jobs[0].sleep_us = 50000;
+	check(ex.begin_cycle(second),"begin a slow cycle");
+	check(!ex.begin_cycle(second),"a cycle is refused while one runs");
+	ex.wait_cycle();
+	jobs[0].sleep_us = 0;
+	c = ex.get_counters();
+	check(c.cycles == 22 && c.skipped == 1,"the refused cycle is skipped");
+	check(all_ran(22),"a refused cycle runs nothing");
+	check(c.worst_cycle_ns >= 50000000LL,"the slow cycle is the worst");
+
+	ex.stop();
+	check(ex.start(),"start() after stop()");
+	runs_ok = true;
+	for (int n=23; n<=30; ++n) runs_ok = runs_ok && cycle(ex,second) && all_ran(n);
+	check(runs_ok,"cycles run again after a restart");
+	c = ex.get_counters();
+	check(c.cycles == 30 && c.blocks == 30UL * streams,"counters carry over a restart");
+	ex.stop();
+	ex.stop();
+	check(all_ran(30),"stop() runs no cycle");
+
+	return test_result();
+}
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "shaper.hpp"
+#include "streaming.hpp"
+#include "test.hpp"
+
+// stream_copy() at every destination and source offset within a cache
+// line, for lengths around the 16 and 32 byte vectors and across a few
+// of them, leaving the bytes on either side alone; and
+// shape_block_streaming() into misaligned output with counts that end
+// mid tile, against shape_block().
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_streaming.cpp streaming.cpp
+//        waplns.cpp -o test_streaming
+
+int main()
+{
+	int const guard = 64;
+	int const max_len = 200;
+	alignas(64) unsigned char src[64 + max_len];
+	alignas(64) unsigned char dst[guard + 64 + max_len + guard];
+	for (int i=0; i<64+max_len; ++i) src[i] = static_cast<unsigned char>(i * 37 + 11);
+	bool copy_ok = true, guard_ok = true;
+	for (int doff=0; doff<64; ++doff) {
+		for (int soff=0; soff<64; soff+=7) {
+			for (int len=0; len<=max_len; len = len<70 ? len+1 : len+13) {
+				std::memset(dst,0xA5,sizeof(dst));
+				unsigned char* const d = dst + guard + doff;
+				stream_copy(d,src + soff,len);
+				stream_fence();
+				copy_ok = copy_ok && std::memcmp(d,src + soff,len) == 0;
+				for (unsigned char const* g=dst; g<d; ++g) guard_ok = guard_ok && *g == 0xA5;
+				for (unsigned char const* g=d+len; g<dst+sizeof(dst); ++g) {
+					guard_ok = guard_ok && *g == 0xA5;
+				}
+			}
+		}
+	}
+	check(copy_ok,"stream_copy copies at any offset and length");
+	check(guard_ok,"stream_copy writes nothing outside the destination");
+
+	int const n = 3 * stream_tile + 123;
+	std::vector<float> s(n);
+	for (int i=0; i<n; ++i) s[i] = 20000.0f * std::sin(0.001f * i) * std::sin(0.37f * i);
+	float const k[] = { 0.5f, -0.2f, 0.1f };
+	std::vector<short> ref(n), out(n + 16);
+	waplns ns;
+	ns.set_params(0.4f,3,k);
+	pcm16_quantizer quant;
+	shape_block(ns,quant,unity_gain(),&s[0],&ref[0],n);
+	bool shaped_ok = true;
+	for (int off=0; off<16; off+=5) {
+		for (int count=n-2*stream_tile-1; count<=n; count+=stream_tile) {
+			std::fill(out.begin(),out.end(),short(0x5A5A));
+			ns.reset_state();
+			pcm16_quantizer q2;
+			shape_block_streaming(ns,q2,unity_gain(),&s[0],&out[off],count);
+			shaped_ok = shaped_ok && std::equal(&ref[0],&ref[count],&out[off])
+				&& (off+count == n+16 || out[off+count] == 0x5A5A);
+		}
+	}
+	check(shaped_ok,"shape_block_streaming matches shape_block at any offset");
+	return test_result();
+}
@@ -0,0 +1,117 @@
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "telemetry.hpp"
+#include "test.hpp"
+
+// Telemetry codes: pack_codes() and unpack_codes() round trip every code
+// of the 8, 12 and 16 bit formats at odd and even counts, write exactly
+// packed_bytes() and lay 12 bit pairs out as documented. shape_batch()
+// with presets of all three widths, ragged lengths and signals beyond the
+// code range follows shape() up to the documented odd code off by one.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_telemetry.cpp telemetry.cpp
+//        wlpc.cpp waplns.cpp workspace.cpp -o test_telemetry
+
+namespace { // anonymous
+
+void test_packing(int bits)
+{
+	int const lo = -(1 << (bits-1)), hi = (1 << (bits-1)) - 1;
+	int const n = hi - lo + 2;    // every code, odd for an odd count
+	std::vector<int> codes(n), back(n);
+	for (int i=0; i<n; ++i) codes[i] = lo + (i * 7919) % (n-1);
+	bool round_trip = true, exact_size = true;
+	for (int m=0; m<=n; m = m<20 ? m+1 : m*3 + 1) {
+		std::vector<unsigned char> buf(packed_bytes(m,bits) + 1,0xA5);
+		pack_codes(&codes[0],m,bits,&buf[0]);
+		exact_size = exact_size && buf.back() == 0xA5;
+		if (m) unpack_codes(&buf[0],m,bits,&back[0]);
+		for (int i=0; i<m; ++i) round_trip = round_trip && back[i] == codes[i];
+	}
+	if (bits == 8) {
+		check(round_trip,"8 bit codes round trip");
+		check(exact_size,"8 bit packing writes packed_bytes()");
+	} else if (bits == 12) {
+		check(round_trip,"12 bit codes round trip");
+		check(exact_size,"12 bit packing writes packed_bytes()");
+	} else {
+		check(round_trip,"16 bit codes round trip");
+		check(exact_size,"16 bit packing writes packed_bytes()");
+	}
+}
+
+void test_12bit_layout()
+{
+	int const codes[] = { 0x123, -0x3aa, -1 };
+	unsigned char buf[5];
+	pack_codes(codes,3,12,buf);
+	// -0x3aa is 0xc56 in 12 bits; the odd last code takes two bytes
+	unsigned char const want[] = { 0x23, 0x61, 0xc5, 0xff, 0x0f };
+	bool ok = packed_bytes(3,12) == 5;
+	for (int i=0; i<5; ++i) ok = ok && buf[i] == want[i];
+	check(ok,"12 bit pairs go into three bytes, low nibble first");
+}
+
+void test_batch()
+{
+	int const series = 29;       // three full lane groups and a partial one
+	int const max_len = 300;
+	telemetry_shaper ts(series);
+	telemetry_format const f8 = { 0.5f, 3.0f, 8 };
+	telemetry_format const f12 = { 0.01f, 0.0f, 12 };
+	telemetry_format const f16 = { 0.001f, -1.0f, 16 };
+	float const k2[] = { 0.6f, -0.2f };
+	int const presets[] = {
+		ts.add_preset(f8,0.2f,2,k2),
+		ts.add_band_preset(f12,25600,2000,4000,12),
+		ts.add_band_preset(f16,1000,10,100,8),
+		ts.add_preset(f12,0.0f,0,0)
+	};
+	ts.set_thresh(presets[1],0.5f);
+
+	std::vector<float> in(series * max_len);
+	std::vector<int> single(series * max_len), batch(series * max_len);
+	std::vector<float const*> ip(series);
+	std::vector<int*> op(series);
+	std::vector<int> len(series), p(series);
+	for (int s=0; s<series; ++s) {
+		p[s] = presets[s % 4];
+		len[s] = (s * 37) % (max_len + 1);
+		telemetry_format const& f = ts.format(p[s]);
+		// up to twice the code range, so both ends clamp
+		float const amp = f.step * (1 << f.bits);
+		for (int i=0; i<max_len; ++i) {
+			in[s*max_len + i] = amp * std::sin(0.05f * (s+1) * i)
+				+ f.step * (std::rand() % 200 - 100) * 0.1f;
+		}
+		ip[s] = &in[s*max_len];
+		op[s] = &batch[s*max_len];
+		ts.shape(p[s],ip[s],len[s],&single[s*max_len]);
+	}
+	ts.shape_batch(series,&p[0],&ip[0],&len[0],&op[0]);
+	long samples = 0, differ = 0;
+	bool close = true;
+	for (int s=0; s<series; ++s) {
+		for (int i=0; i<len[s]; ++i) {
+			int const d = single[s*max_len + i] - batch[s*max_len + i];
+			differ += d != 0;
+			close = close && std::abs(d) <= 1;
+		}
+		samples += len[s];
+	}
+	check(close,"shape_batch() codes are within one of shape()");
+	check(differ * 1000 <= samples,"shape_batch() follows shape()");
+}
+
+} // anonymous namespace
+
+int main()
+{
+	test_packing(8);
+	test_packing(12);
+	test_packing(16);
+	test_12bit_layout();
+	test_batch();
+	return test_result();
+}
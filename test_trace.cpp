@@ -0,0 +1,100 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "test.hpp"
+#include "trace.hpp"
+
+// Dumping the trace rings while another thread records into them: every
+// dump holds only whole events of the recording thread, in order (begin
+// and end alternate and the timestamps never go back), also after the
+// ring has wrapped around many times.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_trace.cpp trace.cpp
+//        -o test_trace -pthread
+
+namespace { // anonymous
+
+std::atomic<bool> stop(false);
+std::atomic<bool> started(false);
+
+void record()
+{
+	trace_register_thread("recorder");
+	bool begin = true;
+	for (long n=0; !stop.load(std::memory_order_relaxed); ++n) {
+		trace_event(trace_shape,begin);
+		begin = !begin;
+		if (n == 2*trace_ring_events) started.store(true,std::memory_order_release);
+	}
+}
+
+struct dump_stats
+{
+	long events;
+	bool known_names;
+	bool alternating;
+	bool in_order;
+};
+
+dump_stats check_dump(std::FILE* f)
+{
+	dump_stats st = { 0, true, true, true };
+	char line[256];
+	char last_ph = 0;
+	double last_ts = 0;
+	while (std::fgets(line,sizeof(line),f)) {
+		char name[16];
+		char ph;
+		double ts;
+		int tid;
+		if (std::sscanf(line,"{\"name\":\"%15[^\"]\",\"ph\":\"%c\",\"ts\":%lf,\"pid\":1,"
+			"\"tid\":%d}",name,&ph,&ts,&tid) != 4) continue;
+		++st.events;
+		st.known_names = st.known_names && std::strcmp(name,"shape") == 0;
+		st.alternating = st.alternating && ph != last_ph && (ph == 'B' || ph == 'E');
+		st.in_order = st.in_order && ts >= last_ts;
+		last_ph = ph;
+		last_ts = ts;
+	}
+	return st;
+}
+
+} // anonymous namespace
+
+int main()
+{
+	trace_enable(true);
+	std::thread recorder(record);
+	while (!started.load(std::memory_order_acquire)) std::this_thread::yield();
+
+	bool whole = true, names = true, alternating = true, in_order = true;
+	long dumped = 0;
+	for (int d=0; d<50; ++d) {
+		std::FILE* f = std::tmpfile();
+		if (!f) {
+			check(false,"tmpfile()");
+			break;
+		}
+		trace_dump_chrome(f);
+		std::rewind(f);
+		dump_stats const st = check_dump(f);
+		std::fclose(f);
+		// at most a full ring; a dumper descheduled while the recorder laps
+		// the ring may find no event it can keep
+		whole = whole && st.events <= trace_ring_events;
+		dumped += st.events;
+		names = names && st.known_names;
+		alternating = alternating && st.alternating;
+		in_order = in_order && st.in_order;
+	}
+	stop.store(true,std::memory_order_relaxed);
+	recorder.join();
+	trace_enable(false);
+
+	check(whole && dumped > 0,"dumps hold up to a ring of events");
+	check(names,"dumped events have the recorded stage");
+	check(alternating,"dumped begin and end events alternate");
+	check(in_order,"dumped timestamps never go back");
+	return test_result();
+}
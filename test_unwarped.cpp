@@ -0,0 +1,122 @@
+#include <cstring>
+#include <vector>
+#include "lattice_kernels.hpp"
+#include "shaper.hpp"
+#include "test.hpp"
+
+// The unwarped x_was() path (lambda = 0) against the general warped
+// lattice run with lambda = 0, which it replaces: u and t[] must be bit
+// identical after every sample, for every order, and shape_block() must
+// give the same codes.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_unwarped.cpp waplns.cpp
+//        -o test_unwarped
+
+namespace { // anonymous
+
+bool same_bits(float a, float b)
+{
+	return std::memcmp(&a,&b,sizeof(a)) == 0;
+}
+
+struct lcg
+{
+	unsigned s;
+	explicit lcg(unsigned seed) : s(seed) {}
+	float operator()()   // uniform in [-1, 1)
+	{
+		s = s * 1664525u + 1013904223u;
+		return static_cast<float>((s >> 8) * (2.0 / 16777216) - 1);
+	}
+};
+
+// waplns::x_was() as it is for lambda != 0, with s1 = s2 = 1
+struct warped_reference
+{
+	int order;
+	float const* k;
+	float t[max_wapl_filt_order];
+	float u;
+
+	warped_reference(int ord, float const* kk) : order(ord), k(kk), u(0)
+	{
+		for (int i=0; i<order; ++i) t[i] = 0;
+	}
+
+	void x_was(float x)
+	{
+		double const y = static_cast<double>(x) - u;
+		u = static_cast<float>(lattice_push(order,0.0f,k,t,y));
+	}
+};
+
+} // anonymous namespace
+
+int main()
+{
+	lcg rnd(7);
+	float k[max_wapl_filt_order];
+	bool u_ok = true, t_ok = true, gain_ok = true;
+	for (int ord=1; ord<=max_wapl_filt_order; ++ord) {
+		for (int i=0; i<ord; ++i) k[i] = 0.9f * rnd();
+		waplns ns;
+		ns.set_params(0.0f,ord,k);
+		gain_ok = gain_ok && ns.warp_gain() == 1.0f;
+		warped_reference ref(ord,k);
+		for (int n=0; n<2000; ++n) {
+			float const x = 0.5f * rnd();
+			ns.x_was(x);
+			ref.x_was(x);
+			u_ok = u_ok && same_bits(ns.u(),ref.u);
+		}
+		waplns::state st;
+		ns.get_state(st);
+		for (int i=0; i<ord; ++i) t_ok = t_ok && same_bits(st.t[i],ref.t[i]);
+	}
+	check(gain_ok,"warp gain 1 at lambda 0");
+	check(u_ok,"u bit identical to the warped lattice at lambda 0");
+	check(t_ok,"t[] bit identical to the warped lattice at lambda 0");
+
+	// shape_block() on a signal, against the plain loop on the reference
+	int const n = 48000;
+	int const ord = 12;
+	std::vector<float> s(n);
+	for (int i=0; i<n; ++i) s[i] = 3000.0f * rnd();
+	waplns ns;
+	ns.set_params(0.0f,ord,k);
+	pcm16_quantizer quant;
+	std::vector<short> q(n);
+	shape_block(ns,quant,&s[0],&q[0],n);
+	warped_reference ref(ord,k);
+	pcm16_quantizer rquant;
+	bool codes_ok = true;
+	for (int i=0; i<n; ++i) {
+		float const w = s[i] - ref.u;
+		float qlin;
+		short const c = rquant.quantize(w,qlin);
+		codes_ok = codes_ok && c == q[i];
+		ref.x_was(rquant.clamp_error(qlin - w));
+	}
+	check(codes_ok,"shape_block() codes at lambda 0");
+
+	// switching to lambda 0 mid-stream is the same as starting there with
+	// the same state
+	waplns a, b;
+	a.set_params(0.4f,ord,k);
+	for (int i=0; i<100; ++i) a.x_was(0.3f * rnd());
+	a.set_lambda(0.0f);
+	waplns::state st;
+	a.get_state(st);
+	b.set_params(0.0f,ord,k);
+	b.set_state(st);
+	bool switch_ok = same_bits(a.u(),b.u());
+	for (int i=0; i<100; ++i) {
+		float const x = 0.3f * rnd();
+		a.x_was(x);
+		b.x_was(x);
+		switch_ok = switch_ok && same_bits(a.u(),b.u());
+	}
+	check(switch_ok,"set_lambda(0) mid-stream");
+
+	return test_result();
+}
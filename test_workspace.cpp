@@ -0,0 +1,236 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "masking.hpp"
+#include "shaper.hpp"
+#include "telemetry.hpp"
+#include "test.hpp"
+#include "uniform_bank.hpp"
+#include "waplns_bank.hpp"
+#include "warped_lattice.hpp"
+#include "workspace.hpp"
+
+// Every engine with a workspace in exactly workspace_bytes(spec) of
+// caller memory, used up to its spec: all channels, the highest order,
+// the longest block. The arena and ws_array asserts catch a layout that
+// outgrows the reported size or a spec the layout does not cover, guard
+// bytes after the workspace catch stray writes, and a counting operator
+// new catches any allocation after setup. Also the alignment of
+// workspace_buffer for every kind of pages.
+//
+//    g++ -std=c++11 -O2 -march=native -I. test_workspace.cpp
+//        waplns_bank.cpp uniform_bank.cpp warped_lattice.cpp telemetry.cpp
+//        masking.cpp fft.cpp wlpc.cpp checkpoint.cpp rt_log.cpp waplns.cpp
+//        workspace.cpp -o test_workspace -pthread
+
+namespace { // anonymous
+
+long allocations = 0;
+
+const std::size_t guard = 256;
+
+/** workspace_bytes() of memory followed by guard bytes */
+struct placed
+{
+	std::size_t bytes;
+	workspace_buffer buf;
+
+	explicit placed(std::size_t n) : bytes(n), buf(n + guard)
+	{
+		std::memset(static_cast<unsigned char*>(buf.data()) + bytes,0xA5,guard);
+	}
+
+	void* data() const { return buf.data(); }
+
+	bool guard_kept() const
+	{
+		unsigned char const* const g = static_cast<unsigned char const*>(buf.data()) + bytes;
+		for (std::size_t i=0; i<guard; ++i) {
+			if (g[i] != 0xA5) return false;
+		}
+		return true;
+	}
+};
+
+/** in[ch] and out[ch] for channels x block samples */
+template<class Code>
+struct signals
+{
+	std::vector<float> in;
+	std::vector<Code> out;
+	std::vector<float const*> ip;
+	std::vector<Code*> op;
+
+	signals(int channels, int block)
+	: in(channels * block), out(channels * block), ip(channels), op(channels)
+	{
+		for (int c=0; c<channels; ++c) {
+			for (int i=0; i<block; ++i) {
+				in[c*block + i] = 3000.0f * std::sin(0.01f * (c+1) * i) + std::rand() % 100;
+			}
+			ip[c] = &in[c*block];
+			op[c] = &out[c*block];
+		}
+	}
+};
+
+float const k16[max_wapl_filt_order] = {
+	0.5f, -0.3f, 0.2f, -0.1f, 0.08f, -0.06f, 0.05f, -0.04f,
+	0.03f, -0.02f, 0.02f, -0.01f, 0.01f, -0.01f, 0.005f, -0.005f
+};
+
+void test_waplns_bank()
+{
+	workspace_spec const spec(max_wapl_filt_order,240,37);
+	placed mem(waplns_bank::workspace_bytes(spec));
+	waplns_bank bank(spec,mem.data(),mem.bytes);
+	signals<short> sig(spec.channels,spec.block);
+	std::vector<int> counts(spec.channels);
+	for (int c=0; c<spec.channels; ++c) counts[c] = 80 * (1 + c % 3);
+	pcm16_quantizer quant;
+	long const before = allocations;
+	for (int c=0; c<spec.channels; ++c) {
+		bank.add_stream(0.5f,1 + c % max_wapl_filt_order,k16);
+		bank.set_param_id(c,c % 5);
+	}
+	bank.set_accounting(2);
+	bank.set_activity(1.0f,0.5f);
+	for (int b=0; b<4; ++b) {
+		bank.process(quant,&sig.ip[0],&sig.op[0],spec.block);
+		bank.process(quant,&sig.ip[0],&sig.op[0],&counts[0]);
+	}
+	for (int c=0; c<spec.channels; c+=3) bank.set_params(c,0.3f,max_wapl_filt_order,k16);
+	bank.repack();
+	bank.process(quant,&sig.ip[0],&sig.op[0],spec.block);
+	waplns_bank::cost costs[8];
+	bank.get_preset_costs(costs,8);
+	check(allocations == before,"waplns_bank does not allocate");
+	check(bank.streams() == spec.channels,"waplns_bank holds spec.channels streams");
+	check(mem.guard_kept(),"waplns_bank stays within workspace_bytes()");
+}
+
+void test_uniform_bank()
+{
+	workspace_spec const spec(max_wapl_filt_order,256,37);
+	placed mem(uniform_bank::workspace_bytes(spec));
+	uniform_bank bank(spec,mem.data(),mem.bytes);
+	signals<short> sig(spec.channels,spec.block);
+	pcm16_quantizer quant;
+	long const before = allocations;
+	for (int ord=1; ord<=max_wapl_filt_order; ord+=5) {
+		bank.set_params(0.6f,ord,k16);
+		bank.process(quant,&sig.ip[0],&sig.op[0],spec.block);
+	}
+	bank.set_params(0.6f,max_wapl_filt_order,k16);
+	bank.process(quant,&sig.ip[0],&sig.op[0],spec.block);
+	check(allocations == before,"uniform_bank does not allocate");
+	check(mem.guard_kept(),"uniform_bank stays within workspace_bytes()");
+}
+
+void test_warped_lattice_bank()
+{
+	workspace_spec const spec(max_wapl_filt_order,256,21);
+	placed mem(warped_lattice_bank::workspace_bytes(spec));
+	warped_lattice_bank bank(spec,mem.data(),mem.bytes);
+	signals<float> sig(spec.channels,spec.block);
+	std::vector<float*> back(spec.channels);
+	std::vector<float> backs(spec.channels * spec.block);
+	for (int c=0; c<spec.channels; ++c) back[c] = &backs[c*spec.block];
+	long const before = allocations;
+	for (int ord=3; ord<=max_wapl_filt_order; ord+=13) {
+		bank.set_params(0.6f,ord,k16);
+		bank.analyze(&sig.ip[0],&sig.op[0],spec.block);
+		bank.synthesize(&sig.op[0],&back[0],spec.block);
+	}
+	check(allocations == before,"warped_lattice_bank does not allocate");
+	check(mem.guard_kept(),"warped_lattice_bank stays within workspace_bytes()");
+}
+
+void test_telemetry_shaper()
+{
+	workspace_spec const spec(max_wapl_filt_order,64,29);
+	placed mem(telemetry_shaper::workspace_bytes(spec));
+	telemetry_shaper ts(spec,mem.data(),mem.bytes);
+	telemetry_format const fmt = { 0.01f, 0.0f, 12 };
+	int const pr[] = { ts.add_preset(fmt,0.5f,max_wapl_filt_order,k16),
+		ts.add_band_preset(fmt,25600,2000,4000,12) };
+	signals<int> sig(spec.channels,spec.block);
+	std::vector<int> p(spec.channels), len(spec.channels);
+	for (int c=0; c<spec.channels; ++c) {
+		p[c] = pr[c % 2];
+		len[c] = spec.block - c;
+	}
+	long const before = allocations;
+	ts.shape_batch(spec.channels,&p[0],&sig.ip[0],&len[0],&sig.op[0]);
+	ts.shape(pr[0],sig.ip[0],spec.block,sig.op[0]);
+	check(allocations == before,"telemetry_shaper does not allocate after setup");
+	check(mem.guard_kept(),"telemetry_shaper stays within workspace_bytes()");
+}
+
+void test_masking_model()
+{
+	bool guards = true;
+	long allocated = 0;
+	for (int block=64; block<=4096; block*=4) {
+		workspace_spec const spec(0,block,1);
+		placed mem(masking_model::workspace_bytes(spec));
+		// 192 kHz has the most bands
+		masking_model model(spec,mem.data(),mem.bytes,192000,0.7f);
+		signals<float> sig(1,block);
+		float k[max_wapl_filt_order];
+		long const before = allocations;
+		model.analyze(sig.ip[0]);
+		model.fit(max_wapl_filt_order,k);
+		allocated += allocations - before;
+		guards = guards && mem.guard_kept();
+	}
+	check(allocated == 0,"masking_model does not allocate after setup");
+	check(guards,"masking_model stays within workspace_bytes()");
+}
+
+void test_buffer()
+{
+	workspace_pages const kinds[] = { normal_pages, transparent_huge_pages,
+		explicit_huge_pages };
+	bool aligned = true, sized = true;
+	for (int i=0; i<3; ++i) {
+		workspace_buffer buf(3 << 20,kinds[i]);
+		aligned = aligned && reinterpret_cast<std::size_t>(buf.data()) % workspace_align == 0;
+		sized = sized && buf.size() >= (3 << 20) && buf.pages() <= kinds[i];
+		std::memset(buf.data(),1,buf.size());
+	}
+	check(aligned,"workspace_buffer is aligned for every kind of pages");
+	check(sized,"workspace_buffer has the size asked for, or more");
+	workspace_spec const spec(max_wapl_filt_order,0,100);
+	workspace_spec const twice(max_wapl_filt_order,0,200);
+	check(waplns_bank::workspace_bytes(spec) < waplns_bank::workspace_bytes(twice),
+		"workspace_bytes() grows with the channels");
+}
+
+} // anonymous namespace
+
+void* operator new(std::size_t n)
+{
+	++allocations;
+	void* const p = std::malloc(n ? n : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+int main()
+{
+	test_waplns_bank();
+	test_uniform_bank();
+	test_warped_lattice_bank();
+	test_telemetry_shaper();
+	test_masking_model();
+	test_buffer();
+	return test_result();
+}
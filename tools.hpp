@@ -1,11 +1,59 @@
 #ifndef TOOLS_HPP_INCLUDED
 #define TOOLS_HPP_INCLUDED
 
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
 template<class T>
 struct identity
 {
 	typedef T type;
 };
 
+/**
+ * Rounds to the nearest integer (ties to even) for |v| < 2^22 by adding
+ * 1.5*2^23, which pushes the fraction bits out of the mantissa. Unlike
+ * std::lrint this never becomes a libm call when math errno handling is
+ * enabled (the default), which matters per sample. Out of range and NaN
+ * inputs are undefined behaviour (the cast overflows), so callers clamp
+ * first with compares that a NaN fails.
+ */
+inline long round_to_long(float v)
+{
+	return static_cast<long>(v + 12582912.0f) - 12582912L;
+}
+
+/**
+ * Cheap timestamps for cost accounting: the TSC where there is one (a
+ * constant rate counter on current x86, not core cycles under frequency
+ * scaling), else CLOCK_MONOTONIC in ns. Bracket the measured code with
+ * cycle_count() and cycle_count_end(); the latter is rdtscp, which waits
+ * for the code before it to finish.
+ */
+inline uint64_t cycle_count()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return uint64_t(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+inline uint64_t cycle_count_end()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned aux;
+	return __rdtscp(&aux);
+#else
+	return cycle_count();
+#endif
+}
+
 #endif // TOOLS_HPP_INCLUDED
 
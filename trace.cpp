@@ -0,0 +1,187 @@
+
+/*
+ * Ring protocol: the owner thread writes slot head & mask after a release
+ * fence and then publishes head+1 (release). The dumper reads head, copies
+ * the last trace_ring_events slots and, after an acquire fence, reads head
+ * again. If a copied slot already held a newer event, the two fences make
+ * that event's head (at least) visible to the second read, so slots that
+ * may have been overwritten meanwhile (index <= head2 - capacity) are
+ * dropped. Slots are relaxed atomics, so a torn copy is impossible and
+ * there is no data race. On x86 both fences cost no instruction.
+ *
+ * Event word: bits 63..8 timestamp (ns), bits 7..1 stage, bit 0 begin.
+ *
+ * Rings are never freed, the dumper may be copying one at any time. When
+ * a registered thread exits its ring is marked free and the next thread
+ * that registers takes it over (preferring one of the same name, so a
+ * restarted worker keeps its track) and continues after the old events.
+ * Threads that come and go therefore need no more rings than were alive
+ * at once. The name is kept in relaxed atomics for the same reason as the
+ * slots.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <stdint.h>
+#include <vector>
+#include "trace.hpp"
+
+namespace { // anonymous
+
+const int name_len = 32;
+
+struct trace_ring
+{
+	std::atomic<char> name[name_len];
+	std::atomic<bool> free;
+	std::atomic<uint64_t> head;
+	std::atomic<uint64_t> slot[trace_ring_events];
+};
+
+std::atomic<bool> enabled(false);
+std::atomic<int> nrings(0);
+std::atomic<trace_ring*> rings[max_trace_threads];
+thread_local trace_ring* my_ring = 0;
+
+// releases the ring of a thread when it exits
+struct ring_owner
+{
+	~ring_owner()
+	{
+		if (my_ring) my_ring->free.store(true,std::memory_order_release);
+		my_ring = 0;
+	}
+};
+
+char const* const stage_names[trace_stage_count] = {
+	"read", "analyze", "shape", "pack", "write"
+};
+
+inline uint64_t now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void set_name(trace_ring & r, char const* name)
+{
+	int i = 0;
+	for (; i<name_len-1 && name[i]; ++i) r.name[i].store(name[i],std::memory_order_relaxed);
+	for (; i<name_len; ++i) r.name[i].store(0,std::memory_order_relaxed);
+}
+
+bool same_name(trace_ring const& r, char const* name)
+{
+	for (int i=0; i<name_len-1; ++i) {
+		if (r.name[i].load(std::memory_order_relaxed) != name[i]) return false;
+		if (!name[i]) return true;
+	}
+	return !name[name_len-1];
+}
+
+/** takes over a free ring, one named name if any; null if none is free */
+trace_ring* reuse_ring(char const* name)
+{
+	int const n = std::min(nrings.load(std::memory_order_acquire),max_trace_threads);
+	for (int pass=0; pass<2; ++pass) {
+		for (int t=0; t<n; ++t) {
+			trace_ring* r = rings[t].load(std::memory_order_acquire);
+			if (!r || !r->free.load(std::memory_order_relaxed)) continue;
+			if (pass == 0 && !same_name(*r,name)) continue;
+			bool expected = true;
+			if (r->free.compare_exchange_strong(expected,false,std::memory_order_acq_rel)) {
+				if (pass == 1) set_name(*r,name);
+				return r;
+			}
+		}
+	}
+	return 0;
+}
+
+} // anonymous namespace
+
+void trace_enable(bool on)
+{
+	enabled.store(on,std::memory_order_relaxed);
+}
+
+bool trace_enabled()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void trace_register_thread(char const* name)
+{
+	if (my_ring) return;
+	static thread_local ring_owner owner;
+	if ((my_ring = reuse_ring(name))) return;
+	trace_ring* r = new trace_ring;
+	set_name(*r,name);
+	r->free.store(false,std::memory_order_relaxed);
+	r->head.store(0,std::memory_order_relaxed);
+	for (int i=0; i<trace_ring_events; ++i) r->slot[i].store(0,std::memory_order_relaxed);
+	// registration is rare and off the real-time path, a CAS loop is fine
+	int slot = nrings.load(std::memory_order_relaxed);
+	while (slot < max_trace_threads
+		&& !nrings.compare_exchange_weak(slot,slot+1,std::memory_order_acq_rel)) {}
+	if (slot >= max_trace_threads) {
+		delete r;
+		return;
+	}
+	rings[slot].store(r,std::memory_order_release);
+	my_ring = r;
+}
+
+void trace_event(trace_stage stage, bool begin)
+{
+	if (!enabled.load(std::memory_order_relaxed)) return;
+	trace_ring* r = my_ring;
+	if (!r) return; // unregistered thread, no allocation here
+	uint64_t const h = r->head.load(std::memory_order_relaxed);
+	uint64_t const ev = (now_ns() << 8) | (uint64_t(stage) << 1) | (begin ? 1 : 0);
+	// pairs with the dumper's acquire fence, see the ring protocol
+	std::atomic_thread_fence(std::memory_order_release);
+	r->slot[h & (trace_ring_events-1)].store(ev,std::memory_order_relaxed);
+	r->head.store(h+1,std::memory_order_release);
+}
+
+void trace_dump_chrome(std::FILE* out)
+{
+	std::vector<uint64_t> copy(trace_ring_events);
+	std::fprintf(out,"{\"traceEvents\":[\n");
+	bool first = true;
+	int const n = std::min(nrings.load(std::memory_order_acquire),max_trace_threads);
+	for (int t=0; t<n; ++t) {
+		trace_ring const* r = rings[t].load(std::memory_order_acquire);
+		if (!r) continue; // registration in progress
+		char name[name_len];
+		for (int i=0; i<name_len; ++i) name[i] = r->name[i].load(std::memory_order_relaxed);
+		name[name_len-1] = 0;
+		std::fprintf(out,"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+			"\"tid\":%d,\"args\":{\"name\":\"%s\"}}",first ? "" : ",\n",t,name);
+		first = false;
+		uint64_t const h1 = r->head.load(std::memory_order_acquire);
+		uint64_t const begin = h1 > uint64_t(trace_ring_events) ? h1 - trace_ring_events : 0;
+		for (uint64_t i=begin; i<h1; ++i) {
+			copy[i-begin] = r->slot[i & (trace_ring_events-1)].load(std::memory_order_relaxed);
+		}
+		// the slot loads are relaxed, an acquire load of head would not keep
+		// them before it; the fence does, so a slot the owner overwrote
+		// while we copied has an index of at most h2 - capacity
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t const h2 = r->head.load(std::memory_order_relaxed);
+		uint64_t const valid = h2 >= uint64_t(trace_ring_events) ? h2 + 1 - trace_ring_events : 0;
+		for (uint64_t i=std::max(begin,valid); i<h1; ++i) {
+			uint64_t const ev = copy[i-begin];
+			int const stage = static_cast<int>((ev >> 1) & 0x7f);
+			if (stage >= trace_stage_count) continue;
+			std::fprintf(out,",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+				"\"pid\":1,\"tid\":%d}",stage_names[stage],(ev & 1) ? 'B' : 'E',
+				(ev >> 8) * 1e-3,t);
+		}
+	}
+	std::fprintf(out,"\n]}\n");
+	std::fflush(out);
+}
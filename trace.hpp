@@ -0,0 +1,67 @@
+#ifndef TRACE_HPP_INCLUDED
+#define TRACE_HPP_INCLUDED
+
+#include <cstdio>
+
+/**
+ * Optional timeline tracing of pipeline stages.
+ *
+ * Every thread records stage begin/end events into its own fixed-size
+ * ring (single writer, overwrites the oldest events, no locks). Each event
+ * is one 64 bit word: timestamp in ns, stage and begin/end bit. A dumper
+ * may copy the rings at any time and writes them as Chrome trace JSON,
+ * which chrome://tracing and ui.perfetto.dev display as one track per
+ * thread.
+ *
+ * Tracing is compiled in only with WAPLNS_TRACE defined; otherwise
+ * WAPLNS_TRACE_SCOPE() expands to nothing. When compiled in, recording is
+ * still off until trace_enable(true). A thread should call
+ * trace_register_thread() once at startup, before any real-time work,
+ * since that allocates its ring. When the thread exits, its ring (with
+ * the events so far) goes to the next thread that registers, so at most
+ * max_trace_threads threads can be traced at once, not in total.
+ */
+
+enum trace_stage
+{
+	trace_read,
+	trace_analyze,
+	trace_shape,
+	trace_pack,
+	trace_write,
+	trace_stage_count
+};
+
+const int trace_ring_events = 1 << 14;
+const int max_trace_threads = 64;
+
+void trace_enable(bool on);
+bool trace_enabled();
+/** registers the calling thread under a display name */
+void trace_register_thread(char const* name);
+void trace_event(trace_stage stage, bool begin);
+/** writes all rings as Chrome trace JSON; safe while threads record */
+void trace_dump_chrome(std::FILE* out);
+
+class trace_scope
+{
+	trace_stage stage_;
+
+	trace_scope(trace_scope const&);
+	trace_scope& operator=(trace_scope const&);
+
+public:
+	explicit trace_scope(trace_stage s) : stage_(s) { trace_event(stage_,true); }
+	~trace_scope() { trace_event(stage_,false); }
+};
+
+#ifdef WAPLNS_TRACE
+#define WAPLNS_TRACE_CONCAT2(a,b) a##b
+#define WAPLNS_TRACE_CONCAT(a,b) WAPLNS_TRACE_CONCAT2(a,b)
+#define WAPLNS_TRACE_SCOPE(stage) \
+	trace_scope WAPLNS_TRACE_CONCAT(trace_scope_,__LINE__)(stage)
+#else
+#define WAPLNS_TRACE_SCOPE(stage)
+#endif
+
+#endif // TRACE_HPP_INCLUDED
@@ -0,0 +1,94 @@
+
+/*
+ * Channels beyond channels_ in the last group get x=0 and start with zero
+ * state, so they stay zero. Orders above the unrolled ones work on t_ in
+ * place; the state of a group is max_order_ vectors, laid out group after
+ * group so that one group's state is contiguous.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include "uniform_bank.hpp"
+
+uniform_bank::uniform_bank(int channels, int max_order)
+: own_(0)
+{
+	workspace_spec const spec(max_order,0,channels);
+	own_ = new workspace_buffer(workspace_bytes(spec));
+	workspace_arena ws(own_->data(),own_->size());
+	layout(ws,spec,this);
+	init(spec);
+}
+
+uniform_bank::uniform_bank(workspace_spec const& spec, void* mem,
+	std::size_t bytes)
+: own_(0)
+{
+	workspace_arena ws(mem,bytes);
+	layout(ws,spec,this);
+	init(spec);
+}
+
+uniform_bank::~uniform_bank()
+{
+	delete own_;
+}
+
+std::size_t uniform_bank::workspace_bytes(workspace_spec const& spec)
+{
+	workspace_arena ws;
+	layout(ws,spec,0);
+	return ws.used();
+}
+
+void uniform_bank::layout(workspace_arena & ws, workspace_spec const& spec,
+	uniform_bank* b)
+{
+	std::size_t const ng = (spec.channels + bank_lanes - 1) / bank_lanes;
+	ws.take(b ? &b->t_ : 0,ng * spec.order);
+	ws.take(b ? &b->u_ : 0,ng);
+}
+
+void uniform_bank::init(workspace_spec const& spec)
+{
+	assert(0 < spec.order && spec.order <= max_wapl_filt_order);
+	channels_ = spec.channels;
+	max_order_ = spec.order;
+	t_.resize(t_.capacity());
+	u_.resize(u_.capacity());
+	reset_state();
+}
+
+void uniform_bank::set_params(float lam, int ord, float const* k)
+{
+	assert(0 <= ord && ord <= max_order_);
+	// t_ has room for max_order_ stages, also where asserts are off
+	ord = std::max(0,std::min(ord,max_order_));
+	int const old = proto_.order();
+	proto_.set_params(lam,ord,k);
+	float const s2v = s2();
+	for (int g=0; g<groups(); ++g) {
+		lane_vec* t = &t_[g*max_order_];
+		for (int i=old; i<ord; ++i) t[i] = lane_vec{};
+		u_[g] = derived_u_uniform(ord,lam,s2v,k,t);
+	}
+}
+
+void uniform_bank::reset_state()
+{
+	std::fill(t_.begin(),t_.end(),lane_vec{});
+	std::fill(u_.begin(),u_.end(),lane_vec{});
+}
+
+waplns uniform_bank::channel(int ch) const
+{
+	assert(0 <= ch && ch < channels_);
+	int const g = ch / bank_lanes;
+	int const l = ch % bank_lanes;
+	waplns ns = proto_;
+	waplns::state st;
+	for (int i=0; i<order(); ++i) st.t[i] = t_[g*max_order_ + i][l];
+	st.u = u_[g][l];
+	ns.set_state(st);
+	return ns;
+}
@@ -0,0 +1,150 @@
+#ifndef UNIFORM_BANK_HPP_INCLUDED
+#define UNIFORM_BANK_HPP_INCLUDED
+
+#include "lane_kernels.hpp"
+#include "waplns.hpp"
+#include "workspace.hpp"
+
+/**
+ * Noise shapers for the channels of one multichannel signal that all use
+ * the same parameters (lambda, k). Unlike waplns_bank, which keeps k, lam
+ * and s2 per lane, the parameters are scalars here and only t[] and u are
+ * per channel, bank_lanes channels per group. A lattice stage then loads
+ * nothing but its t (or nothing at all: for orders up to
+ * max_unrolled_order the state of uniform_groups groups is held in
+ * registers for a whole block), and changing the parameters is one
+ * set_params() instead of one per channel.
+ *
+ * Results match waplns_bank (both compute in float) up to the rounding
+ * differences of contracted multiply-adds.
+ */
+class uniform_bank
+{
+	int channels_;
+	int max_order_;
+	waplns proto_;                // parameters and derived s2
+	workspace_buffer* own_;
+	ws_array<lane_vec> t_;        // t[group * max_order_ + stage]
+	ws_array<lane_vec> u_;        // u[group]
+
+	uniform_bank(uniform_bank const&);
+	uniform_bank& operator=(uniform_bank const&);
+
+	static void layout(workspace_arena & ws, workspace_spec const& spec,
+		uniform_bank* b);
+	void init(workspace_spec const& spec);
+	int groups() const { return (channels_ + bank_lanes - 1) / bank_lanes; }
+	float s2() const { return 1.0f / proto_.warp_gain(); }
+
+	template<int Order, class Quant>
+	void run(Quant & quant, int g0, float const* const* in,
+		typename Quant::code_type* const* out, int count);
+
+public:
+	/** groups shaped side by side, to hide the latency of the lattice */
+	static const int uniform_groups = 2;
+	/** highest order with the state in registers */
+	static const int max_unrolled_order = 8;
+
+	/** allocates the state for channels channels of order up to max_order */
+	explicit uniform_bank(int channels, int max_order = max_wapl_filt_order);
+	/** spec.channels channels of order up to spec.order in caller memory */
+	uniform_bank(workspace_spec const& spec, void* mem, std::size_t bytes);
+	~uniform_bank();
+
+	static std::size_t workspace_bytes(workspace_spec const& spec);
+
+	int channels() const { return channels_; }
+	int order() const { return proto_.order(); }
+	float lambda() const { return proto_.lambda(); }
+
+	/**
+	 * New parameters for all channels, with the semantics of
+	 * waplns::set_params(): the state is kept (new stages start at zero)
+	 * and u is recomputed.
+	 */
+	void set_params(float lam, int ord, float const* k);
+	void reset_state();
+
+	/** copy of channel ch's shaper including its current state */
+	waplns channel(int ch) const;
+
+	/**
+	 * Shapes count samples of every channel: in[ch] / out[ch] are the
+	 * signal and the output of channel ch. Quant is a quantizer policy as
+	 * used by shape_block().
+	 */
+	template<class Quant>
+	void process(Quant & quant, float const* const* in,
+		typename Quant::code_type* const* out, int count);
+};
+
+template<class Quant>
+void uniform_bank::process(Quant & quant, float const* const* in,
+	typename Quant::code_type* const* out, int count)
+{
+	for (int g0=0; g0<groups(); g0+=uniform_groups) {
+		switch (proto_.order()) {
+		case 1: run<1>(quant,g0,in,out,count); break;
+		case 2: run<2>(quant,g0,in,out,count); break;
+		case 3: run<3>(quant,g0,in,out,count); break;
+		case 4: run<4>(quant,g0,in,out,count); break;
+		case 5: run<5>(quant,g0,in,out,count); break;
+		case 6: run<6>(quant,g0,in,out,count); break;
+		case 7: run<7>(quant,g0,in,out,count); break;
+		case 8: run<8>(quant,g0,in,out,count); break;
+		default: run<0>(quant,g0,in,out,count); break;
+		}
+	}
+}
+
+/*
+ * Shapes groups g0 .. g0+uniform_groups-1. Order > 0 works on local
+ * copies of the state, Order = 0 on t_ with the run time order.
+ */
+template<int Order, class Quant>
+void uniform_bank::run(Quant & quant, int g0, float const* const* in,
+	typename Quant::code_type* const* out, int count)
+{
+	int const ng = std::min(uniform_groups,groups()-g0);
+	int const ord = proto_.order();
+	float const lam = proto_.lambda();
+	float const s2v = s2();
+	float k[max_wapl_filt_order];
+	for (int i=0; i<ord; ++i) k[i] = proto_.k(i);
+	int nl[uniform_groups];
+	lane_vec u[uniform_groups];
+	lane_vec t[uniform_groups][Order ? Order : 1];
+	for (int g=0; g<ng; ++g) {
+		nl[g] = std::min(channels_ - (g0+g)*bank_lanes,bank_lanes);
+		u[g] = u_[g0+g];
+		for (int i=0; i<Order; ++i) t[g][i] = t_[(g0+g)*max_order_ + i];
+	}
+	for (int n=0; n<count; ++n) {
+		for (int g=0; g<ng; ++g) {
+			int const c0 = (g0+g)*bank_lanes;
+			// scalar quantizer, lanes staged through arrays
+			alignas(32) float w[bank_lanes];
+			alignas(32) float x[bank_lanes] = {0};
+			lanes(w) = -u[g];
+			for (int l=0; l<nl[g]; ++l) {
+				float const wl = in[c0+l][n] + w[l];
+				float qlin;
+				out[c0+l][n] = quant.quantize(wl,qlin);
+				x[l] = quant.clamp_error(qlin - wl);
+			}
+			if (Order) {
+				lattice_lanes_uniform<Order ? Order : 1>(lam,s2v,k,u[g],t[g],lanes(x));
+			} else {
+				lattice_lanes_uniform(ord,lam,s2v,k,u[g],&t_[(g0+g)*max_order_],
+					lanes(x));
+			}
+		}
+	}
+	for (int g=0; g<ng; ++g) {
+		u_[g0+g] = u[g];
+		for (int i=0; i<Order; ++i) t_[(g0+g)*max_order_ + i] = t[g][i];
+	}
+}
+
+#endif // UNIFORM_BANK_HPP_INCLUDED
@@ -50,48 +50,10 @@
  */
 
 #include <algorithm>
+#include <cassert>
 #include <cmath>
+#include "lattice_kernels.hpp"
 #include "waplns.hpp"
-#include "tools.hpp"
-
-namespace { // anonymous
-
-template<class T>
-inline void lattice_step(T & a, T & b,   // 4 FLOPS
-	typename identity<T>::type k)
-{
-	T const ak = a * k;
-	a -= b*k;
-	b -= ak;
-}
-
-inline void apply_D_alter_t(double & io, float & t, float lambda) // 4 FLOPS
-{
-	float next_t = io + lambda * t;
-	io = t - lambda * next_t;
-	t = next_t;
-}
-
-inline void apply_D_keep_t(double & io, float t, float lambda) // 4 FLOPS
-{
-	float next_t = io + lambda * t;
-	io = t - lambda * next_t;
-}
-
-} // anonymous namespace
-
-void waplns::precompute_derived_params()
-{
-	const double negative_lam = -lambda_;
-	double a = 1;
-	double b = 1;
-	for (int i=0; i<order_; ++i) {
-		b *= negative_lam;
-		lattice_step(a,b,k_[i]);
-	}
-	s1_ = 1.0f;
-	s2_ = static_cast<float>( 1.0/a );
-}
 
 void waplns::set_params(const float lam, int ord, float const* newk)
 {
@@ -104,17 +66,37 @@ void waplns::set_params(const float lam, int ord, float const* newk)
 	}
 	this->lambda_ = lam;
 	this->order_ = neword;
-	precompute_derived_params();
-	double nua = 0;
-	double nub = 0;
-	for (int i=0; i<order_; ++i) {
-		const float k = this->k_[i];
-		apply_D_keep_t(nub,t_[i],lam);
-		lattice_step(nua,nub,k);
-	}
+	update_derived_and_u();
+}
+
+void waplns::update_derived_and_u()
+{
+	// derived parameters (s1, s2) and next_u_ in a single pass
+	double nua;
+	double const a = lattice_derived(order_,lambda_,k_,t_,nua);
+	s1_ = 1.0f;
+	s2_ = static_cast<float>( 1.0/a );
 	next_u_ = nua * s2_;
 }
 
+void waplns::set_lambda(const float lam)
+{
+	if (lam == lambda_) return;
+	lambda_ = lam;
+	update_derived_and_u();
+}
+
+void waplns::set_k(int first, int count, float const* newk)
+{
+	assert(0<=first && 0<=count && first+count<=order_);
+	bool changed = false;
+	for (int i=0; i<count; ++i) {
+		changed = changed || k_[first+i] != newk[i];
+		k_[first+i] = newk[i];
+	}
+	if (changed) update_derived_and_u();
+}
+
 void waplns::reset_state()
 {
 	for (int i=0; i<order_; ++i) {
@@ -125,23 +107,32 @@ void waplns::reset_state()
 
 void waplns::x_was(float x)  // 16 * order + 3 FLOPS
 {
+	if (lambda_ == 0) {
+		x_was_unwarped(x);
+		return;
+	}
 	// y + u = x  <=>  y = x - u
 	double const y = static_cast<double>(x) - next_u_;
-	double a = y * s1_;
-	double b = a;
-	double nua = 0;
-	double nub = 0;
-	const float lam = lambda_;
+	next_u_ = lattice_push(order_,lambda_,k_,t_,y * s1_) * s2_;
+}
+
+void waplns::x_was_unwarped(float x)  // 6 * order + 1 FLOPS
+{
+	next_u_ = lattice_push_unwarped(order_,k_,t_,static_cast<double>(x) - next_u_);
+}
+
+void waplns::get_state(state & st) const
+{
 	for (int i=0; i<order_; ++i) {
-		const float k = this->k_[i];
-		apply_D_alter_t( b,t_[i],lam);
-		apply_D_keep_t(nub,t_[i],lam);
-		lattice_step(  a,  b,k);
-		lattice_step(nua,nub,k);
+		st.t[i] = t_[i];
 	}
-	next_u_ = nua * s2_;
-	// next_u is only a linear combination of the ts which
-	// could be computed with 2*order FLOPS instead of 8*order FLOPS
-	// assuming we know the weights (not yet precomputed).
+	st.u = next_u_;
 }
 
+void waplns::set_state(state const& st)
+{
+	for (int i=0; i<order_; ++i) {
+		t_[i] = st.t[i];
+	}
+	next_u_ = st.u;
+}
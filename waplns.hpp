@@ -1,7 +1,9 @@
 #ifndef WAPLNS_HPP_INCLUDED
 #define WAPLNS_HPP_INCLUDED
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
 const int max_wapl_filt_order = 32;
 
@@ -54,6 +56,9 @@ const int max_wapl_filt_order = 32;
  * The filter that turns x into y ("shapes x") is a frequency-warped
  * all-pole lattice filter. It is parameterized by order, k[i] (parcor
  * coefficients for 0 <= i < order) and a warping parameter lambda.
+ * With lambda = 0 the allpasses are plain unit delays and x_was() runs a
+ * classic lattice at less than half the cost; parameters and state mean
+ * the same in both cases, so switching lambda mid-stream is seamless.
  */
 class waplns
 {
@@ -70,9 +75,17 @@ class waplns
 	float t_[max_wapl_filt_order];
 	float next_u_;
 
-	void precompute_derived_params();
+	void update_derived_and_u();
+	void x_was_unwarped(float x);
 
 public:
+	/** filter state that can be saved and restored (t[] up to order) */
+	struct state
+	{
+		float t[max_wapl_filt_order];
+		float u;
+	};
+
 	waplns() : order_(0), lambda_(0), s1_(1), s2_(1), next_u_(0) {}
 
 	float warp_gain() const { return 1.0 / s1_ / s2_; }
@@ -86,10 +99,31 @@ public:
 	template<class Iter>
 	void set_params(float lam, int ord, Iter it);
 
+	/**
+	 * Incremental updates for high-rate adaptation: they keep the order,
+	 * touch only what changes and redo the derived parameters and u in a
+	 * single pass. set_k() replaces k[first] ... k[first+count-1].
+	 */
+	void set_lambda(float lam);
+	void set_k(int first, int count, float const* newk);
+
 	void reset_state();
+	/**
+	 * Resets the state if it holds a NaN or inf, e.g. after a NaN sample;
+	 * false if it did. u mixes all of t[], so one check of u covers it.
+	 */
+	bool check_state()
+	{
+		if (std::fabs(next_u_) < 1e30f) return true;
+		reset_state();
+		return false;
+	}
 	float u() const { return next_u_; }
 	void x_was(float x);
 
+	void get_state(state & st) const;
+	void set_state(state const& st);
+
 	//void show_state(std::ostream &);
 };
 
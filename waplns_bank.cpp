@@ -0,0 +1,685 @@
+
+/*
+ * Packing: with the streams sorted by descending order o[0] >= o[1] >= ...
+ * an optimal grouping only ever puts consecutive streams together, and a
+ * group's cost is the order of its first stream (plus group_overhead).
+ * So the minimal cost follows from a simple DP over the sorted list:
+ *
+ *    cost[i] = min_{1 <= len <= bank_lanes} o[i] + overhead + cost[i+len]
+ *
+ * which is O(streams * bank_lanes).
+ *
+ * Lanes beyond nlanes have k=0, t=0 and get x=0, so they stay zero and
+ * cost nothing but the executed lanes. Stages beyond a lane's order have
+ * k=0 but not t=0: the warped delay chain still carries the lane's signal
+ * through them, so their t fills up, yet with k=0 nothing of it reaches u.
+ * Whatever reads a lane's state (lane_to_waplns(), move_lane(),
+ * note_decay()) therefore looks at the stream's own stages only.
+ *
+ * Activity: parking and waking costs a few lane moves per stream that
+ * changed, not a repack. The last group is the filler: a parked stream's
+ * hole takes the last lane of the last group if it fits the hole's group
+ * order (after a repack the last group has the lowest order), else the
+ * last lane of its own group; a group left empty is replaced by the last
+ * one. A woken stream goes to a free lane of the last group, raising the
+ * group's order if needed (cheaper than a new group, which costs the
+ * order plus overhead), or opens a new group. Stages above the group's
+ * order and lanes above nlanes are kept zero throughout. useful_ and
+ * executed_ track the packing; when useful_ / executed_ drops by
+ * repack_slack below its value after the last repack, the next process()
+ * repacks. The per-block work for a parked stream is the peak scan of
+ * its input (plus quantizing it), so the cost is dominated by the active
+ * streams.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include "checkpoint.hpp"
+#include "lane_kernels.hpp"
+#include "rt_log.hpp"
+#include "waplns_bank.hpp"
+
+namespace { // anonymous
+
+// relative loss of packing utilization that triggers a repack
+const double repack_slack = 0.1;
+
+} // anonymous namespace
+
+waplns_bank::waplns_bank(int max_streams)
+: max_streams_(max_streams), own_(0)
+{
+	workspace_spec const spec(max_wapl_filt_order,0,max_streams);
+	own_ = new workspace_buffer(workspace_bytes(spec));
+	workspace_arena ws(own_->data(),own_->size());
+	layout(ws,max_streams,this);
+	init();
+}
+
+waplns_bank::waplns_bank(workspace_spec const& spec, void* mem, std::size_t bytes)
+: max_streams_(spec.channels), own_(0)
+{
+	workspace_arena ws(mem,bytes);
+	layout(ws,max_streams_,this);
+	init();
+}
+
+waplns_bank::~waplns_bank()
+{
+	delete own_;
+}
+
+std::size_t waplns_bank::workspace_bytes(workspace_spec const& spec)
+{
+	workspace_arena ws;
+	layout(ws,spec.channels,0);
+	return ws.used();
+}
+
+void waplns_bank::layout(workspace_arena & ws, std::size_t n, waplns_bank* b)
+{
+	ws.take(b ? &b->streams_ : 0,n);
+	ws.take(b ? &b->groups_ : 0,n);
+	ws.take(b ? &b->sorted_ : 0,n);
+	ws.take(b ? &b->cost_ : 0,n+1);
+	ws.take(b ? &b->cut_ : 0,n+1);
+	ws.take(b ? &b->parked_ : 0,n);
+	ws.take(b ? &b->touched_ : 0,n);
+}
+
+void waplns_bank::init()
+{
+	needs_repack_ = false;
+	useful_ = 0;
+	executed_ = 0;
+	repack_use_ = 1;
+	silence_ = 0;
+	decay_ = 0;
+	parks_ = 0;
+	wakeups_ = 0;
+	account_every_ = 0;
+	block_no_ = 0;
+	update_no_ = 0;
+	sampled_blocks_ = 0;
+	log_ = 0;
+	log_source_ = 0;
+	storm_ = -1;
+}
+
+int waplns_bank::add_stream(float lam, int ord, float const* k)
+{
+	assert(streams() < max_streams_);
+	stream_rec r;
+	r.ns.set_params(lam,ord,k);
+	r.param_id = 0;
+	r.cycles = 0;
+	r.blocks = 0;
+	r.update_cycles = 0;
+	r.updates = 0;
+	r.group = -1;
+	r.lane = -1;
+	r.parked = false;
+	r.decayed = true;
+	streams_.push_back(r);
+	needs_repack_ = true;
+	return streams() - 1;
+}
+
+void waplns_bank::lane_to_waplns(group const& g, int lane, waplns & ns)
+{
+	// the group holds the current parameters (see update_params())
+	float k[max_wapl_filt_order];
+	waplns::state st;
+	int const ord = ns.order();
+	for (int i=0; i<ord; ++i) {
+		k[i] = g.k[i][lane];
+		st.t[i] = g.t[i][lane];
+	}
+	st.u = g.u[lane];
+	ns.set_params(g.lam[lane],ord,k);
+	ns.set_state(st);
+}
+
+void waplns_bank::pull_lane(int gi, int lane)
+{
+	group const& g = groups_[gi];
+	lane_to_waplns(g,lane,streams_[g.stream[lane]].ns);
+}
+
+void waplns_bank::push_lane(int gi, int lane)
+{
+	group & g = groups_[gi];
+	stream_rec const& r = streams_[g.stream[lane]];
+	waplns::state st;
+	r.ns.get_state(st);
+	int const ord = r.ns.order();
+	for (int i=0; i<g.order; ++i) {
+		g.k[i][lane] = i<ord ? r.ns.k(i) : 0.0f;
+		g.t[i][lane] = i<ord ? st.t[i] : 0.0f;
+	}
+	g.lam[lane] = r.ns.lambda();
+	g.s2[lane] = 1.0f / r.ns.warp_gain();
+	g.u[lane] = st.u;
+}
+
+void waplns_bank::clear_lane(group & g, int lane)
+{
+	g.stream[lane] = -1;
+	g.lam[lane] = 0;
+	g.s2[lane] = 1;
+	g.u[lane] = 0;
+	for (int i=0; i<g.order; ++i) {
+		g.k[i][lane] = 0;
+		g.t[i][lane] = 0;
+	}
+}
+
+void waplns_bank::move_lane(int from_g, int from_lane, int to_g, int to_lane)
+{
+	group & f = groups_[from_g];
+	group & d = groups_[to_g];
+	int const id = f.stream[from_lane];
+	int const ord = streams_[id].ns.order();
+	assert(ord <= d.order);
+	for (int i=0; i<d.order; ++i) {
+		d.k[i][to_lane] = i<ord ? f.k[i][from_lane] : 0.0f;
+		d.t[i][to_lane] = i<ord ? f.t[i][from_lane] : 0.0f;
+	}
+	d.lam[to_lane] = f.lam[from_lane];
+	d.s2[to_lane] = f.s2[from_lane];
+	d.u[to_lane] = f.u[from_lane];
+	d.stream[to_lane] = id;
+	streams_[id].group = to_g;
+	streams_[id].lane = to_lane;
+	clear_lane(f,from_lane);
+}
+
+void waplns_bank::insert_lane(int id)
+{
+	stream_rec & r = streams_[id];
+	int const ord = r.ns.order();
+	if (groups_.empty() || groups_.back().nlanes == bank_lanes) {
+		groups_.push_back(group());
+		group & g = groups_.back();
+		g.order = ord;
+		g.nlanes = 0;
+		g.dirty = 0;
+		for (int l=0; l<bank_lanes; ++l) clear_lane(g,l);
+		executed_ += ord + group_overhead;
+	}
+	int const gi = static_cast<int>(groups_.size()) - 1;
+	group & g = groups_[gi];
+	if (g.order < ord) {
+		// the stages above the old order are zero in every lane
+		executed_ += ord - g.order;
+		g.order = ord;
+	}
+	int const l = g.nlanes++;
+	g.stream[l] = id;
+	r.group = gi;
+	r.lane = l;
+	push_lane(gi,l);
+	useful_ += ord;
+}
+
+void waplns_bank::remove_lane(int gi, int lane)
+{
+	// the stream's state is already home, only the lane goes
+	useful_ -= streams_[groups_[gi].stream[lane]].ns.order();
+	int const last = static_cast<int>(groups_.size()) - 1;
+	group const& lg = groups_[last];
+	int from = gi;
+	if (gi != last && streams_[lg.stream[lg.nlanes-1]].ns.order() <= groups_[gi].order) {
+		from = last;
+	}
+	group & f = groups_[from];
+	int const fl = f.nlanes - 1;
+	if (from == gi && fl == lane) {
+		clear_lane(f,lane);
+	} else {
+		move_lane(from,fl,gi,lane);
+	}
+	if (--f.nlanes > 0) return;
+	executed_ -= f.order + group_overhead;
+	if (from != last) {
+		groups_[from] = groups_[last];
+		group const& g = groups_[from];
+		for (int l=0; l<g.nlanes; ++l) streams_[g.stream[l]].group = from;
+	}
+	groups_.resize(last);
+}
+
+void waplns_bank::set_params(int id, float lam, int ord, float const* k)
+{
+	bool const sample = sample_update();
+	uint64_t const c0 = sample ? cycle_count() : 0;
+	stream_rec & r = streams_[id];
+	if (r.group < 0) {
+		r.ns.set_params(lam,ord,k);
+	} else {
+		pull_lane(r.group,r.lane);
+		int const old = r.ns.order();
+		r.ns.set_params(lam,ord,k);
+		if (r.ns.order() <= groups_[r.group].order) {
+			useful_ += r.ns.order() - old;
+			push_lane(r.group,r.lane);
+		} else {
+			// the lane no longer fits, the state now lives in r.ns
+			r.group = -1;
+			r.lane = -1;
+			needs_repack_ = true;
+		}
+	}
+	if (sample) {
+		r.update_cycles += cycle_count_end() - c0;
+		++r.updates;
+	}
+}
+
+void waplns_bank::reset_state(int id)
+{
+	stream_rec & r = streams_[id];
+	if (r.group >= 0) pull_lane(r.group,r.lane);
+	r.ns.reset_state();
+	if (r.group >= 0) push_lane(r.group,r.lane);
+}
+
+waplns waplns_bank::stream(int id) const
+{
+	stream_rec const& r = streams_[id];
+	waplns ns = r.ns;
+	if (r.group >= 0) lane_to_waplns(groups_[r.group],r.lane,ns);
+	return ns;
+}
+
+void waplns_bank::update_params(int n, int const* ids,
+	float const* lams, float const* const* ks)
+{
+	bool const sample = n > 0 && sample_update();
+	uint64_t const c0 = sample ? cycle_count() : 0;
+	touched_.clear();
+	for (int j=0; j<n; ++j) {
+		stream_rec & r = streams_[ids[j]];
+		int const ord = r.ns.order();
+		if (r.group < 0) {
+			r.ns.set_params(lams[j],ord,ks[j]);
+			continue;
+		}
+		group & g = groups_[r.group];
+		if (!g.dirty) touched_.push_back(r.group);
+		g.dirty |= 1u << r.lane;
+		g.lam[r.lane] = lams[j];
+		for (int i=0; i<ord; ++i) g.k[i][r.lane] = ks[j][i];
+	}
+	for (std::size_t i=0; i<touched_.size(); ++i) {
+		group & g = groups_[touched_[i]];
+		int mask[bank_lanes];
+		for (int l=0; l<bank_lanes; ++l) mask[l] = (g.dirty >> l) & 1;
+		derived_lanes(g.order,g.lam,g.s2,g.u,g.k,g.t,mask);
+		g.dirty = 0;
+	}
+	if (sample) {
+		uint64_t const share = (cycle_count_end() - c0) / n;
+		for (int j=0; j<n; ++j) {
+			streams_[ids[j]].update_cycles += share;
+			++streams_[ids[j]].updates;
+		}
+	}
+}
+
+void waplns_bank::repack()
+{
+	// bring the state of all packed streams home
+	for (std::size_t gi=0; gi<groups_.size(); ++gi) {
+		for (int l=0; l<groups_[gi].nlanes; ++l) {
+			stream_rec const& r = streams_[groups_[gi].stream[l]];
+			if (r.group == static_cast<int>(gi) && r.lane == l) {
+				pull_lane(gi,l);
+			}
+		}
+	}
+
+	sorted_.clear();
+	for (int i=0; i<streams(); ++i) {
+		if (streams_[i].parked) {
+			streams_[i].group = -1;
+			streams_[i].lane = -1;
+		} else {
+			sorted_.push_back(i);
+		}
+	}
+	int const n = static_cast<int>(sorted_.size());
+	// descending order, ties by id: the order of a stable sort without its
+	// temporary buffer
+	ws_array<stream_rec> const& recs = streams_;
+	std::sort(sorted_.begin(),sorted_.end(),[&recs](int a, int b) {
+		int const oa = recs[a].ns.order(), ob = recs[b].ns.order();
+		return oa > ob || (oa == ob && a < b);
+	});
+
+	cost_.assign(n+1,0);
+	cut_.assign(n+1,n);
+	for (int i=n-1; i>=0; --i) {
+		int const head = streams_[sorted_[i]].ns.order() + group_overhead;
+		cost_[i] = -1;
+		for (int len=1; len<=bank_lanes && i+len<=n; ++len) {
+			int const c = head + cost_[i+len];
+			if (cost_[i] < 0 || c < cost_[i]) {
+				cost_[i] = c;
+				cut_[i] = i+len;
+			}
+		}
+	}
+
+	groups_.clear();
+	useful_ = 0;
+	executed_ = n ? cost_[0] : 0;
+	for (int i=0; i<n; i=cut_[i]) {
+		groups_.push_back(group());
+		int const gi = static_cast<int>(groups_.size()) - 1;
+		group & g = groups_.back();
+		g.order = streams_[sorted_[i]].ns.order();
+		g.nlanes = cut_[i] - i;
+		g.dirty = 0;
+		for (int l=0; l<bank_lanes; ++l) {
+			g.stream[l] = -1;
+			g.lam[l] = 0;
+			g.s2[l] = 1;
+			g.u[l] = 0;
+			for (int s=0; s<max_wapl_filt_order; ++s) {
+				g.k[s][l] = 0;
+				g.t[s][l] = 0;
+			}
+		}
+		for (int l=0; l<g.nlanes; ++l) {
+			int const id = sorted_[i+l];
+			g.stream[l] = id;
+			streams_[id].group = gi;
+			streams_[id].lane = l;
+			push_lane(gi,l);
+			useful_ += streams_[id].ns.order();
+		}
+	}
+	repack_use_ = executed_ ? double(useful_) / executed_ : 1.0;
+	needs_repack_ = false;
+}
+
+void waplns_bank::set_activity(float silence, float decay)
+{
+	silence_ = silence;
+	decay_ = decay;
+	if (silence_ <= 0) {
+		for (int i=0; i<streams(); ++i) {
+			if (streams_[i].parked) {
+				streams_[i].parked = false;
+				needs_repack_ = true;
+			}
+		}
+		parked_.clear();
+	}
+}
+
+void waplns_bank::update_activity(float const* const* in,
+	int const* counts, int count)
+{
+	if (silence_ <= 0) return;
+	parked_.clear();
+	for (int id=0; id<streams(); ++id) {
+		stream_rec & r = streams_[id];
+		int const n = counts ? counts[id] : count;
+		float const* s = in[id];
+		float peak = 0;
+		for (int i=0; i<n; ++i) peak = std::max(peak,std::fabs(s[i]));
+		bool const silent = peak < silence_;
+		// while a repack is pending the groups may hold stale lanes, the
+		// repack places everyone anyway
+		if (r.parked && !silent) {
+			r.parked = false;
+			r.ns.reset_state();
+			r.decayed = true;
+			if (!needs_repack_) insert_lane(id);
+			++wakeups_;
+		} else if (!r.parked && silent && r.decayed) {
+			int const g = r.group, l = r.lane;
+			if (g >= 0) pull_lane(g,l);
+			r.parked = true;
+			r.group = -1;
+			r.lane = -1;
+			if (!needs_repack_ && g >= 0) remove_lane(g,l);
+			++parks_;
+		}
+		if (r.parked) parked_.push_back(id);
+	}
+	if (executed_ && double(useful_) / executed_ < repack_use_ * (1 - repack_slack)) {
+		needs_repack_ = true;
+	}
+}
+
+void waplns_bank::note_decay(group const& g)
+{
+	for (int l=0; l<g.nlanes; ++l) {
+		stream_rec & r = streams_[g.stream[l]];
+		int const ord = r.ns.order();
+		float m = std::fabs(g.u[l]);
+		for (int i=0; i<ord; ++i) m = std::max(m,std::fabs(g.t[i][l]));
+		r.decayed = m < decay_;
+	}
+}
+
+void waplns_bank::check_state(group & g)
+{
+	for (int l=0; l<g.nlanes; ++l) {
+		// u mixes all of t[], so a NaN or inf anywhere shows up here
+		if (std::fabs(g.u[l]) < 1e30f) continue;
+		for (int i=0; i<g.order; ++i) g.t[i][l] = 0;
+		g.u[l] = 0;
+		if (log_) log_->log(rt_log_nan_state,log_source_,g.stream[l]);
+	}
+}
+
+void waplns_bank::note_clamps(group const& g, int const* clamped,
+	int const* counts, int count)
+{
+	if (!log_ || storm_ < 0) return;
+	for (int l=0; l<g.nlanes; ++l) {
+		int const id = g.stream[l];
+		int const n = counts ? counts[id] : count;
+		if (clamped[l] > storm_ * n) {
+			log_->log(rt_log_clamp_storm,log_source_,id,clamped[l],n);
+		}
+	}
+}
+
+void waplns_bank::step(group & g, float const* x)
+{
+	lattice_lanes<false>(g.order,g.lam,g.s2,g.u,g.k,g.t,x,0);
+}
+
+void waplns_bank::step_masked(group & g, float const* x, int const* mask)
+{
+	lattice_lanes<true>(g.order,g.lam,g.s2,g.u,g.k,g.t,x,mask);
+}
+
+waplns_bank::metrics waplns_bank::get_metrics() const
+{
+	metrics m;
+	m.streams = streams();
+	m.groups = static_cast<int>(groups_.size());
+	m.useful_stage_lanes = 0;
+	m.executed_stage_lanes = 0;
+	m.active = 0;
+	for (int i=0; i<m.streams; ++i) {
+		if (streams_[i].group < 0) continue;
+		m.useful_stage_lanes += streams_[i].ns.order();
+		++m.active;
+	}
+	m.parked = static_cast<int>(parked_.size());
+	m.parks = parks_;
+	m.wakeups = wakeups_;
+	for (int i=0; i<m.groups; ++i) {
+		m.executed_stage_lanes += groups_[i].order * bank_lanes;
+	}
+	m.lane_utilization = m.executed_stage_lanes ?
+		double(m.useful_stage_lanes) / m.executed_stage_lanes : 1.0;
+	m.account_every = account_every_;
+	m.sampled_blocks = sampled_blocks_;
+	return m;
+}
+
+void waplns_bank::set_accounting(int every)
+{
+	account_every_ = every > 0 ? every : 0;
+}
+
+bool waplns_bank::sample_block()
+{
+	if (!account_every_ || ++block_no_ % account_every_) return false;
+	++sampled_blocks_;
+	return true;
+}
+
+bool waplns_bank::sample_update()
+{
+	return account_every_ && ++update_no_ % account_every_ == 0;
+}
+
+void waplns_bank::charge_group(group const& g, uint64_t cycles, int const* counts)
+{
+	// shares by samples (equal without counts); the rounding remainder
+	// goes to the longest lane, so the lanes add up to cycles
+	uint64_t total = 0;
+	int longest = 0;
+	for (int l=0; l<g.nlanes; ++l) {
+		uint64_t const n = counts ? counts[g.stream[l]] : 1;
+		total += n;
+		if (counts && counts[g.stream[longest]] < counts[g.stream[l]]) longest = l;
+	}
+	uint64_t rest = cycles;
+	for (int l=0; l<g.nlanes; ++l) {
+		uint64_t const n = counts ? counts[g.stream[l]] : 1;
+		uint64_t const share = total ? cycles * n / total : 0;
+		streams_[g.stream[l]].cycles += share;
+		rest -= share;
+		++streams_[g.stream[l]].blocks;
+	}
+	streams_[g.stream[longest]].cycles += rest;
+}
+
+void waplns_bank::get_stream_costs(cost* out) const
+{
+	for (int id=0; id<streams(); ++id) {
+		stream_rec const& r = streams_[id];
+		cost & c = out[id];
+		c.param_id = r.param_id;
+		c.streams = 1;
+		c.blocks = r.blocks;
+		c.cycles = r.cycles;
+		c.updates = r.updates;
+		c.update_cycles = r.update_cycles;
+	}
+}
+
+int waplns_bank::get_preset_costs(cost* out, int max) const
+{
+	// out[0..n) stays sorted by param id, so finding an entry is a
+	// binary search and only a new id shifts entries
+	int n = 0;
+	for (int id=0; id<streams(); ++id) {
+		stream_rec const& r = streams_[id];
+		cost* const end = out + n;
+		cost* p = std::lower_bound(out,end,r.param_id,
+			[](cost const& c, unsigned pid) { return c.param_id < pid; });
+		if (p == end || p->param_id != r.param_id) {
+			if (n == max) continue;
+			std::copy_backward(p,end,end+1);
+			p->param_id = r.param_id;
+			p->streams = 0;
+			p->blocks = 0;
+			p->cycles = 0;
+			p->updates = 0;
+			p->update_cycles = 0;
+			++n;
+		}
+		++p->streams;
+		p->blocks += r.blocks;
+		p->cycles += r.cycles;
+		p->updates += r.updates;
+		p->update_cycles += r.update_cycles;
+	}
+	return n;
+}
+
+void waplns_bank::reset_costs()
+{
+	for (int id=0; id<streams(); ++id) {
+		stream_rec & r = streams_[id];
+		r.cycles = 0;
+		r.blocks = 0;
+		r.update_cycles = 0;
+		r.updates = 0;
+	}
+	sampled_blocks_ = 0;
+}
+
+void waplns_bank::save_state(bank_checkpoint & cp) const
+{
+	bank_checkpoint::record* const rec = cp.begin_save(streams());
+	if (!rec) return;
+	// packed streams group by group, so the lane-interleaved state is read
+	// in order; the others from their waplns
+	for (std::size_t gi=0; gi<groups_.size(); ++gi) {
+		group const& g = groups_[gi];
+		for (int l=0; l<g.nlanes; ++l) {
+			int const id = g.stream[l];
+			stream_rec const& r = streams_[id];
+			if (r.group != static_cast<int>(gi) || r.lane != l) continue;
+			bank_checkpoint::record & d = rec[id];
+			d.param_id = r.param_id;
+			d.order = r.ns.order();
+			d.lambda = g.lam[l];
+			d.u = g.u[l];
+			for (int i=0; i<d.order; ++i) d.t[i] = g.t[i][l];
+		}
+	}
+	for (int id=0; id<streams(); ++id) {
+		stream_rec const& r = streams_[id];
+		if (r.group >= 0) continue;
+		bank_checkpoint::record & d = rec[id];
+		waplns::state st;
+		r.ns.get_state(st);
+		d.param_id = r.param_id;
+		d.order = r.ns.order();
+		d.lambda = r.ns.lambda();
+		d.u = st.u;
+		for (int i=0; i<d.order; ++i) d.t[i] = st.t[i];
+	}
+	cp.end_save();
+}
+
+int waplns_bank::load_state(bank_checkpoint & cp)
+{
+	int n;
+	bank_checkpoint::record const* const rec = cp.read(n);
+	if (!rec) return 0;
+	int adopted = 0;
+	for (int id=0; id<std::min(n,streams()); ++id) {
+		stream_rec & r = streams_[id];
+		bank_checkpoint::record const& s = rec[id];
+		if (s.param_id != r.param_id || s.order != r.ns.order()) continue;
+		if (r.group >= 0) {
+			group & g = groups_[r.group];
+			for (int i=0; i<s.order; ++i) g.t[i][r.lane] = s.t[i];
+			g.u[r.lane] = s.u;
+		} else {
+			waplns::state st;
+			for (int i=0; i<s.order; ++i) st.t[i] = s.t[i];
+			st.u = s.u;
+			r.ns.set_state(st);
+		}
+		r.decayed = false;
+		++adopted;
+	}
+	return adopted;
+}
@@ -0,0 +1,397 @@
+#ifndef WAPLNS_BANK_HPP_INCLUDED
+#define WAPLNS_BANK_HPP_INCLUDED
+
+#include <stdint.h>
+#include "tools.hpp"
+#include "trace.hpp"
+#include "waplns.hpp"
+#include "workspace.hpp"
+
+const int bank_lanes = 8;
+
+class bank_checkpoint;
+class rt_log_ring;
+
+/**
+ * Quantizes the lanes of a group for one sample: for the lanes l with
+ * live[l] != 0, the code of w = s[l] - u[l] goes to c[l], the fed back
+ * error (after clamp_error()) to x[l], and clamped[l] counts the clamped
+ * errors; the other lanes get x[l] = 0. This one goes lane by lane
+ * through quantize(); a quantizer with a faster way for whole groups
+ * provides an overload (g711.hpp does).
+ */
+template<class Quant, int N>
+inline void quantize_lanes(Quant & quant, float const (&s)[N], float const* u,
+	typename Quant::code_type (&c)[N], float (&x)[N], int (&clamped)[N],
+	int const (&live)[N])
+{
+	for (int l=0; l<N; ++l) {
+		x[l] = 0;
+		if (!live[l]) continue;
+		float const w = s[l] - u[l];
+		float qlin;
+		c[l] = quant.quantize(w,qlin);
+		float const e = qlin - w;
+		x[l] = quant.clamp_error(e);
+		clamped[l] += x[l] != e;
+	}
+}
+
+/**
+ * A bank of many independent noise shapers processed bank_lanes streams
+ * at a time. Streams are packed into groups; a group keeps its parameters
+ * and t_[] state lane-interleaved (k[stage][lane]) so that one stage of the
+ * lattice is a handful of vector operations for all lanes of the group.
+ * The arithmetic is the one of waplns::x_was() done in float.
+ *
+ * A group runs as many stages as its highest-order lane. Lower-order lanes
+ * are padded with k=0 stages, which leave the lattice output unchanged.
+ * repack() sorts streams by order and splits them into groups so that the
+ * executed work (sum of group orders plus a fixed per-group overhead) is
+ * minimal, i.e. padding is only used when it beats opening another group.
+ *
+ * Streams keep their ids across repacks. set_params() updates a stream in
+ * place if it still fits its group; if its order grew beyond the group's,
+ * the bank repacks at the start of the next process().
+ *
+ * With set_activity(), process() parks streams whose input block is silent
+ * and whose state has decayed. Parked streams are not in any group, so they
+ * cost a peak scan of their input and a plain quantization, not a lattice
+ * pass. A parked stream wakes up with zeroed state (which it practically
+ * had anyway) as soon as its input exceeds the silence threshold again.
+ * Parking and waking move single lanes instead of repacking: the hole of
+ * a parked stream is filled from the last group, a woken stream takes a
+ * free lane of the last group or opens a new one. Once the packing got
+ * notably worse than after the last repack(), the bank repacks.
+ *
+ * All memory is laid out at construction, in caller memory or in a buffer
+ * the bank allocates once (see workspace.hpp); nothing allocates later.
+ *
+ * save_state() mirrors the state of all streams into a bank_checkpoint
+ * (see checkpoint.hpp) once per call, typically after every process();
+ * a standby bank set up with the same streams takes it over with
+ * load_state().
+ *
+ * With set_accounting(every), one in every process() calls and one in
+ * every parameter updates is timed with cycle_count() and charged to the
+ * streams involved: a group's block is split over its lanes in
+ * proportion to their samples (they all run the group's order), a batch
+ * update_params() over its streams.
+ * get_stream_costs() and get_preset_costs() (by parameter id) return the
+ * sampled sums; multiplied by every they estimate the totals. Unsampled
+ * blocks cost one counter increment.
+ *
+ * After every block a stream whose u is no longer finite (NaN or inf
+ * input, which the lattice would carry forever) is reset to zero state
+ * and, with set_log(), reported as rt_log_nan_state. Also with set_log(),
+ * a stream that had the fed back error clamped in more than a share storm
+ * of its block's samples is reported as rt_log_clamp_storm.
+ */
+class waplns_bank
+{
+public:
+	struct metrics
+	{
+		int streams;
+		int groups;
+		long long useful_stage_lanes;   // sum of active stream orders
+		long long executed_stage_lanes; // sum of group orders * bank_lanes
+		double lane_utilization;        // useful / executed
+		int active;                     // streams in groups
+		int parked;                     // streams skipped as idle
+		unsigned long parks;            // total park transitions
+		unsigned long wakeups;          // total wake transitions
+		int account_every;              // 0 = no cost accounting
+		unsigned long long sampled_blocks;
+	};
+
+	/** sampled cost of a stream, or of all streams with one param id */
+	struct cost
+	{
+		unsigned param_id;
+		int streams;
+		unsigned long long blocks;        // sampled blocks
+		unsigned long long cycles;        // cycle_count() units in them
+		unsigned long long updates;       // sampled parameter updates
+		unsigned long long update_cycles;
+	};
+
+private:
+	struct stream_rec
+	{
+		waplns ns;    // parameters; state while not packed
+		unsigned param_id;
+		uint64_t cycles;        // sampled cost, see set_accounting()
+		uint64_t blocks;
+		uint64_t update_cycles;
+		uint64_t updates;
+		int group;
+		int lane;
+		bool parked;
+		bool decayed; // |t|, |u| below the decay threshold after last block
+	};
+
+	struct group
+	{
+		int order;
+		int nlanes;
+		int stream[bank_lanes];
+		unsigned dirty;  // lanes with pending update_params()
+		float lam[bank_lanes];
+		float s2[bank_lanes];
+		float u[bank_lanes];
+		float k[max_wapl_filt_order][bank_lanes];
+		float t[max_wapl_filt_order][bank_lanes];
+	};
+
+	int max_streams_;
+	bool needs_repack_;
+	long useful_;              // sum of packed stream orders
+	long executed_;            // sum of group orders plus overheads
+	double repack_use_;        // useful_ / executed_ after repack()
+	workspace_buffer* own_;    // memory if the bank allocated its own
+	ws_array<stream_rec> streams_;
+	ws_array<group> groups_;
+	ws_array<int> sorted_;     // scratch for repack()
+	ws_array<int> cost_;
+	ws_array<int> cut_;
+	ws_array<int> parked_;     // parked streams of the current block
+	ws_array<int> touched_;    // groups touched by update_params()
+
+	float silence_;
+	float decay_;
+	unsigned long parks_;
+	unsigned long wakeups_;
+	int account_every_;
+	unsigned long long block_no_;
+	unsigned long long update_no_;
+	unsigned long long sampled_blocks_;
+	rt_log_ring* log_;
+	int log_source_;
+	float storm_;
+
+	waplns_bank(waplns_bank const&);
+	waplns_bank& operator=(waplns_bank const&);
+
+	static void layout(workspace_arena & ws, std::size_t n, waplns_bank* b);
+	void init();
+	static void lane_to_waplns(group const& g, int lane, waplns & ns);
+	void pull_lane(int g, int lane);
+	void push_lane(int g, int lane);
+	void clear_lane(group & g, int lane);
+	void move_lane(int from_g, int from_lane, int to_g, int to_lane);
+	void insert_lane(int id);
+	void remove_lane(int g, int lane);
+	void update_activity(float const* const* in, int const* counts, int count);
+	void note_decay(group const& g);
+	void check_state(group & g);
+	void note_clamps(group const& g, int const* clamped, int const* counts,
+		int count);
+	bool sample_block();
+	bool sample_update();
+	void charge_group(group const& g, uint64_t cycles, int const* counts);
+	template<class Quant>
+	void process_parked(Quant & quant, float const* const* in,
+		typename Quant::code_type* const* out, int const* counts, int count,
+		bool sample);
+	static void step(group & g, float const* x);
+	static void step_masked(group & g, float const* x, int const* mask);
+
+public:
+	/** fixed per-group cost in stage units used by the packing */
+	static const int group_overhead = 2;
+
+	/** allocates everything needed for up to max_streams streams */
+	explicit waplns_bank(int max_streams);
+	/** up to spec.channels streams in caller memory (see workspace.hpp) */
+	waplns_bank(workspace_spec const& spec, void* mem, std::size_t bytes);
+	~waplns_bank();
+
+	static std::size_t workspace_bytes(workspace_spec const& spec);
+
+	int add_stream(float lam, int ord, float const* k);
+	int streams() const { return static_cast<int>(streams_.size()); }
+
+	void set_params(int id, float lam, int ord, float const* k);
+	/** application id of a stream's parameters, recorded by save_state() */
+	void set_param_id(int id, unsigned pid) { streams_[id].param_id = pid; }
+	unsigned param_id(int id) const { return streams_[id].param_id; }
+	/**
+	 * Batch update for adaptive shaping: new lambda and k for n streams
+	 * whose order stays the same. Coefficients are written into the groups
+	 * directly and s2 and u are recomputed once per touched group for all
+	 * of its lanes with vector code.
+	 */
+	void update_params(int n, int const* ids,
+		float const* lams, float const* const* ks);
+	void reset_state(int id);
+	/** copy of a stream's shaper including its current state */
+	waplns stream(int id) const;
+
+	/** regroups the active streams by order, keeping their state */
+	void repack();
+
+	/**
+	 * Enables parking of idle streams: a stream is parked when the peak of
+	 * its input block is below silence and all of its state was below decay
+	 * at the end of its previous block. silence = 0 disables parking.
+	 */
+	void set_activity(float silence, float decay);
+	bool parked(int id) const { return streams_[id].parked; }
+
+	/**
+	 * Shapes count samples for every stream: in[id] / out[id] are the
+	 * signal and the output of stream id. Quant is a quantizer policy as
+	 * used by shape_block().
+	 */
+	template<class Quant>
+	void process(Quant & quant, float const* const* in,
+		typename Quant::code_type* const* out, int count);
+
+	/**
+	 * Same with a length per stream (counts[id]). A group runs until its
+	 * longest lane is done; lanes that finished are masked and keep their
+	 * state, so ragged blocks cost max(counts) per group instead of a
+	 * fallback to per-stream loops.
+	 */
+	template<class Quant>
+	void process(Quant & quant, float const* const* in,
+		typename Quant::code_type* const* out, int const* counts);
+
+	metrics get_metrics() const;
+
+	/**
+	 * reports NaN resets to ring (null: none) as source, and clamp storms
+	 * above the share storm of a block (storm < 0: none)
+	 */
+	void set_log(rt_log_ring* ring, int source, float storm = -1)
+	{ log_ = ring; log_source_ = source; storm_ = storm; }
+
+	/** samples one in every blocks and updates, 0 turns accounting off */
+	void set_accounting(int every);
+	/** out[id] for every stream (streams() entries) */
+	void get_stream_costs(cost* out) const;
+	/**
+	 * Costs summed per parameter id, sorted by id; returns the number of
+	 * entries. Ids beyond the first max found are left out.
+	 */
+	int get_preset_costs(cost* out, int max) const;
+	void reset_costs();
+
+	/** writes the state of all streams as one snapshot into cp */
+	void save_state(bank_checkpoint & cp) const;
+	/**
+	 * Adopts the newest snapshot in cp: streams whose parameter id and
+	 * order match the snapshot's record of the same stream id take over
+	 * its t[] and u; the others keep their state. Returns the number of
+	 * streams adopted.
+	 */
+	int load_state(bank_checkpoint & cp);
+};
+
+template<class Quant>
+void waplns_bank::process(Quant & quant, float const* const* in,
+	typename Quant::code_type* const* out, int count)
+{
+	{
+		WAPLNS_TRACE_SCOPE(trace_pack);
+		update_activity(in,0,count);
+		if (needs_repack_) repack();
+	}
+	bool const sample = sample_block();
+	for (std::size_t gi=0; gi<groups_.size(); ++gi) {
+		group & g = groups_[gi];
+		uint64_t const c0 = sample ? cycle_count() : 0;
+		float const* ip[bank_lanes];
+		typename Quant::code_type* op[bank_lanes];
+		for (int l=0; l<g.nlanes; ++l) {
+			ip[l] = in[g.stream[l]];
+			op[l] = out[g.stream[l]];
+		}
+		alignas(32) float x[bank_lanes] = {0};
+		alignas(32) float s[bank_lanes] = {0};
+		typename Quant::code_type c[bank_lanes];
+		int clamped[bank_lanes] = {0};
+		int live[bank_lanes];
+		for (int l=0; l<bank_lanes; ++l) live[l] = l < g.nlanes;
+		for (int n=0; n<count; ++n) {
+			for (int l=0; l<g.nlanes; ++l) s[l] = ip[l][n];
+			quantize_lanes(quant,s,g.u,c,x,clamped,live);
+			for (int l=0; l<g.nlanes; ++l) op[l][n] = c[l];
+			step(g,x);
+		}
+		check_state(g);
+		note_clamps(g,clamped,0,count);
+		if (silence_ > 0) note_decay(g);
+		if (sample) charge_group(g,cycle_count_end() - c0,0);
+	}
+	process_parked(quant,in,out,0,count,sample);
+}
+
+template<class Quant>
+void waplns_bank::process(Quant & quant, float const* const* in,
+	typename Quant::code_type* const* out, int const* counts)
+{
+	{
+		WAPLNS_TRACE_SCOPE(trace_pack);
+		update_activity(in,counts,0);
+		if (needs_repack_) repack();
+	}
+	bool const sample = sample_block();
+	for (std::size_t gi=0; gi<groups_.size(); ++gi) {
+		group & g = groups_[gi];
+		uint64_t const c0 = sample ? cycle_count() : 0;
+		float const* ip[bank_lanes];
+		typename Quant::code_type* op[bank_lanes];
+		int len[bank_lanes];
+		int longest = 0;
+		for (int l=0; l<bank_lanes; ++l) {
+			len[l] = l<g.nlanes ? counts[g.stream[l]] : 0;
+			longest = std::max(longest,len[l]);
+			if (l<g.nlanes) {
+				ip[l] = in[g.stream[l]];
+				op[l] = out[g.stream[l]];
+			}
+		}
+		alignas(32) float x[bank_lanes] = {0};
+		alignas(32) float s[bank_lanes] = {0};
+		typename Quant::code_type c[bank_lanes];
+		alignas(32) int mask[bank_lanes];
+		int clamped[bank_lanes] = {0};
+		for (int n=0; n<longest; ++n) {
+			for (int l=0; l<bank_lanes; ++l) mask[l] = n < len[l];
+			for (int l=0; l<g.nlanes; ++l) if (mask[l]) s[l] = ip[l][n];
+			quantize_lanes(quant,s,g.u,c,x,clamped,mask);
+			for (int l=0; l<g.nlanes; ++l) if (mask[l]) op[l][n] = c[l];
+			step_masked(g,x,mask);
+		}
+		check_state(g);
+		note_clamps(g,clamped,counts,0);
+		if (silence_ > 0) note_decay(g);
+		if (sample) charge_group(g,cycle_count_end() - c0,counts);
+	}
+	process_parked(quant,in,out,counts,0,sample);
+}
+
+template<class Quant>
+void waplns_bank::process_parked(Quant & quant, float const* const* in,
+	typename Quant::code_type* const* out, int const* counts, int count,
+	bool sample)
+{
+	// no shaping, the error of a parked stream is not fed back
+	for (std::size_t p=0; p<parked_.size(); ++p) {
+		int const id = parked_[p];
+		int const n = counts ? counts[id] : count;
+		uint64_t const c0 = sample ? cycle_count() : 0;
+		for (int i=0; i<n; ++i) {
+			float qlin;
+			out[id][i] = quant.quantize(in[id][i],qlin);
+		}
+		if (sample) {
+			streams_[id].cycles += cycle_count_end() - c0;
+			++streams_[id].blocks;
+		}
+	}
+}
+
+#endif // WAPLNS_BANK_HPP_INCLUDED
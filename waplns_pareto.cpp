@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+#include "fft.hpp"
+#include "shaper.hpp"
+#include "uniform_bank.hpp"
+#include "waplns_bank.hpp"
+#include "wlpc.hpp"
+
+// Quality versus CPU report: every engine at every order is run on a
+// standard corpus for each preset and measured for
+//
+//    cost      CPU time per sample (thread CPU clock, best of 3 runs)
+//    weighted  noise power weighted by the inverse of the preset's target
+//              curve, in dB relative to plain rounding error (white noise
+//              of 1/12 LSB^2); lower is better
+//    dev       RMS difference in dB between the shape of the measured
+//              noise spectrum and the target curve (mean removed)
+//
+// and a Pareto frontier over (cost, weighted) is printed per preset,
+// with weighted levels within weighted_tie_db of each other taken as equal.
+//
+//    waplns_pareto [-j threads] [-n samples] [in.f32 ...]
+//
+// The presets are absolute threshold of hearing curves at 44.1, 48 and
+// 96 kHz, capped at a range of target_range_db, with lambda from
+// warp_lambda_bark() and k from wlpc_fit(). The corpus is eight
+// synthetic 16 bit items per rate (sweeps, pink noise, low level tones,
+// a multitone chord), or the given raw float32 files (1.0 = full scale),
+// which are then used at every rate. Engines:
+//
+//    round         rounding, no dither (baseline)
+//    tpdf          TPDF dither of 1 LSB, no shaping (baseline)
+//    waplns        scalar shape_block() per item (current baseline)
+//    waplns_bank   all items as streams of one bank, blocks of bank_block
+//    uniform_bank  all items as channels with one parameter set
+//
+// Shaped engines use TPDF dither too. The quality runs in parallel, one
+// configuration per thread. The cost is timed afterwards one
+// configuration at a time, so no other configuration competes for the
+// core, the shared caches or memory bandwidth.
+//
+//    g++ -std=c++11 -O2 -march=native -I. waplns_pareto.cpp fft.cpp
+//        wlpc.cpp uniform_bank.cpp waplns_bank.cpp checkpoint.cpp
+//        rt_log.cpp waplns.cpp workspace.cpp -o waplns_pareto -pthread
+
+namespace { // anonymous
+
+const double pi = 3.14159265358979323846;
+const int psd_len = 4096;
+const int bank_block = 256;
+const int corpus_items = 8;
+const double target_range_db = 50;
+// weighted noise levels closer than this count as equal on the frontier;
+// engines with the same filter differ by rounding noise only
+const double weighted_tie_db = 0.05;
+const int orders[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32 };
+
+enum engine { eng_round, eng_tpdf, eng_waplns, eng_bank, eng_uniform };
+char const* const engine_names[] = {
+	"round", "tpdf", "waplns", "waplns_bank", "uniform_bank"
+};
+
+struct preset
+{
+	char const* name;
+	double fs;
+	float lam;
+	std::vector<double> target;   // power per psd bin, minimum 1
+	std::vector<std::vector<float> > corpus;  // in LSB
+};
+
+struct config
+{
+	int preset;
+	engine eng;
+	int order;
+	double ns;
+	double weighted;
+	double dev;
+	bool frontier;
+};
+
+void make_target(preset & p)
+{
+	int const bins = psd_len/2 + 1;
+	std::vector<double> db(bins);
+	for (int b=0; b<bins; ++b) db[b] = ath_db(b * p.fs / psd_len);
+	double const lo = *std::min_element(db.begin(),db.end());
+	p.target.resize(bins);
+	for (int b=0; b<bins; ++b) {
+		p.target[b] = std::pow(10.0,std::min(db[b]-lo,target_range_db) / 10);
+	}
+}
+
+struct lcg
+{
+	unsigned s;
+	explicit lcg(unsigned seed) : s(seed) {}
+	double operator()()   // uniform in [-1, 1)
+	{
+		s = s * 1664525u + 1013904223u;
+		return (s >> 8) * (2.0 / 16777216) - 1;
+	}
+};
+
+// Paul Kellet's economy pink noise filter
+void pink(float* x, int n, double rms, unsigned seed)
+{
+	lcg rnd(seed);
+	double b0 = 0, b1 = 0, b2 = 0, e = 0;
+	std::vector<double> y(n);
+	for (int i=0; i<n; ++i) {
+		double const w = rnd();
+		b0 = 0.99765 * b0 + w * 0.0990460;
+		b1 = 0.96300 * b1 + w * 0.2965164;
+		b2 = 0.57000 * b2 + w * 1.0526913;
+		y[i] = b0 + b1 + b2 + w * 0.1848;
+		e += y[i] * y[i];
+	}
+	double const g = rms / std::sqrt(e / n);
+	for (int i=0; i<n; ++i) x[i] = static_cast<float>(g * y[i]);
+}
+
+void sweep(float* x, int n, double fs, double peak)
+{
+	double const f0 = 20, f1 = 0.45 * fs, r = std::log(f1/f0);
+	for (int i=0; i<n; ++i) {
+		double const t = double(i) / n;
+		x[i] = static_cast<float>(peak * std::sin(2*pi * f0 * n / fs / r
+			* (std::exp(r * t) - 1)));
+	}
+}
+
+void tones(float* x, int n, double fs, double peak, double const* f, int nf)
+{
+	for (int i=0; i<n; ++i) {
+		double v = 0;
+		for (int j=0; j<nf; ++j) v += std::sin(2*pi * f[j] * i / fs + j);
+		x[i] = static_cast<float>(peak / nf * v);
+	}
+}
+
+void make_corpus(preset & p, int n)
+{
+	double const fs = 32768.0;   // full scale in LSB
+	double const tone1[] = { 1000 }, tone2[] = { 441 };
+	double const chord[] = { 261.6, 329.6, 392.0, 523.3, 3520 };
+	p.corpus.assign(corpus_items,std::vector<float>(n));
+	sweep(&p.corpus[0][0],n,p.fs,fs * std::pow(10.0,-20.0/20));
+	sweep(&p.corpus[1][0],n,p.fs,fs * std::pow(10.0,-50.0/20));
+	pink(&p.corpus[2][0],n,fs * std::pow(10.0,-30.0/20),1);
+	pink(&p.corpus[3][0],n,fs * std::pow(10.0,-70.0/20),2);
+	tones(&p.corpus[4][0],n,p.fs,fs * std::pow(10.0,-60.0/20),tone1,1);
+	tones(&p.corpus[5][0],n,p.fs,fs * std::pow(10.0,-80.0/20),tone2,1);
+	tones(&p.corpus[6][0],n,p.fs,fs * std::pow(10.0,-12.0/20),chord,5);
+	tones(&p.corpus[7][0],n,p.fs,fs * std::pow(10.0,-40.0/20),chord,5);
+}
+
+bool read_f32(char const* path, std::vector<float> & x)
+{
+	std::FILE* const f = std::fopen(path,"rb");
+	if (!f) return false;
+	float buf[4096];
+	std::size_t got;
+	while ((got = std::fread(buf,sizeof(float),4096,f)) > 0) {
+		for (std::size_t i=0; i<got; ++i) x.push_back(buf[i] * 32768.0f);
+	}
+	std::fclose(f);
+	return true;
+}
+
+double thread_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// one run of an engine over the corpus; returns CPU ns
+double run(preset const& p, engine eng, int order, float const* k,
+	std::vector<std::vector<short> > & q)
+{
+	int const items = static_cast<int>(p.corpus.size());
+	int const n = static_cast<int>(p.corpus[0].size());
+	pcm16_quantizer quant;
+	quant.dither = eng == eng_round ? 0.0f : 1.0f;
+	quant.thresh = 2.0f;   // room for the dither in the fed back error
+	std::vector<float const*> in(items);
+	std::vector<short*> out(items);
+	for (int i=0; i<items; ++i) {
+		in[i] = &p.corpus[i][0];
+		out[i] = &q[i][0];
+	}
+	double const t0 = thread_ns();
+	if (eng == eng_round || eng == eng_tpdf) {
+		for (int i=0; i<items; ++i) {
+			for (int j=0; j<n; ++j) {
+				float qlin;
+				out[i][j] = quant.quantize(in[i][j],qlin);
+			}
+		}
+	} else if (eng == eng_waplns) {
+		for (int i=0; i<items; ++i) {
+			waplns ns;
+			ns.set_params(p.lam,order,k);
+			shape_block(ns,quant,in[i],out[i],n);
+		}
+	} else if (eng == eng_bank) {
+		waplns_bank bank(items);
+		for (int i=0; i<items; ++i) bank.add_stream(p.lam,order,k);
+		bank.repack();
+		for (int j=0; j<n; j+=bank_block) {
+			bank.process(quant,&in[0],&out[0],std::min(bank_block,n-j));
+			for (int i=0; i<items; ++i) {
+				in[i] += bank_block;
+				out[i] += bank_block;
+			}
+		}
+	} else {
+		uniform_bank ub(items,order);
+		ub.set_params(p.lam,order,k);
+		ub.process(quant,&in[0],&out[0],n);
+	}
+	return thread_ns() - t0;
+}
+
+void fit_k(preset const& p, int order, float* k)
+{
+	for (int i=0; i<max_wapl_filt_order; ++i) k[i] = 0;
+	if (!order) return;
+	int const bins = psd_len/2 + 1;
+	std::vector<float> target(bins);
+	for (int b=0; b<bins; ++b) target[b] = static_cast<float>(p.target[b]);
+	wlpc_fit(&target[0],bins,p.lam,order,k);
+}
+
+void measure_quality(preset const& p, config & c)
+{
+	int const items = static_cast<int>(p.corpus.size());
+	int const n = static_cast<int>(p.corpus[0].size());
+	float k[max_wapl_filt_order];
+	fit_k(p,c.order,k);
+	std::vector<std::vector<short> > q(items,std::vector<short>(n));
+	run(p,c.eng,c.order,k,q);
+
+	int const bins = psd_len/2 + 1;
+	std::vector<double> psd(bins);
+	std::vector<float> err(n);
+	int segs = 0;
+	for (int i=0; i<items; ++i) {
+		for (int j=0; j<n; ++j) err[j] = q[i][j] - p.corpus[i][j];
+		segs += welch_psd(&err[0],n,psd_len,&psd[0]);
+	}
+	// 20 Hz up to but excluding Nyquist
+	int const b0 = std::max(1,static_cast<int>(std::ceil(20.0 * psd_len / p.fs)));
+	double wsum = 0, wref = 0, dsum = 0, dsq = 0;
+	for (int b=b0; b<bins-1; ++b) {
+		double const v = std::max(psd[b] / segs,1e-30);
+		wsum += v / p.target[b];
+		wref += (1.0/12) / p.target[b];
+		double const d = 10 * std::log10(v / p.target[b]);
+		dsum += d;
+		dsq += d * d;
+	}
+	int const nb = bins - 1 - b0;
+	c.weighted = 10 * std::log10(wsum / wref);
+	c.dev = std::sqrt(std::max(dsq / nb - (dsum / nb) * (dsum / nb),0.0));
+}
+
+void measure_cost(preset const& p, config & c)
+{
+	int const items = static_cast<int>(p.corpus.size());
+	int const n = static_cast<int>(p.corpus[0].size());
+	float k[max_wapl_filt_order];
+	fit_k(p,c.order,k);
+	std::vector<std::vector<short> > q(items,std::vector<short>(n));
+	c.ns = 0;
+	for (int r=0; r<3; ++r) {
+		double const ns = run(p,c.eng,c.order,k,q);
+		if (r==0 || ns<c.ns) c.ns = ns;
+	}
+	c.ns /= double(items) * n;
+}
+
+void mark_frontier(std::vector<config> & cs)
+{
+	for (std::size_t i=0; i<cs.size(); ++i) {
+		cs[i].frontier = true;
+		for (std::size_t j=0; j<cs.size() && cs[i].frontier; ++j) {
+			if (cs[j].preset != cs[i].preset || j == i) continue;
+			double const dw = cs[j].weighted - cs[i].weighted;
+			if ((cs[j].ns < cs[i].ns && dw <= weighted_tie_db)
+				|| (cs[j].ns <= cs[i].ns && dw < -weighted_tie_db)) {
+				cs[i].frontier = false;
+			}
+		}
+	}
+}
+
+void print_row(preset const& p, config const& c)
+{
+	char ord[8] = "-";
+	if (c.order) std::snprintf(ord,sizeof(ord),"%d",c.order);
+	std::printf("%-8s %-13s %5s %9.2f %9.2f %7.2f %s\n",p.name,
+		engine_names[c.eng],ord,c.ns,c.weighted,c.dev,c.frontier ? "*" : "");
+}
+
+bool cheaper(config const& a, config const& b)
+{
+	return a.ns < b.ns;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+	int threads = std::max(1u,std::thread::hardware_concurrency());
+	int n = 1 << 16;
+	std::vector<char const*> files;
+	for (int i=1; i<argc; ++i) {
+		if (!std::strcmp(argv[i],"-j") && i+1 < argc) threads = std::atoi(argv[++i]);
+		else if (!std::strcmp(argv[i],"-n") && i+1 < argc) n = std::atoi(argv[++i]);
+		else if (argv[i][0] == '-') {
+			std::fprintf(stderr,"usage: %s [-j threads] [-n samples] [in.f32 ...]\n",
+				argv[0]);
+			return 2;
+		}
+		else files.push_back(argv[i]);
+	}
+	if (threads < 1 || n < psd_len) {
+		std::fprintf(stderr,"need at least one thread and %d samples\n",psd_len);
+		return 2;
+	}
+
+	std::vector<std::vector<float> > user;
+	for (std::size_t i=0; i<files.size(); ++i) {
+		std::vector<float> x;
+		if (!read_f32(files[i],x) || static_cast<int>(x.size()) < psd_len) {
+			std::fprintf(stderr,"%s: unreadable or shorter than %d samples\n",
+				files[i],psd_len);
+			return 1;
+		}
+		user.push_back(x);
+	}
+	if (!user.empty()) {
+		// equal lengths, so the banks can run all items side by side
+		std::size_t len = user[0].size();
+		for (std::size_t i=1; i<user.size(); ++i) len = std::min(len,user[i].size());
+		for (std::size_t i=0; i<user.size(); ++i) user[i].resize(len);
+	}
+
+	preset presets[] = {
+		{ "44.1k", 44100, 0, {}, {} },
+		{ "48k", 48000, 0, {}, {} },
+		{ "96k", 96000, 0, {}, {} }
+	};
+	int const npresets = sizeof(presets) / sizeof(presets[0]);
+	std::vector<config> cs;
+	for (int p=0; p<npresets; ++p) {
+		presets[p].lam = warp_lambda_bark(presets[p].fs);
+		make_target(presets[p]);
+		if (user.empty()) make_corpus(presets[p],n);
+		else presets[p].corpus = user;
+		config c = { p, eng_round, 0, 0, 0, 0, false };
+		cs.push_back(c);
+		c.eng = eng_tpdf;
+		cs.push_back(c);
+		for (engine e=eng_waplns; e<=eng_uniform; e=engine(e+1)) {
+			for (std::size_t o=0; o<sizeof(orders)/sizeof(orders[0]); ++o) {
+				c.eng = e;
+				c.order = orders[o];
+				cs.push_back(c);
+			}
+		}
+	}
+
+	std::atomic<int> next(0);
+	std::vector<std::thread> pool;
+	for (int t=0; t<threads; ++t) {
+		pool.push_back(std::thread([&]{
+			for (int i; (i = next++) < static_cast<int>(cs.size()); ) {
+				measure_quality(presets[cs[i].preset],cs[i]);
+			}
+		}));
+	}
+	for (std::size_t t=0; t<pool.size(); ++t) pool[t].join();
+	for (std::size_t i=0; i<cs.size(); ++i) measure_cost(presets[cs[i].preset],cs[i]);
+	mark_frontier(cs);
+
+	std::printf("%-8s %-13s %5s %9s %9s %7s\n","preset","engine","order",
+		"ns/sample","weighted","dev");
+	for (std::size_t i=0; i<cs.size(); ++i) print_row(presets[cs[i].preset],cs[i]);
+	for (int p=0; p<npresets; ++p) {
+		std::vector<config> f;
+		for (std::size_t i=0; i<cs.size(); ++i) {
+			if (cs[i].preset == p && cs[i].frontier) f.push_back(cs[i]);
+		}
+		std::sort(f.begin(),f.end(),cheaper);
+		std::printf("\nPareto frontier %s (lambda %.4f)\n",presets[p].name,presets[p].lam);
+		for (std::size_t i=0; i<f.size(); ++i) print_row(presets[p],f[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,538 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+#include "checksum.hpp"
+#include "jobqueue.hpp"
+#include "shaper.hpp"
+#include "streaming.hpp"
+#include "trace.hpp"
+#include "workspace.hpp"
+
+// Batch shaper: raw native-endian float32 mono in (1.0 = full scale),
+// raw native-endian 16 bit PCM out.
+//
+//    waplns_render render <in> <out> <lambda> <dither> k0 k1 ...
+//    waplns_render submit <dir> <job> <in> <out> <chunk> <lambda> <dither> k0 k1 ...
+//    waplns_render worker <dir> [lease_timeout_s] [--keep]
+//    waplns_render wait   <dir> <job> [lease_timeout_s]
+//
+// submit splits the file into chunks of <chunk> samples and queues the
+// first one. A worker that finishes chunk c stores the shaper state
+// (t[], u, dither seed) in state/<job>.<c> and only then queues chunk c+1,
+// so chunks of one file run in order on any host while different files
+// run in parallel. Every chunk is a pure function of the input and the
+// previous state, so a chunk that is redone after a crash rewrites the
+// same bytes. A chunk that fails three times (unreadable input, missing
+// state) goes to failed/, which ends its job: wait exits with 1. Workers
+// exit once the queue is idle unless --keep is given, with 1 if a chunk
+// failed on them. Several workers on one directory on one machine behave
+// exactly like workers on several hosts; test_render.sh runs them so.
+//
+// Samples are read in blocks of a few megabytes into a huge page buffer
+// (if the system grants them). The codes go with non-temporal stores
+// straight into a mapping of the output file, where nothing reads them
+// back, so the output does not push the input out of the caches.
+// WAPLNS_RENDER_STREAM=0 (or a file that cannot be mapped) selects
+// shaping into a staging buffer with regular stores and pwrite() instead.
+//
+// Every tile of stream_tile codes is checksummed while it is in L1 (see
+// output_checksum), and <out>.sum gets the manifest. Chunks carry the
+// running digest and their block lines in their state file; the last
+// chunk writes the manifest. The file CRC does not depend on the chunk
+// size, the file hash does (through the block boundaries).
+//
+//    g++ -std=c++11 -O2 -march=native -I. waplns_render.cpp jobqueue.cpp
+//        checksum.cpp streaming.cpp waplns.cpp workspace.cpp -o waplns_render
+//
+// With -DWAPLNS_TRACE trace.cpp added, WAPLNS_TRACE_FILE=<path> writes a
+// Chrome trace of the read, shape and write stages there.
+
+namespace { // anonymous
+
+struct job_spec
+{
+	std::string input, output;
+	long samples, chunk;
+	float lambda, dither;
+	std::vector<float> k;
+};
+
+std::string format_spec(job_spec const& j)
+{
+	std::ostringstream os;
+	os << "input " << j.input << '\n' << "output " << j.output << '\n'
+	   << "samples " << j.samples << '\n' << "chunk " << j.chunk << '\n';
+	char buf[64];
+	std::snprintf(buf,sizeof(buf),"lambda %a\ndither %a\nk",j.lambda,j.dither);
+	os << buf;
+	for (unsigned i=0; i<j.k.size(); ++i) {
+		std::snprintf(buf,sizeof(buf)," %a",j.k[i]);
+		os << buf;
+	}
+	os << '\n';
+	return os.str();
+}
+
+bool parse_spec(std::string const& text, job_spec & j)
+{
+	std::istringstream is(text);
+	std::string line;
+	j.k.clear();
+	while (std::getline(is,line)) {
+		std::string::size_type const sp = line.find(' ');
+		if (sp == std::string::npos) continue;
+		std::string const key = line.substr(0,sp);
+		std::string const val = line.substr(sp+1);
+		if (key == "input") j.input = val;
+		else if (key == "output") j.output = val;
+		else if (key == "samples") j.samples = std::atol(val.c_str());
+		else if (key == "chunk") j.chunk = std::atol(val.c_str());
+		else if (key == "lambda") j.lambda = std::strtof(val.c_str(),0);
+		else if (key == "dither") j.dither = std::strtof(val.c_str(),0);
+		else if (key == "k") {
+			std::istringstream ks(val);
+			std::string tok;
+			while (ks >> tok) j.k.push_back(std::strtof(tok.c_str(),0));
+		}
+	}
+	return !j.input.empty() && !j.output.empty() && j.chunk > 0
+		&& !j.k.empty() && static_cast<int>(j.k.size()) <= max_wapl_filt_order;
+}
+
+// hex floats, so the state survives the round trip bit exact; then the
+// running digest and the manifest lines of the blocks shaped so far
+std::string format_state(waplns::state const& st, int order, unsigned seed,
+	output_checksum const& sums, std::string const& blocks)
+{
+	std::ostringstream os;
+	char buf[96];
+	std::snprintf(buf,sizeof(buf),"seed %u\nu %a\nt",seed,st.u);
+	os << buf;
+	for (int i=0; i<order; ++i) {
+		std::snprintf(buf,sizeof(buf)," %a",st.t[i]);
+		os << buf;
+	}
+	block_digest const d = sums.so_far();
+	std::snprintf(buf,sizeof(buf),"\nsum %lu %llu %lu %llu\n",sums.blocks(),
+		static_cast<unsigned long long>(d.bytes),static_cast<unsigned long>(d.crc),
+		static_cast<unsigned long long>(d.hash));
+	os << buf << blocks;
+	return os.str();
+}
+
+bool parse_state(std::string const& text, int order,
+	waplns::state & st, unsigned & seed, output_checksum & sums,
+	std::string & blocks)
+{
+	std::istringstream is(text);
+	std::string key, tok;
+	if (!(is >> key >> seed) || key != "seed") return false;
+	if (!(is >> key >> tok) || key != "u") return false;
+	st.u = std::strtof(tok.c_str(),0);
+	if (!(is >> key) || key != "t") return false;
+	for (int i=0; i<max_wapl_filt_order; ++i) st.t[i] = 0;
+	for (int i=0; i<order; ++i) {
+		if (!(is >> tok)) return false;
+		st.t[i] = std::strtof(tok.c_str(),0);
+	}
+	unsigned long n, crc;
+	unsigned long long bytes, hash;
+	if (!(is >> key >> n >> bytes >> crc >> hash) || key != "sum") return false;
+	block_digest d;
+	d.crc = static_cast<uint32_t>(crc);
+	d.hash = hash;
+	d.bytes = bytes;
+	sums.resume(d,n);
+	is.ignore(1);
+	blocks.assign(std::istreambuf_iterator<char>(is),std::istreambuf_iterator<char>());
+	return true;
+}
+
+std::string ticket_name(std::string const& job, long chunk)
+{
+	return job + "." + std::to_string(chunk);
+}
+
+long file_samples(char const* path)
+{
+	std::FILE* f = std::fopen(path,"rb");
+	if (!f) return -1;
+	std::fseek(f,0,SEEK_END);
+	long const n = std::ftell(f) / static_cast<long>(sizeof(float));
+	std::fclose(f);
+	return n;
+}
+
+bool parse_params(int argc, char** argv, int first, job_spec & j)
+{
+	if (argc < first+3) return false;
+	j.lambda = std::strtof(argv[first],0);
+	j.dither = std::strtof(argv[first+1],0);
+	j.k.clear();
+	for (int i=first+2; i<argc; ++i) j.k.push_back(std::strtof(argv[i],0));
+	return static_cast<int>(j.k.size()) <= max_wapl_filt_order;
+}
+
+/**
+ * shapes samples [begin,end) of the job from state st/seed and updates
+ * them, adding the codes to sums; calls beat() between blocks so long
+ * chunks keep their lease
+ */
+template<class Beat>
+bool shape_range(job_spec const& j, long begin, long end,
+	waplns::state & st, unsigned & seed, output_checksum & sums, Beat beat)
+{
+	int const in = open(j.input.c_str(),O_RDONLY);
+	// read access too, mmap() wants it even for write only mappings
+	int const out = open(j.output.c_str(),O_RDWR);
+	bool ok = in >= 0 && out >= 0;
+	waplns ns;
+	ns.set_params(j.lambda,static_cast<int>(j.k.size()),&j.k[0]);
+	ns.set_state(st);
+	pcm16_quantizer quant;
+	quant.dither = j.dither;
+	quant.seed = seed;
+	char const* const mode = std::getenv("WAPLNS_RENDER_STREAM");
+	bool streaming = !mode || std::strcmp(mode,"0") != 0;
+	long const block = 1 << 20;
+	long const page = sysconf(_SC_PAGESIZE);
+	workspace_buffer sbuf(block * sizeof(float),explicit_huge_pages);
+	float* const s = static_cast<float*>(sbuf.data());
+	std::vector<short> qbuf;
+	gain_ramp const full_scale(32768.0f);
+	for (long pos=begin; ok && pos<end; pos+=block) {
+		long const n = end-pos < block ? end-pos : block;
+		size_t const fbytes = n * sizeof(float);
+		size_t const qbytes = n * sizeof(short);
+		{
+			WAPLNS_TRACE_SCOPE(trace_read);
+			ok = pread(in,s,fbytes,pos*sizeof(float)) == static_cast<ssize_t>(fbytes);
+		}
+		if (!ok) break;
+		off_t const at = pos * sizeof(short);
+		off_t const base = at / page * page;
+		size_t const len = at - base + qbytes;
+		void* const m = streaming
+			? mmap(0,len,PROT_READ|PROT_WRITE,MAP_SHARED,out,base) : MAP_FAILED;
+		if (m != MAP_FAILED) {
+			{
+				WAPLNS_TRACE_SCOPE(trace_shape);
+				short* const q = reinterpret_cast<short*>(static_cast<char*>(m) + (at - base));
+				shape_block_streaming(ns,quant,full_scale,s,q,static_cast<int>(n),sums);
+			}
+			WAPLNS_TRACE_SCOPE(trace_write);
+			munmap(m,len);
+		} else {
+			streaming = false;
+			qbuf.resize(block);
+			{
+				WAPLNS_TRACE_SCOPE(trace_shape);
+				// in tiles as above, so the manifest does not depend on the path
+				for (long i0=0; i0<n; i0+=stream_tile) {
+					int const tn = static_cast<int>(std::min<long>(n-i0,stream_tile));
+					shape_block(ns,quant,offset_gain<gain_ramp>(full_scale,static_cast<int>(i0)),
+						s+i0,&qbuf[i0],tn,sums);
+				}
+			}
+			WAPLNS_TRACE_SCOPE(trace_write);
+			ok = pwrite(out,&qbuf[0],qbytes,at) == static_cast<ssize_t>(qbytes);
+		}
+		beat();
+	}
+	if (ok) ok = fsync(out) == 0;
+	if (in >= 0) close(in);
+	if (out >= 0) close(out);
+	ns.get_state(st);
+	seed = quant.seed;
+	return ok;
+}
+
+bool create_output(job_spec const& j)
+{
+	int const fd = open(j.output.c_str(),O_WRONLY|O_CREAT,0666);
+	if (fd < 0) return false;
+	bool const ok = ftruncate(fd,j.samples * sizeof(short)) == 0;
+	close(fd);
+	return ok;
+}
+
+struct no_beat { void operator()() const {} };
+
+class lease_beat
+{
+	job_queue & queue_;
+	std::string const& ticket_;
+	std::time_t last_;
+
+public:
+	lease_beat(job_queue & q, std::string const& t)
+	: queue_(q), ticket_(t), last_(std::time(0)) {}
+
+	void operator()()
+	{
+		std::time_t const now = std::time(0);
+		if (now != last_) {
+			queue_.heartbeat(ticket_);
+			last_ = now;
+		}
+	}
+};
+
+/** lines written to file(), collected in memory */
+class line_buffer
+{
+	char* buf_;
+	std::size_t size_;
+	std::FILE* file_;
+
+	line_buffer(line_buffer const&);
+	line_buffer& operator=(line_buffer const&);
+
+public:
+	line_buffer() : buf_(0), size_(0), file_(open_memstream(&buf_,&size_)) {}
+	~line_buffer()
+	{
+		if (file_) std::fclose(file_);
+		std::free(buf_);
+	}
+
+	std::FILE* file() const { return file_; }
+	std::string str()
+	{
+		std::fflush(file_);
+		return std::string(buf_,size_);
+	}
+};
+
+/**
+ * writes <output>.sum (temporary file and rename) from the block lines in
+ * the states of chunks [0,last) and tail, the last chunk's lines
+ */
+bool write_manifest(job_queue const& queue, job_spec const& j,
+	std::string const& job, long last, std::string const& tail)
+{
+	int const order = static_cast<int>(j.k.size());
+	std::string text, state, blocks;
+	for (long c=0; c<last; ++c) {
+		waplns::state st;
+		unsigned seed;
+		output_checksum sums;
+		if (!queue.read_file("state",ticket_name(job,c),state)
+			|| !parse_state(state,order,st,seed,sums,blocks)) {
+			return false;
+		}
+		text += blocks;
+	}
+	text += tail;
+	char host[256] = "localhost";
+	gethostname(host,sizeof(host)-1);
+	std::string const path = j.output + ".sum";
+	std::string const tmp = path + "." + host + "." + std::to_string(getpid());
+	std::FILE* const f = std::fopen(tmp.c_str(),"w");
+	if (!f) return false;
+	bool ok = std::fwrite(text.data(),1,text.size(),f) == text.size();
+	ok = std::fclose(f) == 0 && ok;
+	if (ok) ok = std::rename(tmp.c_str(),path.c_str()) == 0;
+	if (!ok) std::remove(tmp.c_str());
+	return ok;
+}
+
+bool lease_lost(std::string const& ticket)
+{
+	std::fprintf(stderr,"lease on %s lost, leaving the chunk to its new owner\n",
+		ticket.c_str());
+	return true;
+}
+
+bool run_chunk(job_queue & queue, std::string const& ticket)
+{
+	std::string::size_type const dot = ticket.rfind('.');
+	if (dot == std::string::npos) return false;
+	std::string const job = ticket.substr(0,dot);
+	long const c = std::atol(ticket.c_str()+dot+1);
+	std::string text;
+	job_spec j;
+	if (!queue.read_file("jobs",job,text) || !parse_spec(text,j)) return false;
+	int const order = static_cast<int>(j.k.size());
+	waplns::state st;
+	unsigned seed = 1;
+	line_buffer lines;
+	if (!lines.file()) return false;
+	output_checksum sums(lines.file());
+	std::string prev_blocks;
+	if (c == 0) {
+		for (int i=0; i<max_wapl_filt_order; ++i) st.t[i] = 0;
+		st.u = 0;
+	} else if (!queue.read_file("state",ticket_name(job,c-1),text)
+		|| !parse_state(text,order,st,seed,sums,prev_blocks)) {
+		return false;
+	}
+	long const begin = c * j.chunk;
+	long const end = begin + j.chunk < j.samples ? begin + j.chunk : j.samples;
+	lease_beat beat(queue,ticket);
+	if (!shape_range(j,begin,end,st,seed,sums,beat)) return false;
+	std::string const blocks = lines.str();
+	// state first, then the next ticket: whoever claims c+1 finds its state.
+	// If we stalled and the lease went to another worker, that worker
+	// writes both (the same samples, shaping is deterministic), we don't.
+	if (!queue.owns(ticket)) return lease_lost(ticket);
+	if (!queue.write_file("state",ticket,format_state(st,order,seed,sums,blocks))) {
+		return false;
+	}
+	if (end == j.samples) {
+		sums.finish();
+		if (!write_manifest(queue,j,job,c,lines.str())) return false;
+	}
+	if (!queue.owns(ticket)) return lease_lost(ticket);
+	if (end < j.samples && !queue.put(ticket_name(job,c+1))) return false;
+	if (!queue.complete(ticket)) return lease_lost(ticket);
+	return true;
+}
+
+int cmd_render(int argc, char** argv)
+{
+	job_spec j;
+	if (argc < 4 || !parse_params(argc,argv,4,j)) return 2;
+	j.input = argv[2];
+	j.output = argv[3];
+	j.samples = file_samples(argv[2]);
+	if (j.samples < 0 || !create_output(j)) {
+		std::fprintf(stderr,"cannot open %s or %s\n",argv[2],argv[3]);
+		return 1;
+	}
+	waplns::state st;
+	for (int i=0; i<max_wapl_filt_order; ++i) st.t[i] = 0;
+	st.u = 0;
+	unsigned seed = 1;
+	std::string const sum_path = j.output + ".sum";
+	std::FILE* const manifest = std::fopen(sum_path.c_str(),"w");
+	if (!manifest) {
+		std::fprintf(stderr,"cannot open %s\n",sum_path.c_str());
+		return 1;
+	}
+	output_checksum sums(manifest);
+	bool ok = shape_range(j,0,j.samples,st,seed,sums,no_beat());
+	if (ok) sums.finish();
+	ok = std::fclose(manifest) == 0 && ok;
+	if (!ok) std::remove(sum_path.c_str());
+	return ok ? 0 : 1;
+}
+
+int cmd_submit(int argc, char** argv)
+{
+	job_spec j;
+	if (argc < 7 || !parse_params(argc,argv,7,j)) return 2;
+	std::string const job = argv[3];
+	if (job.empty() || job.find_first_of("./") != std::string::npos) {
+		std::fprintf(stderr,"job names must not contain '.' or '/'\n");
+		return 2;
+	}
+	j.input = argv[4];
+	j.output = argv[5];
+	j.chunk = std::atol(argv[6]);
+	j.samples = file_samples(argv[4]);
+	if (j.samples < 0 || j.chunk <= 0 || !create_output(j)) {
+		std::fprintf(stderr,"cannot open %s or %s\n",argv[4],argv[5]);
+		return 1;
+	}
+	job_queue queue(argv[2]);
+	if (!queue.write_file("jobs",job,format_spec(j))) return 1;
+	if (j.samples > 0 && !queue.put(ticket_name(job,0))) return 1;
+	std::printf("%s: %ld samples in %ld chunks\n",job.c_str(),j.samples,
+		(j.samples + j.chunk - 1) / j.chunk);
+	return 0;
+}
+
+int cmd_worker(int argc, char** argv)
+{
+	if (argc < 3) return 2;
+	job_queue queue(argv[2]);
+	int const timeout = argc > 3 && argv[3][0] != '-' ? std::atoi(argv[3]) : 30;
+	bool const keep = std::strcmp(argv[argc-1],"--keep") == 0;
+#ifdef WAPLNS_TRACE
+	trace_register_thread("render worker");
+	char const* trace_file = std::getenv("WAPLNS_TRACE_FILE");
+	trace_enable(trace_file != 0);
+#endif
+	int failed = 0;
+	for (;;) {
+		std::string ticket;
+		if (queue.claim(ticket)) {
+			if (!run_chunk(queue,ticket)) {
+				// leave the lease to expire, another worker may have more
+				// luck; claim() gives up on the ticket after a few tries
+				std::fprintf(stderr,"chunk %s failed\n",ticket.c_str());
+				++failed;
+			}
+			continue;
+		}
+		if (queue.recover(timeout) > 0) continue;
+		if (!keep && queue.idle()) break;
+		usleep(200000);
+	}
+#ifdef WAPLNS_TRACE
+	if (trace_file) {
+		if (std::FILE* f = std::fopen(trace_file,"w")) {
+			trace_dump_chrome(f);
+			std::fclose(f);
+		}
+	}
+#endif
+	return failed ? 1 : 0;
+}
+
+int cmd_wait(int argc, char** argv)
+{
+	if (argc < 4) return 2;
+	job_queue queue(argv[2]);
+	int const timeout = argc > 4 ? std::atoi(argv[4]) : 30;
+	std::string text;
+	job_spec j;
+	if (!queue.read_file("jobs",argv[3],text) || !parse_spec(text,j)) return 1;
+	long const chunks = (j.samples + j.chunk - 1) / j.chunk;
+	if (chunks == 0) return 0;
+	// chunks finish in order, so only the first unfinished one can fail
+	for (long c=0; c<chunks; ) {
+		std::string const ticket = ticket_name(argv[3],c);
+		if (queue.is_done(ticket)) {
+			++c;
+			continue;
+		}
+		if (queue.is_failed(ticket)) {
+			std::fprintf(stderr,"chunk %s failed\n",ticket.c_str());
+			return 1;
+		}
+		queue.recover(timeout);
+		sleep(1);
+	}
+	return 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+	std::string const cmd = argc > 1 ? argv[1] : "";
+	int r = 2;
+	if (cmd == "render") r = cmd_render(argc,argv);
+	else if (cmd == "submit") r = cmd_submit(argc,argv);
+	else if (cmd == "worker") r = cmd_worker(argc,argv);
+	else if (cmd == "wait") r = cmd_wait(argc,argv);
+	if (r == 2) {
+		std::fprintf(stderr,
+			"usage: %s render <in> <out> <lambda> <dither> k0 k1 ...\n"
+			"       %s submit <dir> <job> <in> <out> <chunk> <lambda> <dither> k0 k1 ...\n"
+			"       %s worker <dir> [lease_timeout_s] [--keep]\n"
+			"       %s wait <dir> <job> [lease_timeout_s]\n",
+			argv[0],argv[0],argv[0],argv[0]);
+	}
+	return r;
+}
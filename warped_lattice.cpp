@@ -0,0 +1,227 @@
+
+/*
+ * Both directions push y into the lattice: analyze() reads y and emits
+ * x = y + u, synthesize() reads x and emits y = x - u. The scalar filter
+ * takes the lam = 0 shortcut of waplns; the lane kernels need none since
+ * they are bound by latency, not by the FLOPS of D.
+ *
+ * The bank works like uniform_bank: lanes beyond channels_ in the last
+ * group get zero input and keep zero state, orders above the unrolled
+ * ones work on t_ in place.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include "lattice_kernels.hpp"
+#include "warped_lattice.hpp"
+
+inline void warped_lattice::push(float y)
+{
+	double const nu = lambda_ == 0
+		? lattice_push_unwarped(order_,k_,t_,y)
+		: lattice_push(order_,lambda_,k_,t_,y);
+	u_ = static_cast<float>(nu * s2_);
+}
+
+void warped_lattice::set_params(float lam, int ord, float const* k)
+{
+	int const neword = std::min(ord,max_wapl_filt_order);
+	for (int i=0; i<neword; ++i) k_[i] = k[i];
+	for (int i=order_; i<neword; ++i) t_[i] = 0;
+	lambda_ = lam;
+	order_ = neword;
+	double nu;
+	s2_ = static_cast<float>(1.0 / lattice_derived(order_,lambda_,k_,t_,nu));
+	u_ = static_cast<float>(nu * s2_);
+}
+
+void warped_lattice::reset_state()
+{
+	for (int i=0; i<order_; ++i) t_[i] = 0;
+	u_ = 0;
+}
+
+void warped_lattice::get_state(state & st) const
+{
+	for (int i=0; i<order_; ++i) st.t[i] = t_[i];
+	st.u = u_;
+}
+
+void warped_lattice::set_state(state const& st)
+{
+	for (int i=0; i<order_; ++i) t_[i] = st.t[i];
+	u_ = st.u;
+}
+
+void warped_lattice::analyze(float const* in, float* out, int count)
+{
+	for (int n=0; n<count; ++n) {
+		float const y = in[n];
+		out[n] = y + u_;
+		push(y);
+	}
+}
+
+void warped_lattice::synthesize(float const* in, float* out, int count)
+{
+	for (int n=0; n<count; ++n) {
+		float const y = in[n] - u_;
+		out[n] = y;
+		push(y);
+	}
+}
+
+warped_lattice_bank::warped_lattice_bank(int channels, int max_order)
+: own_(0)
+{
+	workspace_spec const spec(max_order,0,channels);
+	own_ = new workspace_buffer(workspace_bytes(spec));
+	workspace_arena ws(own_->data(),own_->size());
+	layout(ws,spec,this);
+	init(spec);
+}
+
+warped_lattice_bank::warped_lattice_bank(workspace_spec const& spec, void* mem,
+	std::size_t bytes)
+: own_(0)
+{
+	workspace_arena ws(mem,bytes);
+	layout(ws,spec,this);
+	init(spec);
+}
+
+warped_lattice_bank::~warped_lattice_bank()
+{
+	delete own_;
+}
+
+std::size_t warped_lattice_bank::workspace_bytes(workspace_spec const& spec)
+{
+	workspace_arena ws;
+	layout(ws,spec,0);
+	return ws.used();
+}
+
+void warped_lattice_bank::layout(workspace_arena & ws, workspace_spec const& spec,
+	warped_lattice_bank* b)
+{
+	std::size_t const ng = (spec.channels + bank_lanes - 1) / bank_lanes;
+	ws.take(b ? &b->t_ : 0,ng * spec.order);
+	ws.take(b ? &b->u_ : 0,ng);
+}
+
+void warped_lattice_bank::init(workspace_spec const& spec)
+{
+	assert(0 < spec.order && spec.order <= max_wapl_filt_order);
+	channels_ = spec.channels;
+	max_order_ = spec.order;
+	t_.resize(t_.capacity());
+	u_.resize(u_.capacity());
+	reset_state();
+}
+
+void warped_lattice_bank::set_params(float lam, int ord, float const* k)
+{
+	assert(0 <= ord && ord <= max_order_);
+	// t_ has room for max_order_ stages, also where asserts are off
+	int const old = proto_.order();
+	proto_.set_params(lam,std::max(0,std::min(ord,max_order_)),k);
+	int const n = proto_.order();
+	float const s2 = 1.0f / proto_.warp_gain();
+	for (int g=0; g<groups(); ++g) {
+		lane_vec* t = &t_[g*max_order_];
+		for (int i=old; i<n; ++i) t[i] = lane_vec{};
+		u_[g] = derived_u_uniform(n,lam,s2,k,t);
+	}
+}
+
+void warped_lattice_bank::reset_state()
+{
+	std::fill(t_.begin(),t_.end(),lane_vec{});
+	std::fill(u_.begin(),u_.end(),lane_vec{});
+}
+
+warped_lattice warped_lattice_bank::channel(int ch) const
+{
+	assert(0 <= ch && ch < channels_);
+	int const g = ch / bank_lanes;
+	int const l = ch % bank_lanes;
+	warped_lattice f = proto_;
+	warped_lattice::state st;
+	for (int i=0; i<order(); ++i) st.t[i] = t_[g*max_order_ + i][l];
+	st.u = u_[g][l];
+	f.set_state(st);
+	return f;
+}
+
+template<bool Analysis>
+void warped_lattice_bank::process(float const* const* in, float* const* out, int count)
+{
+	for (int g0=0; g0<groups(); g0+=lattice_groups) {
+		switch (proto_.order()) {
+		case 1: run<1,Analysis>(g0,in,out,count); break;
+		case 2: run<2,Analysis>(g0,in,out,count); break;
+		case 3: run<3,Analysis>(g0,in,out,count); break;
+		case 4: run<4,Analysis>(g0,in,out,count); break;
+		case 5: run<5,Analysis>(g0,in,out,count); break;
+		case 6: run<6,Analysis>(g0,in,out,count); break;
+		case 7: run<7,Analysis>(g0,in,out,count); break;
+		case 8: run<8,Analysis>(g0,in,out,count); break;
+		default: run<0,Analysis>(g0,in,out,count); break;
+		}
+	}
+}
+
+/*
+ * Filters groups g0 .. g0+lattice_groups-1. Order > 0 works on local
+ * copies of the state, Order = 0 on t_ with the run time order.
+ */
+template<int Order, bool Analysis>
+void warped_lattice_bank::run(int g0, float const* const* in, float* const* out,
+	int count)
+{
+	int const ng = std::min(lattice_groups,groups()-g0);
+	int const ord = proto_.order();
+	float const lam = proto_.lambda();
+	float const s2 = 1.0f / proto_.warp_gain();
+	float k[max_wapl_filt_order];
+	for (int i=0; i<ord; ++i) k[i] = proto_.k(i);
+	int nl[lattice_groups];
+	lane_vec u[lattice_groups];
+	lane_vec t[lattice_groups][Order ? Order : 1];
+	for (int g=0; g<ng; ++g) {
+		nl[g] = std::min(channels_ - (g0+g)*bank_lanes,bank_lanes);
+		u[g] = u_[g0+g];
+		for (int i=0; i<Order; ++i) t[g][i] = t_[(g0+g)*max_order_ + i];
+	}
+	for (int n=0; n<count; ++n) {
+		for (int g=0; g<ng; ++g) {
+			int const c0 = (g0+g)*bank_lanes;
+			// channels staged through an array
+			alignas(32) float v[bank_lanes] = {0};
+			for (int l=0; l<nl[g]; ++l) v[l] = in[c0+l][n];
+			lane_vec const y = Analysis ? lanes(v) : lanes(v) - u[g];
+			lanes(v) = Analysis ? y + u[g] : y;
+			for (int l=0; l<nl[g]; ++l) out[c0+l][n] = v[l];
+			if (Order) {
+				lattice_push_uniform<Order ? Order : 1>(lam,s2,k,u[g],t[g],y);
+			} else {
+				lattice_push_uniform(ord,lam,s2,k,u[g],&t_[(g0+g)*max_order_],y);
+			}
+		}
+	}
+	for (int g=0; g<ng; ++g) {
+		u_[g0+g] = u[g];
+		for (int i=0; i<Order; ++i) t_[(g0+g)*max_order_ + i] = t[g][i];
+	}
+}
+
+void warped_lattice_bank::analyze(float const* const* in, float* const* out, int count)
+{
+	process<true>(in,out,count);
+}
+
+void warped_lattice_bank::synthesize(float const* const* in, float* const* out, int count)
+{
+	process<false>(in,out,count);
+}
@@ -0,0 +1,127 @@
+#ifndef WARPED_LATTICE_HPP_INCLUDED
+#define WARPED_LATTICE_HPP_INCLUDED
+
+#include "lane_kernels.hpp"
+#include "waplns.hpp"
+#include "workspace.hpp"
+
+/**
+ * The warped lattice of waplns as plain filters, for warped LPC spectral
+ * envelopes and pre/post filtering:
+ *
+ *    analyze()    : x = A(D) y, the all-zero warped prediction error
+ *                   filter (whitening)
+ *    synthesize() : y = x / A(D), the all-pole warped filter (envelope)
+ *
+ * A is the polynomial in the allpass D(z) = (z^-1 - lam) / (1 - lam z^-1)
+ * given by lam and the parcor coefficients k, with the conventions of
+ * waplns and wlpc.hpp: k from wlpc_fit() gives a synthesize() whose
+ * response follows the fitted spectrum, and k from levinson() on
+ * warped_autocorr() of a signal gives an analyze() that whitens it. A is
+ * scaled so that x = y + u with u a function of past y only (for lam != 0
+ * that differs from the monic warped polynomial by warp_gain()), so both
+ * directions run the same lattice on y and the state is the history of y
+ * in either case. analyze() followed by synthesize() on a second filter
+ * with the same parameters restores the input up to rounding.
+ *
+ * Block processing; out may be the same array as in.
+ */
+class warped_lattice
+{
+	int order_;
+	float lambda_;
+	float s2_;
+	float u_;
+	float k_[max_wapl_filt_order];
+	float t_[max_wapl_filt_order];
+
+	void push(float y);
+
+public:
+	struct state
+	{
+		float t[max_wapl_filt_order];
+		float u;
+	};
+
+	warped_lattice() : order_(0), lambda_(0), s2_(1), u_(0) {}
+
+	int order() const { return order_; }
+	float lambda() const { return lambda_; }
+	float k(int idx) const { return k_[idx]; }
+	/** 1/s2: the monic warped polynomial is warp_gain() times A */
+	float warp_gain() const { return 1.0f / s2_; }
+
+	/**
+	 * New parameters with the semantics of waplns::set_params(): the
+	 * state is kept, new stages start at zero.
+	 */
+	void set_params(float lam, int ord, float const* k);
+	void reset_state();
+
+	void get_state(state & st) const;
+	void set_state(state const& st);
+
+	void analyze(float const* in, float* out, int count);
+	void synthesize(float const* in, float* out, int count);
+};
+
+/**
+ * warped_lattice for the channels of one multichannel signal with shared
+ * parameters, bank_lanes channels per lane vector, with the kernels and
+ * the layout of uniform_bank: for orders up to max_unrolled_order the
+ * state of lattice_groups groups stays in registers for a whole block.
+ * Computes in float, so results match warped_lattice up to rounding.
+ */
+class warped_lattice_bank
+{
+	int channels_;
+	int max_order_;
+	warped_lattice proto_;        // parameters and derived s2
+	workspace_buffer* own_;
+	ws_array<lane_vec> t_;        // t[group * max_order_ + stage]
+	ws_array<lane_vec> u_;        // u[group]
+
+	warped_lattice_bank(warped_lattice_bank const&);
+	warped_lattice_bank& operator=(warped_lattice_bank const&);
+
+	static void layout(workspace_arena & ws, workspace_spec const& spec,
+		warped_lattice_bank* b);
+	void init(workspace_spec const& spec);
+	int groups() const { return (channels_ + bank_lanes - 1) / bank_lanes; }
+
+	template<bool Analysis>
+	void process(float const* const* in, float* const* out, int count);
+	template<int Order, bool Analysis>
+	void run(int g0, float const* const* in, float* const* out, int count);
+
+public:
+	/** groups filtered side by side, to hide the latency of the lattice */
+	static const int lattice_groups = 2;
+	/** highest order with the state in registers */
+	static const int max_unrolled_order = 8;
+
+	explicit warped_lattice_bank(int channels, int max_order = max_wapl_filt_order);
+	/** spec.channels channels of order up to spec.order in caller memory */
+	warped_lattice_bank(workspace_spec const& spec, void* mem, std::size_t bytes);
+	~warped_lattice_bank();
+
+	static std::size_t workspace_bytes(workspace_spec const& spec);
+
+	int channels() const { return channels_; }
+	int order() const { return proto_.order(); }
+	float lambda() const { return proto_.lambda(); }
+
+	/** as warped_lattice::set_params(), for all channels */
+	void set_params(float lam, int ord, float const* k);
+	void reset_state();
+
+	/** copy of channel ch's filter including its current state */
+	warped_lattice channel(int ch) const;
+
+	/** count samples of every channel, in[ch] / out[ch] */
+	void analyze(float const* const* in, float* const* out, int count);
+	void synthesize(float const* const* in, float* const* out, int count);
+};
+
+#endif // WARPED_LATTICE_HPP_INCLUDED
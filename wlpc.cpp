@@ -0,0 +1,302 @@
+
+/*
+ * wlpc_fit() samples the target on a uniform grid of the warped frequency
+ * v (mapping each v back with wrp(v,-lam)) and takes the cosine transform
+ * with the trapezoidal rule, which is the autocorrelation of a process
+ * with that spectrum in the warped domain. levinson() then gives the
+ * all-pole fit. A tiny white floor keeps r positive definite for targets
+ * with zeros. The cosines cos(m v) come from the Chebyshev recurrence
+ * cos(m v) = 2 cos(v) cos((m-1) v) - cos((m-2) v), one lag per pass over
+ * the grid, instead of a cos() call per lag and grid point.
+ *
+ * Sign: levinson() runs the usual recursion for A(z) = 1 + sum a_i z^-i
+ * with a_m = rho_m in step m. waplns' lattice_step() subtracts k times the
+ * other branch, so its k is -rho.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "lane_kernels.hpp"
+#include "waplns.hpp"
+#include "wlpc.hpp"
+
+namespace { // anonymous
+
+const double pi = 3.14159265358979323846;
+
+// number of grid points in the warped domain for wlpc_fit()
+const int fit_points = 1024;
+// grid points per tile of the cosine transform, divides fit_points
+const int fit_tile = 128;
+
+// samples per block and frame vectors per pass of warped_autocorr_batch()
+const int corr_block = 64;
+const int corr_groups = 2;
+const int corr_lanes = corr_groups * bank_lanes;
+
+/*
+ * Stages of the allpass cascade for one block of corr_groups lane vectors
+ * per sample: y[] holds the input of the first stage and gets the output
+ * of the last one, x[] is the block of the frames themselves. The stages
+ * of one sample form a chain, but a stage of sample j only waits for the
+ * previous stage of sample j and for itself at sample j-1, so the
+ * out-of-order core overlaps consecutive samples. Tiles of a few stages
+ * keep that overlap within reach of the reorder window for any order,
+ * and two independent frame vectors give it enough to choose from.
+ */
+template<int Stages>
+inline void corr_tile(float lam, lane_vec (*t)[corr_groups], lane_vec (*y)[corr_groups],
+	lane_vec const (*x)[corr_groups], int len, double (*r)[corr_groups][bank_lanes])
+{
+	lane_vec tt[Stages][corr_groups], acc[Stages][corr_groups];
+	for (int s=0; s<Stages; ++s) {
+		for (int g=0; g<corr_groups; ++g) {
+			tt[s][g] = t[s][g];
+			acc[s][g] = lane_vec{};
+		}
+	}
+	for (int j=0; j<len; ++j) {
+#pragma GCC unroll 4
+		for (int g=0; g<corr_groups; ++g) {
+			lane_vec v = y[j][g];
+#pragma GCC unroll 8
+			for (int s=0; s<Stages; ++s) {
+				lane_vec const nt = v + lam * tt[s][g];
+				v = tt[s][g] - lam * nt;
+				tt[s][g] = nt;
+				acc[s][g] += v * x[j][g];
+			}
+			y[j][g] = v;
+		}
+	}
+	for (int s=0; s<Stages; ++s) {
+		for (int g=0; g<corr_groups; ++g) {
+			t[s][g] = tt[s][g];
+			for (int l=0; l<bank_lanes; ++l) r[s][g][l] += acc[s][g][l];
+		}
+	}
+}
+
+// cos(pi j / fit_points) for j = 0 .. fit_points
+struct grid_cosines
+{
+	double c[fit_points+1];
+
+	grid_cosines()
+	{
+		for (int j=0; j<=fit_points; ++j) c[j] = std::cos(pi * j / fit_points);
+	}
+};
+
+// r[0..order] of the target p[0..fit_points] sampled on the warped grid.
+// Tiles of fit_tile points run through all lags, so the recurrence state
+// of a tile stays in L1 and is never written back to full grid arrays.
+void grid_autocorr(double const* p, int order, double* r)
+{
+	static grid_cosines const grid;
+	double mean = 0;
+	for (int j=0; j<=fit_points; ++j) mean += p[j];
+	mean /= fit_points + 1;
+	for (int m=0; m<=order; ++m) r[m] = 0;
+	for (int j0=0; j0<fit_points; j0+=fit_tile) {
+		double const* const c = grid.c + j0;
+		double const* const pt = p + j0;
+		double prev[fit_tile], cur[fit_tile];
+		double acc0[4] = {0, 0, 0, 0}, acc1[4] = {0, 0, 0, 0};
+		for (int j=0; j<fit_tile; j+=4) {
+#pragma GCC unroll 4
+			for (int i=0; i<4; ++i) {
+				prev[j+i] = 1;
+				cur[j+i] = c[j+i];
+				acc0[i] += pt[j+i];
+				acc1[i] += pt[j+i] * c[j+i];
+			}
+		}
+		r[0] += acc0[0] + acc0[1] + acc0[2] + acc0[3];
+		if (order > 0) r[1] += acc1[0] + acc1[1] + acc1[2] + acc1[3];
+		for (int m=2; m<=order; ++m) {
+			// four partial sums, one chain of adds would bound the loop
+			double acc[4] = {0, 0, 0, 0};
+			for (int j=0; j<fit_tile; j+=4) {
+#pragma GCC unroll 4
+				for (int i=0; i<4; ++i) {
+					double const next = 2 * c[j+i] * cur[j+i] - prev[j+i];
+					prev[j+i] = cur[j+i];
+					cur[j+i] = next;
+					acc[i] += pt[j+i] * next;
+				}
+			}
+			r[m] += acc[0] + acc[1] + acc[2] + acc[3];
+		}
+	}
+	// trapezoidal rule: the last point at cos(pi m) = (-1)^m, both ends halved
+	for (int m=0; m<=order; ++m) {
+		double const last = m & 1 ? -p[fit_points] : p[fit_points];
+		r[m] = (r[m] - 0.5 * p[0] + 0.5 * last) / fit_points;
+	}
+	r[0] += 1e-9 * mean;
+}
+
+} // anonymous namespace
+
+double warp_frequency(double w, double lam)
+{
+	return w + 2 * std::atan2(lam * std::sin(w), 1 - lam * std::cos(w));
+}
+
+float warp_lambda_for(double w)
+{
+	// wrp(w,lam) grows with lam, so bisect
+	double lo = -0.99, hi = 0.99;
+	for (int i=0; i<60; ++i) {
+		double const mid = 0.5 * (lo + hi);
+		if (warp_frequency(w,mid) < 0.5 * pi) lo = mid; else hi = mid;
+	}
+	return static_cast<float>(0.5 * (lo + hi));
+}
+
+float warp_lambda_bark(double fs)
+{
+	return static_cast<float>(1.0674 * std::sqrt(2 / pi * std::atan(0.06583 * fs / 1000))
+		- 0.1916);
+}
+
+double ath_db(double f)
+{
+	double const k = std::max(f,20.0) / 1000;
+	return 3.64 * std::pow(k,-0.8) - 6.5 * std::exp(-0.6 * (k-3.3) * (k-3.3))
+		+ 1e-3 * k * k * k * k;
+}
+
+void warped_autocorr(float const* x, int n, float lam, int order, double* r)
+{
+	for (int i=0; i<=order; ++i) r[i] = 0;
+	double t[max_wapl_filt_order+1] = {0};
+	for (int j=0; j<n; ++j) {
+		// y runs through the allpass cascade, t[i] is the state of stage i
+		double y = x[j];
+		r[0] += y * x[j];
+		for (int i=0; i<order; ++i) {
+			double const nt = y + lam * t[i];
+			y = t[i] - lam * nt;
+			t[i] = nt;
+			r[i+1] += y * x[j];
+		}
+	}
+}
+
+void warped_autocorr_batch(int frames, float const* const* x, int n,
+	float lam, int order, double* r)
+{
+	lane_vec t[max_wapl_filt_order][corr_groups];
+	lane_vec xb[corr_block][corr_groups], yb[corr_block][corr_groups];
+	double acc[max_wapl_filt_order+1][corr_groups][bank_lanes];
+	for (int f0=0; f0<frames; f0+=corr_lanes) {
+		int const nl = std::min(frames-f0,corr_lanes);
+		for (int i=0; i<order; ++i) {
+			for (int g=0; g<corr_groups; ++g) t[i][g] = lane_vec{};
+		}
+		std::memset(acc,0,sizeof(acc));
+		for (int j0=0; j0<n; j0+=corr_block) {
+			int const len = std::min(n-j0,corr_block);
+			for (int j=0; j<len; ++j) {
+				for (int g=0; g<corr_groups; ++g) {
+					for (int l=0; l<bank_lanes; ++l) {
+						int const f = g*bank_lanes + l;
+						xb[j][g][l] = f<nl ? x[f0+f][j0+j] : 0.0f;
+					}
+					yb[j][g] = xb[j][g];
+				}
+			}
+			for (int g=0; g<corr_groups; ++g) {
+				lane_vec a0 = {0};
+				for (int j=0; j<len; ++j) a0 += xb[j][g] * xb[j][g];
+				for (int l=0; l<bank_lanes; ++l) acc[0][g][l] += a0[l];
+			}
+			int i = 0;
+			for (; i+4<=order; i+=4) corr_tile<4>(lam,t+i,yb,xb,len,acc+i+1);
+			switch (order-i) {
+			case 3: corr_tile<3>(lam,t+i,yb,xb,len,acc+i+1); break;
+			case 2: corr_tile<2>(lam,t+i,yb,xb,len,acc+i+1); break;
+			case 1: corr_tile<1>(lam,t+i,yb,xb,len,acc+i+1); break;
+			}
+		}
+		for (int f=0; f<nl; ++f) {
+			int const g = f / bank_lanes, l = f % bank_lanes;
+			for (int i=0; i<=order; ++i) r[(f0+f)*(order+1)+i] = acc[i][g][l];
+		}
+	}
+}
+
+double levinson(double const* r, int order, float* k)
+{
+	double a[max_wapl_filt_order+1] = {1};
+	double tmp[max_wapl_filt_order+1];
+	double err = r[0];
+	int m = 0;
+	for (; m<order && r[0] > 0; ++m) {
+		double acc = r[m+1];
+		for (int i=1; i<=m; ++i) acc += a[i] * r[m+1-i];
+		double const rho = -acc / err;
+		if (!(std::fabs(rho) < 1)) break;
+		for (int i=1; i<=m; ++i) tmp[i] = a[i] + rho * a[m+1-i];
+		for (int i=1; i<=m; ++i) a[i] = tmp[i];
+		a[m+1] = rho;
+		err *= 1 - rho * rho;
+		k[m] = static_cast<float>(-rho);
+	}
+	for (; m<order; ++m) k[m] = 0;
+	return r[0] > 0 ? err / r[0] : 1;
+}
+
+double wlpc_fit(float const* power, int nbins, float lam, int order, float* k)
+{
+	double p[fit_points+1];
+	for (int j=0; j<=fit_points; ++j) {
+		double const v = pi * j / fit_points;
+		double const pos = warp_frequency(v,-lam) / pi * (nbins - 1);
+		int const i = std::min(static_cast<int>(pos),nbins-2);
+		double const f = pos - i;
+		p[j] = (1 - f) * power[i] + f * power[i+1];
+	}
+	double r[max_wapl_filt_order+1];
+	grid_autocorr(p,order,r);
+	return levinson(r,order,k);
+}
+
+wlpc_fitter::wlpc_fitter(int nbins, float lam)
+: nbins_(nbins), lam_(lam), bin_(fit_points+1), frac_(fit_points+1)
+{
+	for (int j=0; j<=fit_points; ++j) {
+		double const v = pi * j / fit_points;
+		double const pos = warp_frequency(v,-lam) / pi * (nbins - 1);
+		bin_[j] = std::min(static_cast<int>(pos),nbins-2);
+		frac_[j] = pos - bin_[j];
+	}
+}
+
+double wlpc_fitter::fit(float const* power, int order, float* k) const
+{
+	double p[fit_points+1];
+	for (int j=0; j<=fit_points; ++j) {
+		int const i = bin_[j];
+		p[j] = (1 - frac_[j]) * power[i] + frac_[j] * power[i+1];
+	}
+	double r[max_wapl_filt_order+1];
+	grid_autocorr(p,order,r);
+	return levinson(r,order,k);
+}
+
+double design_band_shaper(double w_lo, double w_hi, double depth, int order,
+	float & lam, float* k)
+{
+	int const nbins = 512;
+	float power[nbins];
+	for (int i=0; i<nbins; ++i) {
+		double const w = pi * i / (nbins - 1);
+		power[i] = w_lo <= w && w <= w_hi ? static_cast<float>(depth) : 1.0f;
+	}
+	lam = warp_lambda_for(0.5 * (w_lo + w_hi));
+	return wlpc_fit(power,nbins,lam,order,k);
+}
@@ -0,0 +1,108 @@
+#ifndef WLPC_HPP_INCLUDED
+#define WLPC_HPP_INCLUDED
+
+#include <vector>
+
+/**
+ * Warped linear prediction: the analysis side that turns a signal or a
+ * desired noise spectrum into parameters for waplns.
+ *
+ * Frequencies are normalized to radians per sample (0..pi). The warping
+ * is the one of waplns: the allpass D(z) = (z^-1 - lam) / (1 - lam z^-1)
+ * maps frequency w to
+ *
+ *    wrp(w,lam) = w + 2 atan(lam sin w / (1 - lam cos w))
+ *
+ * and wrp(wrp(w,lam),-lam) = w. The shaped noise of waplns has the power
+ * spectrum |1/A(e^(-j wrp(w,lam)))|^2 times the white quantization error
+ * power, where A is the monic polynomial given by its parcor coefficients.
+ * The k produced here follow the sign convention of waplns::set_params().
+ */
+
+/** the frequency warping of waplns (see above) */
+double warp_frequency(double w, double lam);
+
+/** lambda that maps w to pi/2, i.e. puts half of the resolution below w */
+float warp_lambda_for(double w);
+
+/**
+ * lambda whose warping approximates the Bark scale at sample rate fs
+ * (Smith and Abel), for perceptual targets
+ */
+float warp_lambda_bark(double fs);
+
+/**
+ * Terhardt's approximation of the threshold in quiet in dB SPL at f Hz,
+ * taken as constant below 20 Hz
+ */
+double ath_db(double f);
+
+/**
+ * Warped autocorrelation r[0..order] of n samples of x: r[i] is the sum of
+ * x[n] * (D^i x)[n] with D applied i times, starting from zero state.
+ */
+void warped_autocorr(float const* x, int n, float lam, int order, double* r);
+
+/**
+ * warped_autocorr() for many frames at once: frame f has n samples in
+ * x[f] and gets r[f*(order+1) + i]. Frames are processed bank_lanes per
+ * vector, two vectors at a time, with the allpass cascade computed once
+ * per sample and stage and every stage output used for its lag right
+ * away. Float arithmetic with double accumulation per block of samples,
+ * so results differ from warped_autocorr() in the low bits.
+ */
+void warped_autocorr_batch(int frames, float const* const* x, int n,
+	float lam, int order, double* r);
+
+/**
+ * Levinson-Durbin recursion: parcor coefficients k[0..order) from r[0..order].
+ * Returns the prediction error power relative to r[0] (1 = no gain).
+ * If r is not positive definite the recursion stops early and the
+ * remaining k are zero.
+ */
+double levinson(double const* r, int order, float* k);
+
+/**
+ * Fits a warped all-pole model to a power spectrum: power[0..nbins) holds
+ * the target at frequencies pi * i / (nbins - 1). Computes the warped
+ * autocorrelation of the target, then k by levinson(). Returns the
+ * flatness: the white noise power that the shaped noise is relative to
+ * the target (the fit matches shape, not level).
+ */
+double wlpc_fit(float const* power, int nbins, float lam, int order, float* k);
+
+/**
+ * wlpc_fit() for a stream of targets on one frequency grid and lambda, as
+ * in per-block adaptation: the warped sampling positions are computed at
+ * construction, so fit() is an interpolation, a cosine transform by
+ * recurrence and levinson(), with no trigonometric calls. Same results as
+ * wlpc_fit() up to rounding.
+ */
+class wlpc_fitter
+{
+	int nbins_;
+	float lam_;
+	std::vector<int> bin_;        // per grid point: left target bin ...
+	std::vector<double> frac_;    // ... and the weight of the right one
+
+public:
+	wlpc_fitter(int nbins, float lam);
+
+	int bins() const { return nbins_; }
+	float lambda() const { return lam_; }
+
+	/** power[0..bins()) as for wlpc_fit(); returns the same */
+	double fit(float const* power, int order, float* k) const;
+};
+
+/**
+ * Designs a shaper that moves noise out of the band [w_lo, w_hi]: the
+ * target is depth (power ratio < 1) inside the band and 1 outside. lam is
+ * chosen with warp_lambda_for() at the band centre, so the warped model
+ * spends its resolution where the band edges are. Returns the same as
+ * wlpc_fit().
+ */
+double design_band_shaper(double w_lo, double w_hi, double depth, int order,
+	float & lam, float* k);
+
+#endif // WLPC_HPP_INCLUDED
@@ -0,0 +1,72 @@
+
+/*
+ * Transparent huge pages only back 2 MiB aligned ranges, and mmap()
+ * aligns to the base page size, so the transparent case maps one huge
+ * page more than needed and unmaps the misaligned head and tail. Whether
+ * the kernel actually uses huge pages there is up to its THP settings;
+ * pages() reports what was asked for successfully, not what was granted.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include "workspace.hpp"
+
+namespace { // anonymous
+
+const std::size_t huge_page = std::size_t(2) << 20;
+
+} // anonymous namespace
+
+workspace_buffer::workspace_buffer(std::size_t bytes, workspace_pages want)
+: mem_(0), bytes_(bytes), mapped_(0), pages_(normal_pages)
+{
+	if (want != normal_pages && map(bytes,want)) return;
+	if (posix_memalign(&mem_,workspace_align,bytes ? bytes : 1) != 0) {
+		throw std::bad_alloc();
+	}
+}
+
+workspace_buffer::~workspace_buffer()
+{
+	if (mapped_) munmap(mem_,mapped_);
+	else std::free(mem_);
+}
+
+bool workspace_buffer::map(std::size_t bytes, workspace_pages want)
+{
+	std::size_t const len = (bytes + huge_page - 1) / huge_page * huge_page;
+	if (len == 0) return false;
+#ifdef MAP_HUGETLB
+	if (want == explicit_huge_pages) {
+		void* const p = mmap(0,len,PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+		if (p != MAP_FAILED) {
+			mem_ = p;
+			mapped_ = len;
+			bytes_ = len;
+			pages_ = explicit_huge_pages;
+			return true;
+		}
+	}
+#endif
+#ifdef MADV_HUGEPAGE
+	unsigned char* const raw = static_cast<unsigned char*>(mmap(0,len+huge_page,
+		PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0));
+	if (raw == MAP_FAILED) return false;
+	std::uintptr_t const a = reinterpret_cast<std::uintptr_t>(raw);
+	std::size_t const head = (huge_page - a % huge_page) % huge_page;
+	if (head) munmap(raw,head);
+	if (huge_page - head) munmap(raw + head + len,huge_page - head);
+	mem_ = raw + head;
+	mapped_ = len;
+	bytes_ = len;
+	pages_ = madvise(mem_,len,MADV_HUGEPAGE) == 0
+		? transparent_huge_pages : normal_pages;
+	return true;
+#else
+	(void)want;
+	return false;
+#endif
+}
@@ -0,0 +1,154 @@
+#ifndef WORKSPACE_HPP_INCLUDED
+#define WORKSPACE_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+
+/**
+ * Preallocated scratch memory for the shaping engines.
+ *
+ * An engine that needs more than fixed-size members describes its memory
+ * in terms of a workspace_spec and offers
+ *
+ *    static std::size_t workspace_bytes(workspace_spec const& spec);
+ *    engine(workspace_spec const& spec, void* mem, std::size_t bytes);
+ *
+ * The caller provides mem (aligned to workspace_align, e.g. from a
+ * workspace_buffer or huge pages) and keeps it alive as long as the
+ * engine. After construction the engine never allocates; operations that
+ * would exceed the spec are precondition violations (asserts).
+ *
+ * Engines lay out their memory with one function taking a
+ * workspace_arena, which either counts (no memory) or hands out pieces,
+ * so the reported size and the actual layout cannot disagree.
+ */
+
+const std::size_t workspace_align = 64;
+
+struct workspace_spec
+{
+	int order;    // highest filter order
+	int block;    // longest block in samples
+	int channels; // streams, series or channels, depending on the engine
+
+	workspace_spec(int ord, int blk, int ch)
+	: order(ord), block(blk), channels(ch) {}
+};
+
+/**
+ * A vector-like array of trivially copyable T with a fixed capacity in
+ * workspace memory. Growing past the capacity is an error.
+ */
+template<class T>
+class ws_array
+{
+	T* data_;
+	std::size_t size_;
+	std::size_t cap_;
+
+public:
+	ws_array() : data_(0), size_(0), cap_(0) {}
+
+	void attach(T* p, std::size_t cap) { data_ = p; size_ = 0; cap_ = cap; }
+
+	std::size_t size() const { return size_; }
+	std::size_t capacity() const { return cap_; }
+	bool empty() const { return size_ == 0; }
+
+	T & operator[](std::size_t i) { assert(i<size_); return data_[i]; }
+	T const& operator[](std::size_t i) const { assert(i<size_); return data_[i]; }
+	T* begin() { return data_; }
+	T* end() { return data_ + size_; }
+	T const* begin() const { return data_; }
+	T const* end() const { return data_ + size_; }
+	T & back() { assert(size_>0); return data_[size_-1]; }
+
+	void clear() { size_ = 0; }
+	void push_back(T const& v) { assert(size_<cap_); data_[size_++] = v; }
+	void resize(std::size_t n) { assert(n<=cap_); size_ = n; }
+	void assign(std::size_t n, T const& v)
+	{
+		resize(n);
+		for (std::size_t i=0; i<n; ++i) data_[i] = v;
+	}
+};
+
+/**
+ * Hands out aligned pieces of a block of memory, or only counts bytes when
+ * constructed without memory.
+ */
+class workspace_arena
+{
+	unsigned char* base_;
+	std::size_t size_;
+	std::size_t used_;
+
+public:
+	/** counting arena */
+	workspace_arena() : base_(0), size_(0), used_(0) {}
+
+	workspace_arena(void* mem, std::size_t bytes)
+	: base_(static_cast<unsigned char*>(mem)), size_(bytes), used_(0)
+	{
+		assert(reinterpret_cast<std::size_t>(mem) % workspace_align == 0);
+	}
+
+	template<class T>
+	T* take(std::size_t n)
+	{
+		used_ = (used_ + workspace_align - 1) / workspace_align * workspace_align;
+		T* const p = base_ ? reinterpret_cast<T*>(base_ + used_) : 0;
+		used_ += n * sizeof(T);
+		assert(!base_ || used_ <= size_);
+		return p;
+	}
+
+	/** places a (if any, counting arenas pass none) */
+	template<class T>
+	void take(ws_array<T>* a, std::size_t n)
+	{
+		T* const p = take<T>(n);
+		if (a) a->attach(p,n);
+	}
+
+	std::size_t used() const { return used_; }
+};
+
+/** page backing of a workspace_buffer */
+enum workspace_pages
+{
+	normal_pages,
+	transparent_huge_pages, // madvise(MADV_HUGEPAGE) on a 2 MiB aligned map
+	explicit_huge_pages     // MAP_HUGETLB, needs reserved huge pages
+};
+
+/**
+ * Owned memory aligned to workspace_align, for engines that own theirs
+ * and for large I/O buffers. Huge pages cut TLB misses on buffers of many
+ * megabytes; asking for explicit ones falls back to transparent ones and
+ * those to normal pages, pages() tells what was obtained. Huge page
+ * buffers are rounded up to whole 2 MiB pages and start zeroed.
+ */
+class workspace_buffer
+{
+	void* mem_;
+	std::size_t bytes_;
+	std::size_t mapped_;    // length of the mapping, 0 if from the heap
+	workspace_pages pages_;
+
+	workspace_buffer(workspace_buffer const&);
+	workspace_buffer& operator=(workspace_buffer const&);
+
+	bool map(std::size_t bytes, workspace_pages want);
+
+public:
+	explicit workspace_buffer(std::size_t bytes,
+		workspace_pages want = normal_pages);
+	~workspace_buffer();
+
+	void* data() const { return mem_; }
+	std::size_t size() const { return bytes_; }
+	workspace_pages pages() const { return pages_; }
+};
+
+#endif // WORKSPACE_HPP_INCLUDED